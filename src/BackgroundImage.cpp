@@ -19,7 +19,11 @@
 #include "BackgroundImage.h"
 
 // Qt includes
+#include <QBuffer>
 #include <QDataStream>
+#include <QFile>
+#include <QImageReader>
+#include <QPixmap>
 
 // KF5 includes
 #include <KLocalizedString>
@@ -31,12 +35,19 @@
 BackgroundImage::BackgroundImage(const QUrl &url, const QRect &location)
     :   m_url(url),
         m_location(location),
-        m_visible(true)
+        m_visible(true),
+        m_status(false)
 {
-    m_status = m_image.load(m_url.path());
+    QFile file(m_url.path());
 
-    if (m_status) {
-        generateIcon();
+    if (file.open(QIODevice::ReadOnly)) {
+        m_data = file.readAll();
+
+        // only the header is read to check the image, it is decoded when first drawn
+        QBuffer buffer(&m_data);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer);
+        m_status = reader.canRead();
     }
 }
 
@@ -67,12 +78,57 @@ bool BackgroundImage::isValid() const
 
 const QImage &BackgroundImage::image() const
 {
+    if (m_image.isNull() && !m_data.isEmpty()) {
+        m_image = QImage::fromData(m_data);
+    }
+
     return m_image;
 }
 
 
+const QImage &BackgroundImage::image(const QSize &size) const
+{
+    const QImage *reduced = &image();
+
+    if (size.isEmpty()) {
+        return *reduced;
+    }
+
+    for (int level = 0 ; reduced->width() / 2 >= size.width() && reduced->height() / 2 >= size.height() ; ++level) {
+        if (level == m_reduced.count()) {
+            m_reduced.append(reduced->scaled(reduced->width() / 2, reduced->height() / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+        }
+
+        reduced = &m_reduced.at(level);
+    }
+
+    return *reduced;
+}
+
+
 const QIcon &BackgroundImage::icon() const
 {
+    if (m_icon.isNull() && m_status) {
+        QImage iconImage;
+
+        if (m_image.isNull() && !m_data.isEmpty()) {
+            // decode directly at the icon size, which is much faster for some formats than decoding the whole image
+            QBuffer buffer;
+            buffer.setData(m_data);
+            QImageReader reader(&buffer);
+
+            if (reader.size().isValid()) {
+                reader.setScaledSize(reader.size().scaled(64, 64, Qt::KeepAspectRatio));
+            }
+
+            iconImage = reader.read();
+        } else {
+            iconImage = image(QSize(64, 64));
+        }
+
+        m_icon = QPixmap::fromImage(iconImage).scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+
     return m_icon;
 }
 
@@ -89,9 +145,18 @@ void BackgroundImage::setVisible(bool visible)
 }
 
 
-void BackgroundImage::generateIcon()
+QByteArray BackgroundImage::encodedImage() const
 {
-    m_icon = QPixmap::fromImage(m_image).scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    if (!m_data.isEmpty() || m_image.isNull()) {
+        return m_data;
+    }
+
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    m_image.save(&buffer, "PNG");
+
+    return data;
 }
 
 
@@ -102,7 +167,7 @@ QDataStream &operator<<(QDataStream &stream, const BackgroundImage &backgroundIm
     stream << backgroundImage.m_location;
     stream << backgroundImage.m_visible;
     stream << backgroundImage.m_status;
-    stream << backgroundImage.m_image;
+    stream << backgroundImage.encodedImage();
     return stream;
 }
 
@@ -114,13 +179,20 @@ QDataStream &operator>>(QDataStream &stream, BackgroundImage &backgroundImage)
     stream >> version;
 
     switch (version) {
+    case 102:
+        stream >> backgroundImage.m_url;
+        stream >> backgroundImage.m_location;
+        stream >> backgroundImage.m_visible;
+        stream >> backgroundImage.m_status;
+        stream >> backgroundImage.m_data;
+        break;
+
     case 101:
         stream >> backgroundImage.m_url;
         stream >> backgroundImage.m_location;
         stream >> backgroundImage.m_visible;
         stream >> backgroundImage.m_status;
         stream >> backgroundImage.m_image;
-        backgroundImage.generateIcon();
         break;
 
     case 100:
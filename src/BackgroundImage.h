@@ -20,10 +20,12 @@
 
 
 // Qt includes
+#include <QByteArray>
 #include <QIcon>
 #include <QImage>
 #include <QRect>
 #include <QUrl>
+#include <QVector>
 
 
 // Forward declaration of Qt classes
@@ -32,9 +34,11 @@ class QDataStream;
 
 /**
  * This class defines a background image including the area it occupies on the
- * canvas, its visibility state and its original source url.  It also stores an
- * icon for display in the menus and a Qimage which is scaled to fit the canvas
- * zoom factor.
+ * canvas, its visibility state and its original source url.  It stores the
+ * image in the compressed encoding of its source file, which is only decoded
+ * when the image or the icon for display in the menus is first needed.  A chain
+ * of images each half the size of the previous one is kept so that the canvas
+ * can draw a version close to the size it is displayed at.
  */
 class BackgroundImage
 {
@@ -85,13 +89,24 @@ public:
     bool isValid() const;
 
     /**
-     * Get the QImage of the background image. This will be used to paint onto
-     * the canvas.
+     * Get the QImage of the background image, decoding it if it has not been
+     * decoded yet.
      *
      * @return a const reference to a QImage representing the image
      */
     const QImage &image() const;
 
+    /**
+     * Get a version of the image for painting onto the canvas at a size. This
+     * is the smallest image of the chain that is at least the size required,
+     * the reduced images being created as they are first needed.
+     *
+     * @param size is a const reference to a QSize of the area painted in device pixels
+     *
+     * @return a const reference to a QImage representing the image
+     */
+    const QImage &image(const QSize &size) const;
+
     /**
      * Get the QIcon of the background image. This is used in the menus to show
      * which image any action would apply to.
@@ -137,19 +152,25 @@ public:
 
 private:
     /**
-     * Generate the QIcon from the image data. Used after reading from a file.
+     * Get the encoded image to be streamed. Images read from files before
+     * version 102 have no source encoding and are encoded as PNG.
+     *
+     * @return a QByteArray of the encoded image
      */
-    void generateIcon();
+    QByteArray encodedImage() const;
 
-    static const int version = 101; /**< The version of the streamed object */
-    // no longer store m_icon, generate it on loading
+    static const int version = 102; /**< The version of the streamed object */
+    // no longer store m_icon or the decoded image, generate them when needed
 
     QUrl    m_url;      /**< The URL of the source file */
     QRect   m_location; /**< The area of the canvas occupied by the image */
     bool    m_visible;  /**< The visibility state, @c true if visible, @c false otherwise */
     bool    m_status;   /**< The validity state of the class instance, @c true if valid, @c false otherwise */
-    QImage  m_image;    /**< The image read from the URL */
-    QIcon   m_icon;     /**< An icon of the image */
+    QByteArray  m_data; /**< The contents of the source file */
+
+    mutable QImage  m_image;            /**< The decoded image, null until needed */
+    mutable QVector<QImage> m_reduced;  /**< The reduced images, each half the size of the previous */
+    mutable QIcon   m_icon;             /**< An icon of the image, null until needed */
 };
 
 
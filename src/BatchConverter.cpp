@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include "BatchConverter.h"
+
+#include <QAtomicInt>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+
+#include <KLocalizedString>
+
+#include <string.h>
+
+#include "configuration.h"
+#include "Document.h"
+#include "DocumentFloss.h"
+#include "Exceptions.h"
+#include "Floss.h"
+#include "FlossScheme.h"
+#include "ImageConverter.h"
+#include "SchemeManager.h"
+#include "StitchData.h"
+#include "SymbolLibrary.h"
+#include "SymbolManager.h"
+
+
+static QMutex reportMutex;
+
+
+/**
+    Write a line to stderr, the lines from the conversion threads are not mixed.
+    */
+static void report(const QString &message)
+{
+    QMutexLocker locker(&reportMutex);
+    QTextStream stream(stderr);
+    stream << message << endl;
+}
+
+
+/**
+    Convert one image on a pool thread.
+    */
+class ConvertTask : public QRunnable
+{
+public:
+    ConvertTask(const BatchConverter *converter, const QString &source, QAtomicInt *failures)
+        :   m_converter(converter),
+            m_source(source),
+            m_failures(failures)
+    {
+    }
+
+    virtual void run() Q_DECL_OVERRIDE
+    {
+        QString message;
+
+        if (m_converter->convertFile(m_source, message)) {
+            report(message);
+        } else {
+            report(i18n("%1: %2", m_source, message));
+            m_failures->ref();
+        }
+    }
+
+private:
+    const BatchConverter    *m_converter;
+    QString                 m_source;
+    QAtomicInt              *m_failures;
+};
+
+
+/**
+    Constructor.  The settings default to those of the import image dialog.
+    */
+BatchConverter::BatchConverter()
+    :   m_scale(100),
+        m_useFractionals(Configuration::import_UseFractionals()),
+        m_dithering(static_cast<FlossQuantizer::Dithering>(Configuration::import_Dithering()))
+{
+    m_schemeName = Configuration::palette_DefaultScheme();
+
+    if (SchemeManager::scheme(m_schemeName) == nullptr) {
+        m_schemeName = SchemeManager::schemes().at(m_schemeName.toInt());
+    }
+
+    m_symbolIndexes = SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes();
+    m_colors = m_symbolIndexes.count();
+
+    if (Configuration::import_UseMaximumColors()) {
+        m_colors = qMin(m_colors, Configuration::import_MaximumColors());
+    }
+
+    m_horizontalClothCount = Configuration::editor_HorizontalClothCount();
+    m_verticalClothCount = Configuration::editor_VerticalClothCount();
+}
+
+
+/**
+    Add the batch conversion options to a QCommandLineParser.
+    */
+void BatchConverter::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption(QStringList() << QStringLiteral("b") << QStringLiteral("batch"), i18n("Convert the images given to patterns without showing any windows. Wildcards are expanded and @file reads a list of images from file.")));
+    parser.addOption(QCommandLineOption(QStringLiteral("scheme"), i18n("The floss scheme used by converted images."), i18n("name")));
+    parser.addOption(QCommandLineOption(QStringLiteral("colors"), i18n("The maximum number of colors in converted images."), i18n("count")));
+    parser.addOption(QCommandLineOption(QStringLiteral("horizontal-cloth-count"), i18n("The horizontal cloth count of converted images."), i18n("count")));
+    parser.addOption(QCommandLineOption(QStringLiteral("vertical-cloth-count"), i18n("The vertical cloth count of converted images, defaults to the horizontal cloth count if that is given."), i18n("count")));
+    parser.addOption(QCommandLineOption(QStringLiteral("scale"), i18n("The size of converted patterns as a percentage of the image size."), i18n("percent")));
+    parser.addOption(QCommandLineOption(QStringLiteral("fractionals"), i18n("Use fractional stitches for converted images.")));
+    parser.addOption(QCommandLineOption(QStringLiteral("dithering"), i18n("The dithering used for converted images, one of none, floyd-steinberg, atkinson or ordered."), i18n("mode")));
+    parser.addOption(QCommandLineOption(QStringLiteral("output"), i18n("The directory converted patterns are written to, defaults to the directory of each image."), i18n("directory")));
+}
+
+
+/**
+    Check if a batch conversion is requested before the application is created.
+    @return true if the batch option is present
+    */
+bool BatchConverter::requested(int argc, char **argv)
+{
+    for (int i = 1 ; i < argc ; ++i) {
+        if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--batch") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+    Take the settings from the command line, reporting any that are not valid.
+    @return true if the settings are valid, false otherwise
+    */
+bool BatchConverter::setOptions(const QCommandLineParser &parser)
+{
+    bool ok = true;
+
+    if (parser.isSet(QStringLiteral("scheme"))) {
+        m_schemeName = parser.value(QStringLiteral("scheme"));
+
+        if (SchemeManager::scheme(m_schemeName) == nullptr) {
+            report(i18n("Unknown floss scheme %1, the schemes available are %2.", m_schemeName, SchemeManager::schemes().join(QStringLiteral(", "))));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("colors"))) {
+        bool valid;
+        m_colors = parser.value(QStringLiteral("colors")).toInt(&valid);
+
+        if (!valid || m_colors < 1 || m_colors > m_symbolIndexes.count()) {
+            report(i18n("The number of colors must be between 1 and %1, the number of symbols available.", m_symbolIndexes.count()));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("horizontal-cloth-count"))) {
+        bool valid;
+        m_horizontalClothCount = parser.value(QStringLiteral("horizontal-cloth-count")).toDouble(&valid);
+        m_verticalClothCount = m_horizontalClothCount;
+
+        if (!valid || m_horizontalClothCount <= 0) {
+            report(i18n("The horizontal cloth count must be greater than 0."));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("vertical-cloth-count"))) {
+        bool valid;
+        m_verticalClothCount = parser.value(QStringLiteral("vertical-cloth-count")).toDouble(&valid);
+
+        if (!valid || m_verticalClothCount <= 0) {
+            report(i18n("The vertical cloth count must be greater than 0."));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("scale"))) {
+        bool valid;
+        m_scale = parser.value(QStringLiteral("scale")).toInt(&valid);
+
+        if (!valid || m_scale < 1) {
+            report(i18n("The scale must be a percentage greater than 0."));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("fractionals"))) {
+        m_useFractionals = true;
+    }
+
+    if (parser.isSet(QStringLiteral("dithering"))) {
+        QStringList modes;
+        modes << QStringLiteral("none") << QStringLiteral("floyd-steinberg") << QStringLiteral("atkinson") << QStringLiteral("ordered");
+        int mode = modes.indexOf(parser.value(QStringLiteral("dithering")).toLower());
+
+        if (mode == -1) {
+            report(i18n("The dithering must be one of %1.", modes.join(QStringLiteral(", "))));
+            ok = false;
+        } else {
+            m_dithering = static_cast<FlossQuantizer::Dithering>(mode);
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("output"))) {
+        m_outputDirectory = parser.value(QStringLiteral("output"));
+
+        if (!QDir().mkpath(m_outputDirectory)) {
+            report(i18n("Failed to create the directory %1.", m_outputDirectory));
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+
+/**
+    Convert a list of images, sharing them between the threads of a pool and
+    each conversion using its share of the cores.
+    @param sources the paths of the images
+    @return the number of images that failed to convert
+    */
+int BatchConverter::convert(const QStringList &sources)
+{
+    if (sources.isEmpty()) {
+        report(i18n("No images to convert."));
+        return 1;
+    }
+
+    // initialise Magick and create the index and lookup of the scheme here,
+    // rather than on the conversion threads
+    Magick::InitializeMagick(nullptr);
+    SchemeManager::scheme(m_schemeName)->createLookup();
+
+    QAtomicInt failures(0);
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMin(pool.maxThreadCount(), sources.count()));
+
+    // the cores are shared between the images converted at once, rather than
+    // every conversion starting a thread for each core
+    ImageConverter::setMaxThreadCount(QThread::idealThreadCount() / pool.maxThreadCount());
+
+    foreach (const QString &source, sources) {
+        pool.start(new ConvertTask(this, source, &failures));
+    }
+
+    pool.waitForDone();
+
+    return failures.load();
+}
+
+
+/**
+    Expand wildcards and lists of images given on the command line.
+    @param arguments the arguments, each is a path, a path with wildcards in
+    the file name or @ followed by the path of a file listing an image on each line
+    @return the paths of the images
+    */
+QStringList BatchConverter::expand(const QStringList &arguments)
+{
+    QStringList paths;
+
+    foreach (const QString &argument, arguments) {
+        if (argument.startsWith(QLatin1Char('@'))) {
+            QFile list(argument.mid(1));
+
+            if (list.open(QIODevice::ReadOnly | QIODevice::Text)) {
+                QTextStream stream(&list);
+
+                while (!stream.atEnd()) {
+                    QString line = stream.readLine().trimmed();
+
+                    if (!line.isEmpty()) {
+                        paths.append(line);
+                    }
+                }
+            } else {
+                report(i18n("Failed to read the list of images %1.", list.fileName()));
+            }
+        } else if (argument.contains(QLatin1Char('*')) || argument.contains(QLatin1Char('?')) || argument.contains(QLatin1Char('['))) {
+            QFileInfo fileInfo(argument);
+            QDir dir = fileInfo.dir();
+
+            foreach (const QString &name, dir.entryList(QStringList(fileInfo.fileName()), QDir::Files, QDir::Name)) {
+                paths.append(dir.filePath(name));
+            }
+        } else {
+            paths.append(argument);
+        }
+    }
+
+    return paths;
+}
+
+
+/**
+    Convert one image and save the pattern.
+    @param source the path of the image
+    @param message set to the path of the pattern written, or the reason for failing
+    @return true if the pattern was written, false otherwise
+    */
+bool BatchConverter::convertFile(const QString &source, QString &message) const
+{
+    FlossScheme *flossScheme = SchemeManager::scheme(m_schemeName);
+    Document document;
+
+    try {
+        Magick::Image image(source.toStdString());
+
+        QSize size(qMax(1, static_cast<int>(image.columns()) * m_scale / 100), qMax(1, static_cast<int>(image.rows()) * m_scale / 100));
+
+        if (m_useFractionals) {
+            size *= 2;
+        }
+
+        if (ImageConverter::reduce(image, QRect(), size, m_colors, m_dithering, flossScheme).isNull()) {
+            message = i18n("Failed to reduce the image.");
+            return false;
+        }
+
+        ImageConverter converter(image, m_useFractionals, false, 0);
+        QSize patternSize = converter.patternSize();
+
+        StitchData stitchData;
+        stitchData.resize(patternSize.width(), patternSize.height());
+
+        for (int band = 0 ; band < converter.bands() ; ++band) {
+            if (!converter.convertBand(band, stitchData)) {
+                message = i18n("Failed to read the reduced image.");
+                return false;
+            }
+        }
+
+        QList<QRgb> colors = converter.colors();
+
+        if (colors.count() > m_symbolIndexes.count()) {
+            message = i18n("More colors were found than symbols available.");
+            return false;
+        }
+
+        document.pattern()->stitches().swap(stitchData);
+        document.pattern()->palette().setSchemeName(m_schemeName);
+
+        for (int flossIndex = 0 ; flossIndex < colors.count() ; ++flossIndex) {
+            Floss *floss = flossScheme->find(QColor(colors.at(flossIndex)));
+
+            DocumentFloss *documentFloss = new DocumentFloss(floss->name(), m_symbolIndexes.at(flossIndex), Qt::SolidLine, Configuration::palette_StitchStrands(), Configuration::palette_BackstitchStrands());
+            documentFloss->setFlossColor(floss->color());
+            document.pattern()->palette().add(flossIndex, documentFloss);
+        }
+    } catch (const Magick::Exception &e) {
+        message = QString::fromLocal8Bit(e.what());
+        return false;
+    }
+
+    document.setProperty(QStringLiteral("horizontalClothCount"), m_horizontalClothCount);
+    document.setProperty(QStringLiteral("verticalClothCount"), m_verticalClothCount);
+
+    QSaveFile file(target(source));
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        message = i18n("Failed to open the file %1.\n%2", file.fileName(), file.errorString());
+        return false;
+    }
+
+    QDataStream stream(&file);
+
+    try {
+        document.write(stream);
+
+        if (!file.commit()) {
+            message = i18n("Failed to save the file %1.\n%2", file.fileName(), file.errorString());
+            return false;
+        }
+    } catch (const FailedWriteFile &e) {
+        file.cancelWriting();
+        message = i18n("Failed to save the file %1.\n%2", file.fileName(), e.statusMessage());
+        return false;
+    }
+
+    message = i18n("%1: written %2", source, file.fileName());
+
+    return true;
+}
+
+
+/**
+    Get the path of the pattern for an image.
+    */
+QString BatchConverter::target(const QString &source) const
+{
+    QFileInfo fileInfo(source);
+    QDir dir(m_outputDirectory.isEmpty() ? fileInfo.absolutePath() : m_outputDirectory);
+
+    return dir.filePath(fileInfo.completeBaseName() + QStringLiteral(".kxs"));
+}
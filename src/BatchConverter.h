@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef BatchConverter_H
+#define BatchConverter_H
+
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include "FlossQuantizer.h"
+
+
+class QCommandLineParser;
+
+
+/**
+    Convert images to patterns from the command line without any windows.
+    Each image is scaled, reduced to the flosses of a scheme and converted to
+    stitches as the import image dialog would with the same settings, then
+    saved as a .kxs file of the same name.  The images are converted in
+    parallel, one per thread.
+    */
+class BatchConverter
+{
+public:
+    BatchConverter();
+
+    static void addOptions(QCommandLineParser &);
+    static bool requested(int, char **);
+
+    bool setOptions(const QCommandLineParser &);
+    int convert(const QStringList &);
+
+    static QStringList expand(const QStringList &);
+
+private:
+    friend class ConvertTask;
+
+    bool convertFile(const QString &, QString &) const;
+    QString target(const QString &) const;
+
+    QString     m_schemeName;
+    int         m_colors;
+    double      m_horizontalClothCount;
+    double      m_verticalClothCount;
+    int         m_scale;
+    bool        m_useFractionals;
+    FlossQuantizer::Dithering   m_dithering;
+    QString     m_outputDirectory;
+    QList<qint16>   m_symbolIndexes;
+};
+
+
+#endif // BatchConverter_H
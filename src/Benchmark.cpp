@@ -0,0 +1,556 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include "Benchmark.h"
+
+#include <QBuffer>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QVector>
+
+#include <KLocalizedString>
+
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+#include "configuration.h"
+#include "Document.h"
+#include "DocumentFloss.h"
+#include "Exceptions.h"
+#include "Floss.h"
+#include "FlossScheme.h"
+#include "SchemeManager.h"
+#include "SymbolLibrary.h"
+#include "SymbolManager.h"
+
+
+/**
+    Write a line to stderr, keeping stdout for the results.
+    */
+static void report(const QString &message)
+{
+    QTextStream stream(stderr);
+    stream << message << endl;
+}
+
+
+/**
+    Get the next value of a xorshift generator, so the patterns generated
+    from a seed are the same on every platform.
+    */
+static quint32 nextRandom(quint32 &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return state;
+}
+
+
+/**
+    Time an operation over a number of iterations.
+    @param name the name of the operation in the results
+    @param iterations the number of times the operation is run
+    @param operation run once for each iteration, it returns the nanoseconds
+    taken by the part being timed so any preparation is not included
+    @return a QJsonObject of the minimum, median and maximum times in milliseconds
+    */
+static QJsonObject timeOperation(const QString &name, int iterations, const std::function<qint64()> &operation)
+{
+    QVector<double> times;
+
+    for (int iteration = 0 ; iteration < iterations ; ++iteration) {
+        times.append(operation() / 1.0e6);
+    }
+
+    std::sort(times.begin(), times.end());
+
+    QJsonObject result;
+    result[QStringLiteral("operation")] = name;
+    result[QStringLiteral("iterations")] = iterations;
+    result[QStringLiteral("minimum")] = times.first();
+    result[QStringLiteral("median")] = times.at(times.count() / 2);
+    result[QStringLiteral("maximum")] = times.last();
+
+    return result;
+}
+
+
+Benchmark::Benchmark()
+    :   m_colors(50),
+        m_fractionals(0.1),
+        m_backstitches(0.01),
+        m_iterations(5),
+        m_seed(1),
+        m_fuzz(1000)
+{
+    m_sizes << QSize(100, 100) << QSize(500, 500) << QSize(1000, 1000);
+}
+
+
+/**
+    Add the benchmark options to a QCommandLineParser.
+    */
+void Benchmark::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption(QStringLiteral("benchmark"), i18n("Time loading, saving, copying, pasting and floss usage on generated patterns without showing any windows, writing the results as JSON.")));
+    parser.addOption(QCommandLineOption(QStringLiteral("benchmark-sizes"), i18n("The sizes of the generated patterns, separated by commas."), i18n("widthxheight,...")));
+    parser.addOption(QCommandLineOption(QStringLiteral("benchmark-colors"), i18n("The number of colors in the generated patterns."), i18n("count")));
+    parser.addOption(QCommandLineOption(QStringLiteral("benchmark-fractionals"), i18n("The fraction of cells having fractional stitches, from 0 to 1."), i18n("fraction")));
+    parser.addOption(QCommandLineOption(QStringLiteral("benchmark-backstitches"), i18n("The number of backstitches for each cell, from 0 to 1."), i18n("density")));
+    parser.addOption(QCommandLineOption(QStringLiteral("benchmark-iterations"), i18n("The number of times each operation is timed."), i18n("count")));
+    parser.addOption(QCommandLineOption(QStringLiteral("benchmark-seed"), i18n("The seed for generating the patterns."), i18n("number")));
+    parser.addOption(QCommandLineOption(QStringLiteral("benchmark-fuzz"), i18n("The number of damaged copies read of each PC Stitch file given."), i18n("count")));
+}
+
+
+/**
+    Check if a benchmark is requested before the application is created.
+    @return true if the benchmark option is present
+    */
+bool Benchmark::requested(int argc, char **argv)
+{
+    for (int i = 1 ; i < argc ; ++i) {
+        if (strcmp(argv[i], "--benchmark") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+    Take the settings from the command line, reporting any that are not valid.
+    @return true if the settings are valid, false otherwise
+    */
+bool Benchmark::setOptions(const QCommandLineParser &parser)
+{
+    bool ok = true;
+
+    if (parser.isSet(QStringLiteral("benchmark-sizes"))) {
+        m_sizes.clear();
+
+        foreach (const QString &size, parser.value(QStringLiteral("benchmark-sizes")).split(QLatin1Char(','))) {
+            QStringList dimensions = size.split(QLatin1Char('x'));
+            bool validWidth = false;
+            bool validHeight = false;
+
+            if (dimensions.count() == 2) {
+                m_sizes.append(QSize(dimensions.at(0).toInt(&validWidth), dimensions.at(1).toInt(&validHeight)));
+            }
+
+            if (!validWidth || !validHeight || m_sizes.isEmpty() || m_sizes.last().isEmpty()) {
+                report(i18n("The size %1 is not a width and height greater than 0 such as 1000x1000.", size));
+                ok = false;
+            }
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("benchmark-colors"))) {
+        bool valid;
+        m_colors = parser.value(QStringLiteral("benchmark-colors")).toInt(&valid);
+
+        if (!valid || m_colors < 1) {
+            report(i18n("The number of colors must be greater than 0."));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("benchmark-fractionals"))) {
+        bool valid;
+        m_fractionals = parser.value(QStringLiteral("benchmark-fractionals")).toDouble(&valid);
+
+        if (!valid || m_fractionals < 0 || m_fractionals > 1) {
+            report(i18n("The fraction of fractional stitches must be between 0 and 1."));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("benchmark-backstitches"))) {
+        bool valid;
+        m_backstitches = parser.value(QStringLiteral("benchmark-backstitches")).toDouble(&valid);
+
+        if (!valid || m_backstitches < 0 || m_backstitches > 1) {
+            report(i18n("The backstitch density must be between 0 and 1."));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("benchmark-iterations"))) {
+        bool valid;
+        m_iterations = parser.value(QStringLiteral("benchmark-iterations")).toInt(&valid);
+
+        if (!valid || m_iterations < 1) {
+            report(i18n("The number of iterations must be greater than 0."));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("benchmark-seed"))) {
+        bool valid;
+        m_seed = parser.value(QStringLiteral("benchmark-seed")).toUInt(&valid);
+
+        if (!valid || m_seed == 0) {
+            report(i18n("The seed must be a number greater than 0."));
+            ok = false;
+        }
+    }
+
+    if (parser.isSet(QStringLiteral("benchmark-fuzz"))) {
+        bool valid;
+        m_fuzz = parser.value(QStringLiteral("benchmark-fuzz")).toInt(&valid);
+
+        if (!valid || m_fuzz < 0) {
+            report(i18n("The number of damaged copies must be 0 or more."));
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+
+/**
+    Generate and time a document for each of the sizes, writing the results to stdout.
+    @return 0 if all the operations succeeded, 1 otherwise
+    */
+int Benchmark::run()
+{
+    QJsonArray results;
+
+    foreach (const QSize &size, m_sizes) {
+        Document document;
+        generate(document, size, m_colors, m_fractionals, m_backstitches, m_seed);
+        report(i18n("Timing a %1x%2 pattern", size.width(), size.height()));
+
+        try {
+            results.append(measure(document, size));
+        } catch (const InvalidFile &) {
+            report(i18n("The saved pattern was not recognized."));
+            return 1;
+        } catch (const InvalidFileVersion &e) {
+            report(i18n("The saved pattern version was not supported.\n%1", e.version));
+            return 1;
+        } catch (const FailedReadFile &e) {
+            report(i18n("Failed to read the saved pattern.\n%1", e.status));
+            return 1;
+        } catch (const FailedWriteFile &e) {
+            report(i18n("Failed to save the pattern.\n%1", e.statusMessage()));
+            return 1;
+        }
+    }
+
+    QJsonObject output;
+    output[QStringLiteral("results")] = results;
+
+    QTextStream stream(stdout);
+    stream << QJsonDocument(output).toJson();
+
+    return 0;
+}
+
+
+/**
+    Time reading PC Stitch files and read damaged copies of them, writing the results to stdout.
+    @param files the PC Stitch files
+    @return 0 if all the files were read, 1 otherwise
+    */
+int Benchmark::runPCStitch(const QStringList &files)
+{
+    QJsonArray results;
+    int failed = 0;
+
+    foreach (const QString &fileName, files) {
+        QFile file(fileName);
+
+        if (!file.open(QIODevice::ReadOnly)) {
+            report(i18n("Failed to open %1.", fileName));
+            ++failed;
+            continue;
+        }
+
+        QByteArray data = file.readAll();
+        report(i18n("Timing %1", fileName));
+
+        try {
+            results.append(measurePCStitch(fileName, data));
+        } catch (const InvalidFile &) {
+            report(i18n("%1 was not recognized as a PC Stitch file.", fileName));
+            ++failed;
+        } catch (const FailedReadFile &e) {
+            report(i18n("Failed to read %1.\n%2", fileName, e.status));
+            ++failed;
+        }
+    }
+
+    QJsonObject output;
+    output[QStringLiteral("results")] = results;
+
+    QTextStream stream(stdout);
+    stream << QJsonDocument(output).toJson();
+
+    return (failed) ? 1 : 0;
+}
+
+
+/**
+    Fill a document with a synthetic pattern.  The cells are filled with runs
+    of colors along the rows, as an imported image would be, some cells having
+    a three quarter stitch and a quarter stitch of another color instead of a
+    full stitch.  Backstitches of one or two cells in length are placed at
+    random.
+    @param document the document, it should be new, the palette uses the scheme of the document
+    @param size the size of the pattern
+    @param colors the number of colors, limited to the flosses in the scheme and the symbols available
+    @param fractionals the fraction of cells with fractional stitches
+    @param backstitches the number of backstitches as a fraction of the number of cells
+    @param seed the seed, the same seed generates the same pattern
+    */
+void Benchmark::generate(Document &document, const QSize &size, int colors, double fractionals, double backstitches, quint32 seed)
+{
+    static const Stitch::Type threeQuarters[] = {Stitch::TL3Qtr, Stitch::TR3Qtr, Stitch::BL3Qtr, Stitch::BR3Qtr};
+    static const Stitch::Type quarters[] = {Stitch::BRQtr, Stitch::BLQtr, Stitch::TRQtr, Stitch::TLQtr};    // the quarters not covered by the above
+
+    DocumentPalette &palette = document.pattern()->palette();
+    FlossScheme *scheme = SchemeManager::scheme(palette.schemeName());
+    QList<qint16> symbolIndexes = SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes();
+    colors = qBound(1, colors, qMin(scheme->flosses().count(), symbolIndexes.count()));
+
+    for (int colorIndex = 0 ; colorIndex < colors ; ++colorIndex) {
+        Floss *floss = scheme->flosses().at(colorIndex * scheme->flosses().count() / colors);
+        DocumentFloss *documentFloss = new DocumentFloss(floss->name(), symbolIndexes.at(colorIndex), Qt::SolidLine, Configuration::palette_StitchStrands(), Configuration::palette_BackstitchStrands());
+        documentFloss->setFlossColor(floss->color());
+        palette.add(colorIndex, documentFloss);
+    }
+
+    StitchData &stitches = document.pattern()->stitches();
+    stitches.clear();
+    stitches.resize(size.width(), size.height());
+
+    quint32 state = seed;
+    quint32 fractionalThreshold = quint32(fractionals * 0xffffffffu);
+    int colorIndex = 0;
+
+    for (int row = 0 ; row < size.height() ; ++row) {
+        for (int column = 0 ; column < size.width() ; ++column) {
+            // start a new run of color on average every eight cells
+            if (nextRandom(state) % 8 == 0) {
+                colorIndex = nextRandom(state) % colors;
+            }
+
+            StitchQueue *stitchQueue = new StitchQueue;
+
+            if (nextRandom(state) < fractionalThreshold) {
+                int corner = nextRandom(state) % 4;
+                stitchQueue->enqueue(new Stitch(threeQuarters[corner], colorIndex));
+
+                if (colors > 1) {
+                    stitchQueue->enqueue(new Stitch(quarters[corner], (colorIndex + 1 + nextRandom(state) % (colors - 1)) % colors));
+                }
+            } else {
+                stitchQueue->enqueue(new Stitch(Stitch::Full, colorIndex));
+            }
+
+            stitches.replaceStitchQueueAt(column, row, stitchQueue);
+        }
+    }
+
+    // backstitches run between the snap points at the corners and centres of the cells
+    QRect snapArea(0, 0, size.width() * 2 + 1, size.height() * 2 + 1);
+    int count = static_cast<int>(backstitches * size.width() * size.height());
+
+    while (count--) {
+        QPoint start(nextRandom(state) % snapArea.width(), nextRandom(state) % snapArea.height());
+        QPoint end(start.x() + static_cast<int>(nextRandom(state) % 5) - 2, start.y() + static_cast<int>(nextRandom(state) % 5) - 2);
+
+        if (end != start && snapArea.contains(end)) {
+            stitches.addBackstitch(start, end, nextRandom(state) % colors);
+        }
+    }
+}
+
+
+/**
+    Time the operations on a document.
+    @param document the generated document
+    @param size the size of the pattern
+    @return a QJsonObject describing the pattern with the results for each operation
+    */
+QJsonObject Benchmark::measure(Document &document, const QSize &size)
+{
+    QList<Stitch::Type> stitchTypes;
+    stitchTypes << Stitch::TLQtr << Stitch::TRQtr << Stitch::BLQtr << Stitch::BTHalf << Stitch::TL3Qtr << Stitch::BRQtr
+                << Stitch::TBHalf << Stitch::TR3Qtr << Stitch::BL3Qtr << Stitch::BR3Qtr << Stitch::Full << Stitch::TLSmallHalf
+                << Stitch::TRSmallHalf << Stitch::BLSmallHalf << Stitch::BRSmallHalf << Stitch::TLSmallFull << Stitch::TRSmallFull
+                << Stitch::BLSmallFull << Stitch::BRSmallFull;
+
+    QRect area(QPoint(0, 0), size);
+    QByteArray data;
+    Pattern *copied = nullptr;
+    QJsonArray operations;
+
+    QJsonObject write = timeOperation(QStringLiteral("write"), m_iterations, [&]() {
+        data.clear();
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        QDataStream stream(&buffer);
+        QElapsedTimer timer;
+        timer.start();
+        document.write(stream);
+        return timer.nsecsElapsed();
+    });
+    write[QStringLiteral("bytes")] = data.size();
+    operations.append(write);
+
+    operations.append(timeOperation(QStringLiteral("readKXStitch"), m_iterations, [&]() {
+        Document target;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream stream(&buffer);
+        QElapsedTimer timer;
+        timer.start();
+        target.readKXStitch(stream);
+        return timer.nsecsElapsed();
+    }));
+
+    operations.append(timeOperation(QStringLiteral("copy"), m_iterations, [&]() {
+        delete copied;
+        QElapsedTimer timer;
+        timer.start();
+        copied = document.pattern()->copy(area, -1, stitchTypes, false, false);
+        return timer.nsecsElapsed();
+    }));
+
+    operations.append(timeOperation(QStringLiteral("paste"), m_iterations, [&]() {
+        Document target;
+        target.pattern()->palette().setSchemeName(document.pattern()->palette().schemeName());
+        target.pattern()->stitches().resize(size.width(), size.height());
+        QElapsedTimer timer;
+        timer.start();
+        target.pattern()->paste(copied, QPoint(0, 0), true);
+        return timer.nsecsElapsed();
+    }));
+
+    delete copied;
+
+    operations.append(timeOperation(QStringLiteral("flossUsage"), m_iterations, [&]() {
+        QElapsedTimer timer;
+        timer.start();
+        document.pattern()->stitches().flossUsage();
+        return timer.nsecsElapsed();
+    }));
+
+    QJsonObject result;
+    result[QStringLiteral("width")] = size.width();
+    result[QStringLiteral("height")] = size.height();
+    result[QStringLiteral("colors")] = document.pattern()->palette().flosses().count();
+    result[QStringLiteral("fractionals")] = m_fractionals;
+    result[QStringLiteral("backstitches")] = document.pattern()->stitches().backstitches().count();
+    result[QStringLiteral("seed")] = static_cast<qint64>(m_seed);
+    result[QStringLiteral("operations")] = operations;
+
+    return result;
+}
+
+
+/**
+    Time reading a PC Stitch file, then read damaged copies of it.  A quarter of
+    the copies are cut short, the rest have up to eight bytes changed.  Every
+    copy must either be read or be rejected with an exception, anything else
+    crashing the benchmark.
+    @param fileName the name of the file
+    @param data the contents of the file
+    @return a QJsonObject describing the file with the results of the reading
+    */
+QJsonObject Benchmark::measurePCStitch(const QString &fileName, const QByteArray &data)
+{
+    QJsonArray operations;
+
+    operations.append(timeOperation(QStringLiteral("readPCStitch"), m_iterations, [&]() {
+        Document target;
+        QBuffer buffer;
+        buffer.setData(data);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream stream(&buffer);
+        QElapsedTimer timer;
+        timer.start();
+        target.readPCStitch(stream);
+        return timer.nsecsElapsed();
+    }));
+
+    quint32 state = m_seed;
+    int rejected = 0;
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int copy = 0 ; copy < m_fuzz && !data.isEmpty() ; ++copy) {
+        QByteArray damaged(data);
+
+        if (nextRandom(state) % 4 == 0) {
+            damaged.truncate(nextRandom(state) % damaged.size());
+        } else {
+            int changes = 1 + nextRandom(state) % 8;
+
+            while (changes--) {
+                damaged[int(nextRandom(state) % damaged.size())] = char(nextRandom(state));
+            }
+        }
+
+        Document target;
+        QBuffer buffer;
+        buffer.setData(damaged);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream stream(&buffer);
+
+        try {
+            target.readPCStitch(stream);
+        } catch (const InvalidFile &) {
+            ++rejected;
+        } catch (const FailedReadFile &) {
+            ++rejected;
+        }
+    }
+
+    QJsonObject fuzz;
+    fuzz[QStringLiteral("operation")] = QStringLiteral("fuzz");
+    fuzz[QStringLiteral("copies")] = m_fuzz;
+    fuzz[QStringLiteral("rejected")] = rejected;
+    fuzz[QStringLiteral("time")] = timer.nsecsElapsed() / 1.0e6;
+    operations.append(fuzz);
+
+    Document document;
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    QDataStream stream(&buffer);
+    document.readPCStitch(stream);
+
+    QJsonObject result;
+    result[QStringLiteral("file")] = fileName;
+    result[QStringLiteral("bytes")] = data.size();
+    result[QStringLiteral("width")] = document.pattern()->stitches().width();
+    result[QStringLiteral("height")] = document.pattern()->stitches().height();
+    result[QStringLiteral("colors")] = document.pattern()->palette().flosses().count();
+    result[QStringLiteral("seed")] = static_cast<qint64>(m_seed);
+    result[QStringLiteral("operations")] = operations;
+
+    return result;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef Benchmark_H
+#define Benchmark_H
+
+
+#include <QList>
+#include <QSize>
+#include <QStringList>
+
+
+class QByteArray;
+class QCommandLineParser;
+class QJsonObject;
+
+class Document;
+
+
+/**
+    Time the document operations on synthetic patterns from the command line.
+    A document is generated for each size requested with the colors, fractional
+    stitches and backstitches chosen, then saving, loading, copying, pasting
+    and counting floss usage are each timed over a number of iterations.  The
+    results are written to stdout as JSON so that format and data structure
+    changes can be compared.
+    Given PC Stitch files instead, reading each of them is timed, then copies
+    with bytes changed at random, or cut short, are read to check that damaged
+    files are rejected rather than crashing.  The copies are generated from
+    the seed, so a failure can be reproduced with the same seed.
+    Only built when WITH_BENCHMARK is set.
+    */
+class Benchmark
+{
+public:
+    Benchmark();
+
+    static void addOptions(QCommandLineParser &);
+    static bool requested(int, char **);
+
+    bool setOptions(const QCommandLineParser &);
+    int run();
+    int runPCStitch(const QStringList &);
+
+    static void generate(Document &, const QSize &, int, double, double, quint32);
+
+private:
+    QJsonObject measure(Document &, const QSize &);
+    QJsonObject measurePCStitch(const QString &, const QByteArray &);
+
+    QList<QSize>    m_sizes;
+    int             m_colors;
+    double          m_fractionals;
+    double          m_backstitches;
+    int             m_iterations;
+    quint32         m_seed;
+    int             m_fuzz;
+};
+
+
+#endif // Benchmark_H
@@ -211,6 +211,8 @@ void CalibrateFlossDlg::on_DialogButtonBox_accepted()
                 }
             }
 
+            scheme->flossesChanged();
+
             SchemeManager::writeScheme(mapIterator.key());
         }
     }
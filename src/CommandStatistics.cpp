@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+/**
+    @file
+    Implement classes for CommandStatistic, CommandStatistics and CommandMonitor.
+    */
+
+
+#include "CommandStatistics.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+
+bool CommandStatistics::enabled = false;
+QMap<QString, CommandStatistic> CommandStatistics::values;
+CommandMonitor *CommandMonitor::active = nullptr;
+
+
+CommandStatistic::CommandStatistic()
+    :   count(0),
+        totalTime(0),
+        maximumTime(0),
+        stitches(0),
+        retained(0),
+        redrawArea(0)
+{
+}
+
+
+bool CommandStatistics::isEnabled()
+{
+    return enabled;
+}
+
+
+void CommandStatistics::setEnabled(bool enable)
+{
+    enabled = enable;
+}
+
+
+void CommandStatistics::reset()
+{
+    values.clear();
+}
+
+
+QMap<QString, CommandStatistic> CommandStatistics::statistics()
+{
+    return values;
+}
+
+
+/**
+    Serialize the collected statistics.
+    @return a JSON array with one object per command operation
+    */
+QByteArray CommandStatistics::toJson()
+{
+    QJsonArray array;
+
+    for (QMap<QString, CommandStatistic>::const_iterator i = values.constBegin() ; i != values.constEnd() ; ++i) {
+        QJsonObject object;
+        object.insert(QStringLiteral("command"), i.key());
+        object.insert(QStringLiteral("count"), i.value().count);
+        object.insert(QStringLiteral("totalTimeNs"), double(i.value().totalTime));
+        object.insert(QStringLiteral("maximumTimeNs"), double(i.value().maximumTime));
+        object.insert(QStringLiteral("stitchesTouched"), double(i.value().stitches));
+        object.insert(QStringLiteral("bytesRetained"), double(i.value().retained));
+        object.insert(QStringLiteral("redrawArea"), double(i.value().redrawArea));
+        array.append(object);
+    }
+
+    return QJsonDocument(array).toJson();
+}
+
+
+void CommandStatistics::stitchesTouched(qint64 stitches)
+{
+    if (CommandMonitor::active) {
+        CommandMonitor::active->m_stitches += stitches;
+    }
+}
+
+
+void CommandStatistics::bytesRetained(qint64 bytes)
+{
+    if (CommandMonitor::active) {
+        CommandMonitor::active->m_retained += bytes;
+    }
+}
+
+
+void CommandStatistics::redrawn(const QRect &cells)
+{
+    if (CommandMonitor::active) {
+        CommandMonitor::active->m_redrawArea += qint64(cells.width()) * cells.height();
+    }
+}
+
+
+/**
+    Constructor.
+    @param function the Q_FUNC_INFO of the operation being measured,
+    reduced to Class::operation for the statistics key
+    */
+CommandMonitor::CommandMonitor(const char *function)
+    :   m_enabled(CommandStatistics::enabled),
+        m_parent(nullptr),
+        m_stitches(0),
+        m_retained(0),
+        m_redrawArea(0)
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    m_name = QString::fromLatin1(function);
+    m_name.truncate(m_name.indexOf(QLatin1Char('(')));
+    m_name.remove(0, m_name.lastIndexOf(QLatin1Char(' ')) + 1);
+
+    m_parent = active;
+    active = this;
+    m_timer.start();
+}
+
+
+CommandMonitor::~CommandMonitor()
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    qint64 elapsed = m_timer.nsecsElapsed();
+    active = m_parent;
+
+    CommandStatistic &statistic = CommandStatistics::values[m_name];
+    statistic.count++;
+    statistic.totalTime += elapsed;
+    statistic.maximumTime = qMax(statistic.maximumTime, elapsed);
+    statistic.stitches += m_stitches;
+    statistic.retained += m_retained;
+    statistic.redrawArea += m_redrawArea;
+
+    // the time of a child command is already within the parent's, its measurements are added explicitly
+    if (m_parent) {
+        m_parent->m_stitches += m_stitches;
+        m_parent->m_retained += m_retained;
+        m_parent->m_redrawArea += m_redrawArea;
+    }
+}
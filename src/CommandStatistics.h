@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+/**
+ * @file
+ * Header file for the optional command instrumentation.
+ */
+
+
+#ifndef CommandStatistics_H
+#define CommandStatistics_H
+
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QRect>
+#include <QString>
+
+
+/**
+ * @brief Accumulated measurements for one command operation.
+ *
+ * Times are in nanoseconds, the redraw area is in cells.
+ */
+class CommandStatistic
+{
+public:
+    CommandStatistic();
+
+    int     count;
+    qint64  totalTime;
+    qint64  maximumTime;
+    qint64  stitches;
+    qint64  retained;
+    qint64  redrawArea;
+};
+
+
+/**
+ * @brief Collects CommandStatistic values keyed by Class::operation.
+ *
+ * Collection is disabled by default and costs a single test per
+ * operation while disabled.  Measurements reported while no
+ * CommandMonitor is active are ignored.
+ */
+class CommandStatistics
+{
+public:
+    static bool isEnabled();
+    static void setEnabled(bool);
+    static void reset();
+
+    static QMap<QString, CommandStatistic> statistics();
+    static QByteArray toJson();
+
+    static void stitchesTouched(qint64);
+    static void bytesRetained(qint64);
+    static void redrawn(const QRect &);
+
+private:
+    friend class CommandMonitor;
+
+    static bool                             enabled;
+    static QMap<QString, CommandStatistic>  values;
+};
+
+
+/**
+ * @brief Scoped measurement of a QUndoCommand redo or undo.
+ *
+ * Construct at the start of the operation with Q_FUNC_INFO, the
+ * measurement is recorded when it goes out of scope.  A monitor
+ * constructed while another is active measures a child command, its
+ * measurements being recorded for the child and added to the parent.
+ * An undo sharing the code of its redo must call that code directly
+ * rather than redo, which would be counted as a second operation.
+ */
+class CommandMonitor
+{
+public:
+    explicit CommandMonitor(const char *function);
+    ~CommandMonitor();
+
+private:
+    friend class CommandStatistics;
+
+    static CommandMonitor   *active;
+
+    bool            m_enabled;
+    QString         m_name;
+    QElapsedTimer   m_timer;
+    CommandMonitor  *m_parent;
+    qint64          m_stitches;
+    qint64          m_retained;
+    qint64          m_redrawArea;
+};
+
+
+#endif // CommandStatistics_H
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include "CommandStatisticsView.h"
+
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QSaveFile>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+#include <KLocalizedString>
+#include <KMessageBox>
+
+#include "CommandStatistics.h"
+
+
+CommandStatisticsView::CommandStatisticsView(QWidget *parent)
+    :   QWidget(parent),
+        m_statistics(new QTreeWidget(this))
+{
+    m_statistics->setRootIsDecorated(false);
+    m_statistics->setSortingEnabled(true);
+    m_statistics->setHeaderLabels(QStringList() << i18n("Command")
+                                                << i18n("Count")
+                                                << i18n("Total ms")
+                                                << i18n("Maximum ms")
+                                                << i18n("Stitches")
+                                                << i18n("Retained KiB")
+                                                << i18n("Redraw Cells"));
+
+    QPushButton *resetButton = new QPushButton(i18n("Reset"), this);
+    QPushButton *saveButton = new QPushButton(i18n("Save as JSON..."), this);
+
+    QHBoxLayout *buttons = new QHBoxLayout;
+    buttons->addStretch();
+    buttons->addWidget(resetButton);
+    buttons->addWidget(saveButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(m_statistics);
+    layout->addLayout(buttons);
+
+    connect(resetButton, &QPushButton::clicked, this, &CommandStatisticsView::reset);
+    connect(saveButton, &QPushButton::clicked, this, &CommandStatisticsView::save);
+}
+
+
+void CommandStatisticsView::refresh()
+{
+    if (!isVisible()) {
+        return;
+    }
+
+    m_statistics->clear();
+
+    QMap<QString, CommandStatistic> statistics = CommandStatistics::statistics();
+
+    for (QMap<QString, CommandStatistic>::const_iterator i = statistics.constBegin() ; i != statistics.constEnd() ; ++i) {
+        QTreeWidgetItem *item = new QTreeWidgetItem(m_statistics);
+        item->setText(0, i.key());
+        item->setData(1, Qt::DisplayRole, i.value().count);
+        item->setData(2, Qt::DisplayRole, double(i.value().totalTime) / 1000000.0);
+        item->setData(3, Qt::DisplayRole, double(i.value().maximumTime) / 1000000.0);
+        item->setData(4, Qt::DisplayRole, i.value().stitches);
+        item->setData(5, Qt::DisplayRole, i.value().retained / 1024);
+        item->setData(6, Qt::DisplayRole, i.value().redrawArea);
+    }
+
+    for (int column = 0 ; column < m_statistics->columnCount() ; ++column) {
+        m_statistics->resizeColumnToContents(column);
+    }
+}
+
+
+void CommandStatisticsView::reset()
+{
+    CommandStatistics::reset();
+    refresh();
+}
+
+
+void CommandStatisticsView::save()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, i18n("Save Command Statistics"), QString(), i18n("JSON files (*.json)"));
+
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    QSaveFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly) || (file.write(CommandStatistics::toJson()) == -1) || !file.commit()) {
+        KMessageBox::sorry(this, i18n("Unable to save the command statistics to %1", fileName));
+    }
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef CommandStatisticsView_H
+#define CommandStatisticsView_H
+
+
+#include <QWidget>
+
+
+class QTreeWidget;
+
+
+class CommandStatisticsView : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit CommandStatisticsView(QWidget *);
+    virtual ~CommandStatisticsView() = default;
+
+public slots:
+    void refresh();
+
+private slots:
+    void reset();
+    void save();
+
+private:
+    QTreeWidget *m_statistics;
+};
+
+
+#endif // CommandStatisticsView_H
@@ -18,6 +18,7 @@
 #include <KLocalizedString>
 
 #include "BackgroundImage.h"
+#include "CommandStatistics.h"
 #include "Document.h"
 #include "Editor.h"
 #include "Floss.h"
@@ -38,6 +39,8 @@ FilePropertiesCommand::FilePropertiesCommand(Document *document)
 
 void FilePropertiesCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->readDocumentSettings();
     m_document->preview()->readDocumentSettings();
@@ -47,6 +50,8 @@ void FilePropertiesCommand::redo()
 
 void FilePropertiesCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->readDocumentSettings();
     m_document->preview()->readDocumentSettings();
@@ -63,6 +68,8 @@ ImportImageCommand::ImportImageCommand(Document *document)
 
 void ImportImageCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->readDocumentSettings();
     m_document->preview()->readDocumentSettings();
@@ -72,6 +79,8 @@ void ImportImageCommand::redo()
 
 void ImportImageCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->readDocumentSettings();
     m_document->preview()->readDocumentSettings();
@@ -88,6 +97,8 @@ PaintStitchesCommand::PaintStitchesCommand(Document *document)
 
 void PaintStitchesCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -96,6 +107,8 @@ void PaintStitchesCommand::redo()
 
 void PaintStitchesCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -111,6 +124,8 @@ PaintKnotsCommand::PaintKnotsCommand(Document *document)
 
 void PaintKnotsCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -119,6 +134,8 @@ void PaintKnotsCommand::redo()
 
 void PaintKnotsCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -134,6 +151,8 @@ DrawLineCommand::DrawLineCommand(Document *document)
 
 void DrawLineCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -142,6 +161,8 @@ void DrawLineCommand::redo()
 
 void DrawLineCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -157,6 +178,8 @@ EraseStitchesCommand::EraseStitchesCommand(Document *document)
 
 void EraseStitchesCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -165,6 +188,8 @@ void EraseStitchesCommand::redo()
 
 void EraseStitchesCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -180,6 +205,8 @@ DrawRectangleCommand::DrawRectangleCommand(Document *document)
 
 void DrawRectangleCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -188,6 +215,8 @@ void DrawRectangleCommand::redo()
 
 void DrawRectangleCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -203,6 +232,8 @@ FillRectangleCommand::FillRectangleCommand(Document *document)
 
 void FillRectangleCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -211,6 +242,8 @@ void FillRectangleCommand::redo()
 
 void FillRectangleCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -227,6 +260,8 @@ DrawEllipseCommand::DrawEllipseCommand(Document *document)
 
 void DrawEllipseCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -235,6 +270,8 @@ void DrawEllipseCommand::redo()
 
 void DrawEllipseCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -250,6 +287,8 @@ FillEllipseCommand::FillEllipseCommand(Document *document)
 
 void FillEllipseCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -258,6 +297,8 @@ void FillEllipseCommand::redo()
 
 void FillEllipseCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -273,6 +314,8 @@ FillPolygonCommand::FillPolygonCommand(Document *document)
 
 void FillPolygonCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -281,6 +324,8 @@ void FillPolygonCommand::redo()
 
 void FillPolygonCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -306,6 +351,7 @@ AddStitchCommand::~AddStitchCommand()
 
 void AddStitchCommand::redo()
 {
+    CommandStatistics::stitchesTouched(1);
     m_original = m_document->pattern()->stitches().stitchQueueAt(m_cell);
 
     if (m_original) {
@@ -318,6 +364,7 @@ void AddStitchCommand::redo()
 
 void AddStitchCommand::undo()
 {
+    CommandStatistics::stitchesTouched(1);
     delete m_document->pattern()->stitches().takeStitchQueueAt(m_cell);
 
     if (m_original) {
@@ -346,6 +393,7 @@ DeleteStitchCommand::~DeleteStitchCommand()
 
 void DeleteStitchCommand::redo()
 {
+    CommandStatistics::stitchesTouched(1);
     m_original = m_document->pattern()->stitches().stitchQueueAt(m_cell);
 
     if (m_original) {
@@ -357,6 +405,8 @@ void DeleteStitchCommand::redo()
 
 void DeleteStitchCommand::undo()
 {
+    CommandStatistics::stitchesTouched(1);
+
     if (m_original) {
         delete m_document->pattern()->stitches().replaceStitchQueueAt(m_cell, m_original);
         m_original = nullptr;
@@ -376,6 +426,8 @@ AddBackstitchCommand::AddBackstitchCommand(Document *document, const QPoint &sta
 
 void AddBackstitchCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->stitches().addBackstitch(m_start, m_end, m_colorIndex);
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -384,7 +436,12 @@ void AddBackstitchCommand::redo()
 
 void AddBackstitchCommand::undo()
 {
-    delete m_document->pattern()->stitches().takeBackstitch(m_start, m_end, m_colorIndex);
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    // the backstitch added by redo is the last one, which may not be the first
+    // matching one if there are duplicates
+    StitchData &stitchData = m_document->pattern()->stitches();
+    delete stitchData.takeBackstitch(stitchData.backstitches().last());
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
 }
@@ -396,7 +453,8 @@ DeleteBackstitchCommand::DeleteBackstitchCommand(Document *document, const QPoin
         m_start(start),
         m_end(end),
         m_colorIndex(colorIndex),
-        m_backstitch(nullptr)
+        m_backstitch(nullptr),
+        m_index(-1)
 {
 }
 
@@ -409,7 +467,12 @@ DeleteBackstitchCommand::~DeleteBackstitchCommand()
 
 void DeleteBackstitchCommand::redo()
 {
-    m_backstitch = m_document->pattern()->stitches().takeBackstitch(m_start, m_end, m_colorIndex);
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    StitchData &stitchData = m_document->pattern()->stitches();
+    m_backstitch = stitchData.findBackstitch(m_start, m_end, m_colorIndex);
+    m_index = stitchData.backstitches().indexOf(m_backstitch);
+    stitchData.takeBackstitch(m_backstitch);
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
 }
@@ -417,8 +480,15 @@ void DeleteBackstitchCommand::redo()
 
 void DeleteBackstitchCommand::undo()
 {
-    m_document->pattern()->stitches().addBackstitch(m_backstitch);
-    m_backstitch = nullptr;
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    // restore the backstitch to its original position, the order of the list
+    // being needed by the positional color usage index
+    if (m_backstitch) {
+        m_document->pattern()->stitches().insertBackstitch(m_index, m_backstitch);
+        m_backstitch = nullptr;
+    }
+
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
 }
@@ -435,13 +505,16 @@ AddKnotCommand::AddKnotCommand(Document *document, const QPoint &snap, int color
 
 void AddKnotCommand::redo()
 {
+    CommandStatistics::stitchesTouched(1);
     m_document->pattern()->stitches().addFrenchKnot(m_snap, m_colorIndex);
 }
 
 
 void AddKnotCommand::undo()
 {
-    delete m_document->pattern()->stitches().takeFrenchKnot(m_snap, m_colorIndex);
+    CommandStatistics::stitchesTouched(1);
+    StitchData &stitchData = m_document->pattern()->stitches();
+    delete stitchData.takeFrenchKnot(stitchData.knots().last());
 }
 
 
@@ -450,7 +523,8 @@ DeleteKnotCommand::DeleteKnotCommand(Document *document, const QPoint &snap, int
         m_document(document),
         m_snap(snap),
         m_colorIndex(colorIndex),
-        m_knot(nullptr)
+        m_knot(nullptr),
+        m_index(-1)
 {
 }
 
@@ -463,14 +537,22 @@ DeleteKnotCommand::~DeleteKnotCommand()
 
 void DeleteKnotCommand::redo()
 {
-    m_knot = m_document->pattern()->stitches().takeFrenchKnot(m_snap, m_colorIndex);
+    CommandStatistics::stitchesTouched(1);
+    StitchData &stitchData = m_document->pattern()->stitches();
+    m_knot = stitchData.findKnot(m_snap, m_colorIndex);
+    m_index = stitchData.knots().indexOf(m_knot);
+    stitchData.takeFrenchKnot(m_knot);
 }
 
 
 void DeleteKnotCommand::undo()
 {
-    m_document->pattern()->stitches().addFrenchKnot(m_knot);
-    m_knot = nullptr;
+    CommandStatistics::stitchesTouched(1);
+
+    if (m_knot) {
+        m_document->pattern()->stitches().insertFrenchKnot(m_index, m_knot);
+        m_knot = nullptr;
+    }
 }
 
 
@@ -485,6 +567,8 @@ SetPropertyCommand::SetPropertyCommand(Document *document, const QString &name,
 
 void SetPropertyCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_oldValue = m_document->property(m_name);
     m_document->setProperty(m_name, m_value);
 }
@@ -492,6 +576,8 @@ void SetPropertyCommand::redo()
 
 void SetPropertyCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->setProperty(m_name, m_oldValue);
 }
 
@@ -507,6 +593,8 @@ AddBackgroundImageCommand::AddBackgroundImageCommand(Document *document, QShared
 
 void AddBackgroundImageCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->backgroundImages().addBackgroundImage(m_backgroundImage);
     m_mainWindow->updateBackgroundImageActionLists();
     m_document->editor()->drawContents();
@@ -515,6 +603,8 @@ void AddBackgroundImageCommand::redo()
 
 void AddBackgroundImageCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->backgroundImages().removeBackgroundImage(m_backgroundImage);
     m_mainWindow->updateBackgroundImageActionLists();
     m_document->editor()->drawContents();
@@ -532,15 +622,25 @@ FitBackgroundImageCommand::FitBackgroundImageCommand(Document *document, QShared
 
 void FitBackgroundImageCommand::redo()
 {
-    m_rect = m_document->backgroundImages().fitBackgroundImage(m_backgroundImage, m_rect);
-    m_document->editor()->resetSelectionArea();
-    m_document->editor()->drawContents();
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
 }
 
 
 void FitBackgroundImageCommand::undo()
 {
-    redo(); // same code required
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply(); // same code required
+}
+
+
+void FitBackgroundImageCommand::apply()
+{
+    m_rect = m_document->backgroundImages().fitBackgroundImage(m_backgroundImage, m_rect);
+    m_document->editor()->resetSelectionArea();
+    m_document->editor()->drawContents();
 }
 
 
@@ -555,14 +655,24 @@ ShowBackgroundImageCommand::ShowBackgroundImageCommand(Document *document, QShar
 
 void ShowBackgroundImageCommand::redo()
 {
-    m_visible = m_document->backgroundImages().showBackgroundImage(m_backgroundImage, m_visible);
-    m_document->editor()->drawContents();
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
 }
 
 
 void ShowBackgroundImageCommand::undo()
 {
-    redo(); // same code required
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply(); // same code required
+}
+
+
+void ShowBackgroundImageCommand::apply()
+{
+    m_visible = m_document->backgroundImages().showBackgroundImage(m_backgroundImage, m_visible);
+    m_document->editor()->drawContents();
 }
 
 
@@ -585,6 +695,8 @@ RemoveBackgroundImageCommand::~RemoveBackgroundImageCommand()
 
 void RemoveBackgroundImageCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->backgroundImages().removeBackgroundImage(m_backgroundImage);
     m_mainWindow->updateBackgroundImageActionLists();
 
@@ -596,6 +708,8 @@ void RemoveBackgroundImageCommand::redo()
 
 void RemoveBackgroundImageCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->backgroundImages().addBackgroundImage(m_backgroundImage);
     m_mainWindow->updateBackgroundImageActionLists();
 
@@ -616,12 +730,16 @@ AddDocumentFlossCommand::AddDocumentFlossCommand(Document *document, int key, Do
 
 void AddDocumentFlossCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->palette().add(m_key, m_documentFloss);
 }
 
 
 void AddDocumentFlossCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->palette().remove(m_key);
 }
 
@@ -643,12 +761,16 @@ RemoveDocumentFlossCommand::~RemoveDocumentFlossCommand()
 
 void RemoveDocumentFlossCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->palette().remove(m_key);
 }
 
 
 void RemoveDocumentFlossCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->palette().add(m_key, m_documentFloss);
 }
 
@@ -670,13 +792,23 @@ ReplaceDocumentFlossCommand::~ReplaceDocumentFlossCommand()
 
 void ReplaceDocumentFlossCommand::redo()
 {
-    m_documentFloss = m_document->pattern()->palette().replace(m_key, m_documentFloss);
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
 }
 
 
 void ReplaceDocumentFlossCommand::undo()
 {
-    redo(); // same code required
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply(); // same code required
+}
+
+
+void ReplaceDocumentFlossCommand::apply()
+{
+    m_documentFloss = m_document->pattern()->palette().replace(m_key, m_documentFloss);
 }
 
 
@@ -689,6 +821,8 @@ ClearUnusedFlossesCommand::ClearUnusedFlossesCommand(Document *document)
 
 void ClearUnusedFlossesCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_document->palette()->update();
 }
@@ -696,57 +830,197 @@ void ClearUnusedFlossesCommand::redo()
 
 void ClearUnusedFlossesCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_document->palette()->update();
 }
 
 
-ResizeDocumentCommand::ResizeDocumentCommand(Document *document, int width, int height, QUndoCommand *parent)
+ResizeDocumentCommand::ResizeDocumentCommand(Document *document, int width, int height, QUndoCommand *parent, StitchData *stitchData)
     :   QUndoCommand(i18n("Resize Document"), parent),
         m_document(document),
         m_width(width),
-        m_height(height)
+        m_height(height),
+        m_stitchData(stitchData)
+{
+}
+
+
+ResizeDocumentCommand::~ResizeDocumentCommand()
+{
+    delete m_stitchData;
+}
+
+
+/**
+    Resize the stitch data, moving the pattern if required to keep it within the new size.
+    @param stitchData the StitchData to resize
+    @param width the new width
+    @param height the new height
+    @return the offset the pattern was moved by
+    */
+QPoint ResizeDocumentCommand::resize(StitchData &stitchData, int width, int height)
+{
+    QPoint offset = resizeOffset(stitchData, width, height);
+    stitchData.movePattern(offset.x(), offset.y());
+    stitchData.resize(width, height);
+
+    return offset;
+}
+
+
+/**
+    Calculate the offset resize() will move the pattern by without changing the stitch data.
+    @param stitchData the StitchData to be resized
+    @param width the new width
+    @param height the new height
+    @return the offset the pattern will be moved by
+    */
+QPoint ResizeDocumentCommand::resizeOffset(const StitchData &stitchData, int width, int height)
 {
+    QRect extents = stitchData.extents();
+    int minx = std::min(extents.left(), width - extents.width());
+    int miny = std::min(extents.top(), height - extents.height());
+
+    return QPoint(minx - extents.left(), miny - extents.top());
 }
 
 
 void ResizeDocumentCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_originalWidth = m_document->pattern()->stitches().width();
     m_originalHeight = m_document->pattern()->stitches().height();
-    QRect extents = m_document->pattern()->stitches().extents();
-    int minx = std::min(extents.left(), m_width - extents.width());
-    m_xOffset = minx - extents.left();
-    int miny = std::min(extents.top(), m_height - extents.height());
-    m_yOffset = miny - extents.top();
-    m_document->pattern()->stitches().movePattern(m_xOffset, m_yOffset);
-    m_document->pattern()->stitches().resize(m_width, m_height);
+
+    QPoint offset;
+
+    if (m_stitchData) {
+        // transformed in advance by a StitchDataJob, only the offset is kept for undo
+        offset = resizeOffset(m_document->pattern()->stitches(), m_width, m_height);
+        m_document->pattern()->stitches().swap(*m_stitchData);
+        delete m_stitchData;
+        m_stitchData = nullptr;
+    } else {
+        offset = resize(m_document->pattern()->stitches(), m_width, m_height);
+    }
+
+    m_xOffset = offset.x();
+    m_yOffset = offset.y();
+
+    CommandStatistics::stitchesTouched(m_originalWidth * m_originalHeight);
 }
 
 
 void ResizeDocumentCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->stitches().resize(m_originalWidth, m_originalHeight);
     m_document->pattern()->stitches().movePattern(-m_xOffset, -m_yOffset);
+
+    CommandStatistics::stitchesTouched(m_originalWidth * m_originalHeight);
 }
 
 
-CropToPatternCommand::CropToPatternCommand(Document *document)
+/**
+    Replace the stitch data with new content, such as an imported image.  The
+    content is unrelated to the stitch data replaced, so both are kept and
+    swapped on redo and undo.
+    @param document the Document
+    @param stitchData the new content, owned by the command
+    @param parent the parent command
+    */
+ReplaceStitchDataCommand::ReplaceStitchDataCommand(Document *document, StitchData *stitchData, QUndoCommand *parent)
+    :   QUndoCommand(i18n("Replace Stitches"), parent),
+        m_document(document),
+        m_stitchData(stitchData)
+{
+}
+
+
+ReplaceStitchDataCommand::~ReplaceStitchDataCommand()
+{
+    delete m_stitchData;
+}
+
+
+void ReplaceStitchDataCommand::redo()
+{
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
+}
+
+
+void ReplaceStitchDataCommand::undo()
+{
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply(); // same code required
+}
+
+
+void ReplaceStitchDataCommand::apply()
+{
+    m_document->pattern()->stitches().swap(*m_stitchData);
+    CommandStatistics::stitchesTouched(m_document->pattern()->stitches().width() * m_document->pattern()->stitches().height());
+}
+
+
+CropToPatternCommand::CropToPatternCommand(Document *document, StitchData *stitchData)
     :   QUndoCommand(i18n("Crop to Pattern")),
-        m_document(document)
+        m_document(document),
+        m_stitchData(stitchData)
 {
 }
 
 
+CropToPatternCommand::~CropToPatternCommand()
+{
+    delete m_stitchData;
+}
+
+
+/**
+    Crop the stitch data to the extents of the pattern.
+    @param stitchData the StitchData to crop
+    @return the offset the pattern was moved by
+    */
+QPoint CropToPatternCommand::crop(StitchData &stitchData)
+{
+    QRect extents = stitchData.extents();
+    stitchData.movePattern(-extents.left(), -extents.top());
+    stitchData.resize(extents.width(), extents.height());
+
+    return -extents.topLeft();
+}
+
+
 void CropToPatternCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_originalWidth = m_document->pattern()->stitches().width();
     m_originalHeight = m_document->pattern()->stitches().height();
-    QRect extents = m_document->pattern()->stitches().extents();
-    m_xOffset = -extents.left();
-    m_yOffset = -extents.top();
-    m_document->pattern()->stitches().movePattern(m_xOffset, m_yOffset);
-    m_document->pattern()->stitches().resize(extents.width(), extents.height());
+
+    QPoint offset;
+
+    if (m_stitchData) {
+        // transformed in advance by a StitchDataJob, only the offset is kept for undo
+        offset = -m_document->pattern()->stitches().extents().topLeft();
+        m_document->pattern()->stitches().swap(*m_stitchData);
+        delete m_stitchData;
+        m_stitchData = nullptr;
+    } else {
+        offset = crop(m_document->pattern()->stitches());
+    }
+
+    m_xOffset = offset.x();
+    m_yOffset = offset.y();
+
+    CommandStatistics::stitchesTouched(m_originalWidth * m_originalHeight);
     m_document->editor()->readDocumentSettings();
     m_document->preview()->readDocumentSettings();
 }
@@ -754,8 +1028,12 @@ void CropToPatternCommand::redo()
 
 void CropToPatternCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->stitches().resize(m_originalWidth, m_originalHeight);
     m_document->pattern()->stitches().movePattern(-m_xOffset, -m_yOffset);
+
+    CommandStatistics::stitchesTouched(m_originalWidth * m_originalHeight);
     m_document->editor()->readDocumentSettings();
     m_document->preview()->readDocumentSettings();
 }
@@ -771,6 +1049,8 @@ CropToSelectionCommand::CropToSelectionCommand(Document *document, const QRect &
 
 void CropToSelectionCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QList<Stitch::Type> maskStitches;
     maskStitches << Stitch::TLQtr << Stitch::TRQtr << Stitch::BLQtr << Stitch::BTHalf << Stitch::TL3Qtr << Stitch::BRQtr
                  << Stitch::TBHalf << Stitch::TR3Qtr << Stitch::BL3Qtr << Stitch::BR3Qtr << Stitch::Full << Stitch::TLSmallHalf
@@ -786,6 +1066,8 @@ void CropToSelectionCommand::redo()
     m_document->pattern()->paste(pattern, QPoint(0, 0), true);
     delete pattern;
 
+    CommandStatistics::bytesRetained(m_originalPattern.size());
+
     m_document->editor()->readDocumentSettings();
     m_document->preview()->readDocumentSettings();
 }
@@ -793,6 +1075,8 @@ void CropToSelectionCommand::redo()
 
 void CropToSelectionCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QDataStream stream(&m_originalPattern, QIODevice::ReadOnly);
     stream >> m_document->pattern()->stitches();
     m_originalPattern.clear();
@@ -812,6 +1096,8 @@ InsertColumnsCommand::InsertColumnsCommand(Document *document, const QRect &sele
 
 void InsertColumnsCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->stitches().insertColumns(m_selectionArea.left(), m_selectionArea.width());
 
     auto backgroundImageIterator = m_document->backgroundImages().backgroundImages();
@@ -831,6 +1117,8 @@ void InsertColumnsCommand::redo()
 
 void InsertColumnsCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->stitches().removeColumns(m_selectionArea.left(), m_selectionArea.width());
 
     auto backgroundImageIterator = m_document->backgroundImages().backgroundImages();
@@ -858,6 +1146,8 @@ InsertRowsCommand::InsertRowsCommand(Document *document, const QRect &selectionA
 
 void InsertRowsCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->stitches().insertRows(m_selectionArea.top(), m_selectionArea.height());
 
     auto backgroundImageIterator = m_document->backgroundImages().backgroundImages();
@@ -877,6 +1167,8 @@ void InsertRowsCommand::redo()
 
 void InsertRowsCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->stitches().removeRows(m_selectionArea.top(), m_selectionArea.height());
 
     auto backgroundImageIterator = m_document->backgroundImages().backgroundImages();
@@ -894,22 +1186,47 @@ void InsertRowsCommand::undo()
 }
 
 
-ExtendPatternCommand::ExtendPatternCommand(Document *document, int top, int left, int right, int bottom)
+ExtendPatternCommand::ExtendPatternCommand(Document *document, int top, int left, int right, int bottom, StitchData *stitchData)
     :   QUndoCommand(i18n("Extend Pattern")),
         m_document(document),
         m_top(top),
         m_left(left),
         m_right(right),
-        m_bottom(bottom)
+        m_bottom(bottom),
+        m_stitchData(stitchData)
+{
+}
+
+
+ExtendPatternCommand::~ExtendPatternCommand()
 {
+    delete m_stitchData;
+}
+
+
+void ExtendPatternCommand::extend(StitchData &stitchData, int top, int left, int right, int bottom)
+{
+    stitchData.resize(stitchData.width() + left + right, stitchData.height() + top + bottom);
+    stitchData.movePattern(left, top);
 }
 
 
 void ExtendPatternCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     StitchData &stitchData = m_document->pattern()->stitches();
-    stitchData.resize(stitchData.width() + m_left + m_right, stitchData.height() + m_top + m_bottom);
-    stitchData.movePattern(m_left, m_top);
+
+    if (m_stitchData) {
+        // transformed in advance by a StitchDataJob, undo and later redo use the margins
+        stitchData.swap(*m_stitchData);
+        delete m_stitchData;
+        m_stitchData = nullptr;
+    } else {
+        extend(stitchData, m_top, m_left, m_right, m_bottom);
+    }
+
+    CommandStatistics::stitchesTouched(stitchData.width() * stitchData.height());
     auto backgroundImageIterator = m_document->backgroundImages().backgroundImages();
 
     while (backgroundImageIterator.hasNext()) {
@@ -924,9 +1241,14 @@ void ExtendPatternCommand::redo()
 
 void ExtendPatternCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     StitchData &stitchData = m_document->pattern()->stitches();
+
     stitchData.movePattern(-m_left, -m_top);
     stitchData.resize(stitchData.width() - m_left - m_right, stitchData.height() - m_top - m_bottom);
+
+    CommandStatistics::stitchesTouched(stitchData.width() * stitchData.height());
     auto backgroundImageIterator = m_document->backgroundImages().backgroundImages();
 
     while (backgroundImageIterator.hasNext()) {
@@ -939,22 +1261,73 @@ void ExtendPatternCommand::undo()
 }
 
 
-CentrePatternCommand::CentrePatternCommand(Document *document)
+CentrePatternCommand::CentrePatternCommand(Document *document, StitchData *stitchData)
     :   QUndoCommand(i18n("Center Pattern")),
-        m_document(document)
+        m_document(document),
+        m_xOffset(0),
+        m_yOffset(0),
+        m_stitchData(stitchData)
+{
+}
+
+
+CentrePatternCommand::~CentrePatternCommand()
 {
+    delete m_stitchData;
+}
+
+
+/**
+    Move the pattern to the centre of the stitch data.
+    @param stitchData the StitchData to centre
+    @return the offset the pattern was moved by
+    */
+QPoint CentrePatternCommand::centre(StitchData &stitchData)
+{
+    QPoint offset = centreOffset(stitchData);
+
+    if (!offset.isNull()) {
+        stitchData.movePattern(offset.x(), offset.y());
+    }
+
+    return offset;
+}
+
+
+/**
+    Calculate the offset centre() will move the pattern by without changing the stitch data.
+    @param stitchData the StitchData to be centred
+    @return the offset the pattern will be moved by
+    */
+QPoint CentrePatternCommand::centreOffset(const StitchData &stitchData)
+{
+    QRect extents = stitchData.extents();
+
+    return QPoint(((stitchData.width() - extents.width()) / 2) - extents.left(), ((stitchData.height() - extents.height()) / 2) - extents.top());
 }
 
 
 void CentrePatternCommand::redo()
 {
-    QRect extents = m_document->pattern()->stitches().extents();
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    QPoint offset;
+
+    if (m_stitchData) {
+        // transformed in advance by a StitchDataJob, only the offset is kept for undo
+        offset = centreOffset(m_document->pattern()->stitches());
+        m_document->pattern()->stitches().swap(*m_stitchData);
+        delete m_stitchData;
+        m_stitchData = nullptr;
+    } else {
+        offset = centre(m_document->pattern()->stitches());
+    }
 
-    m_xOffset = ((m_document->pattern()->stitches().width() - extents.width()) / 2) - extents.left();
-    m_yOffset = ((m_document->pattern()->stitches().height() - extents.height()) / 2) - extents.top();
+    m_xOffset = offset.x();
+    m_yOffset = offset.y();
 
     if (m_xOffset || m_yOffset) {
-        m_document->pattern()->stitches().movePattern(m_xOffset, m_yOffset);
+        CommandStatistics::stitchesTouched(m_document->pattern()->stitches().width() * m_document->pattern()->stitches().height());
 
         m_document->editor()->drawContents();
         m_document->preview()->drawContents();
@@ -965,8 +1338,11 @@ void CentrePatternCommand::redo()
 
 void CentrePatternCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     if (m_xOffset || m_yOffset) {
         m_document->pattern()->stitches().movePattern(-m_xOffset, -m_yOffset);
+        CommandStatistics::stitchesTouched(m_document->pattern()->stitches().width() * m_document->pattern()->stitches().height());
 
         m_document->editor()->drawContents();
         m_document->preview()->drawContents();
@@ -983,6 +1359,22 @@ UpdateDocumentPaletteCommand::UpdateDocumentPaletteCommand(Document *document, c
 
 
 void UpdateDocumentPaletteCommand::redo()
+{
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
+}
+
+
+void UpdateDocumentPaletteCommand::undo()
+{
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply(); // swaps the palette back
+}
+
+
+void UpdateDocumentPaletteCommand::apply()
 {
     DocumentPalette palette = m_document->pattern()->palette();
     m_document->pattern()->palette() = m_palette;
@@ -994,12 +1386,6 @@ void UpdateDocumentPaletteCommand::redo()
 }
 
 
-void UpdateDocumentPaletteCommand::undo()
-{
-    redo(); // swaps the palette back
-}
-
-
 ChangeSchemeCommand::ChangeSchemeCommand(Document *document, const QString &schemeName, QUndoCommand *parent)
     :   QUndoCommand(i18n("Change Floss Scheme"), parent),
         m_document(document),
@@ -1010,9 +1396,12 @@ ChangeSchemeCommand::ChangeSchemeCommand(Document *document, const QString &sche
 
 void ChangeSchemeCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QDataStream stream(&m_originalPalette, QIODevice::WriteOnly);
     stream << m_document->pattern()->palette();
     m_document->pattern()->palette().setSchemeName(m_schemeName);
+    CommandStatistics::bytesRetained(m_originalPalette.size());
 
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -1022,6 +1411,8 @@ void ChangeSchemeCommand::redo()
 
 void ChangeSchemeCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QDataStream stream(&m_originalPalette, QIODevice::ReadOnly);
     stream >> m_document->pattern()->palette();
     m_originalPalette.clear();
@@ -1041,13 +1432,23 @@ EditorReadDocumentSettingsCommand::EditorReadDocumentSettingsCommand(Editor *edi
 
 void EditorReadDocumentSettingsCommand::redo()
 {
-    m_editor->readDocumentSettings();
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
 }
 
 
 void EditorReadDocumentSettingsCommand::undo()
 {
-    redo(); // same code required
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply(); // same code required
+}
+
+
+void EditorReadDocumentSettingsCommand::apply()
+{
+    m_editor->readDocumentSettings();
 }
 
 
@@ -1060,13 +1461,23 @@ PreviewReadDocumentSettingsCommand::PreviewReadDocumentSettingsCommand(Preview *
 
 void PreviewReadDocumentSettingsCommand::redo()
 {
-    m_preview->readDocumentSettings();
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
 }
 
 
 void PreviewReadDocumentSettingsCommand::undo()
 {
-    redo(); // same code required
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply(); // same code required
+}
+
+
+void PreviewReadDocumentSettingsCommand::apply()
+{
+    m_preview->readDocumentSettings();
 }
 
 
@@ -1081,66 +1492,20 @@ PaletteReplaceColorCommand::PaletteReplaceColorCommand(Document *document, int o
 
 void PaletteReplaceColorCommand::redo()
 {
-    if (m_stitches.count() || m_backstitches.count() || m_knots.count()) {
-        // populated from a previous redo call
-        // iterator over the existing pointers
-        for (Stitch *stitch : m_stitches) {
-            stitch->colorIndex = m_replacementIndex;
-        }
-
-        for (Backstitch *backstitch : m_backstitches) {
-            backstitch->colorIndex = m_replacementIndex;
-        }
-
-        for (Knot *knot : m_knots) {
-            knot->colorIndex = m_replacementIndex;
-        }
-    } else {
-        // search the stitch data for stitches of the required color
-        StitchData &stitchData = m_document->pattern()->stitches();
-
-        for (int row = 0 ; row < stitchData.height() ; ++row) {
-            for (int col = 0 ; col < stitchData.width() ; ++col) {
-                StitchQueue *queue = stitchData.stitchQueueAt(QPoint(col, row));
-
-                if (queue) {
-                    QListIterator<Stitch *> stitchIterator(*queue);
-
-                    while (stitchIterator.hasNext()) {
-                        Stitch *stitch = stitchIterator.next();
-
-                        if (stitch->colorIndex == m_originalIndex) {
-                            m_stitches.append(stitch);
-                            stitch->colorIndex = m_replacementIndex;
-                        }
-                    }
-                }
-            }
-        }
-
-        QListIterator<Backstitch *> backstitchIterator = stitchData.backstitchIterator();
+    CommandMonitor monitor(Q_FUNC_INFO);
 
-        while (backstitchIterator.hasNext()) {
-            Backstitch *backstitch = backstitchIterator.next();
-
-            if (backstitch->colorIndex == m_originalIndex) {
-                m_backstitches.append(backstitch);
-                backstitch->colorIndex = m_replacementIndex;
-            }
-        }
-
-        QListIterator<Knot *> knotIterator = stitchData.knotIterator();
-
-        while (knotIterator.hasNext()) {
-            Knot *knot = knotIterator.next();
+    StitchData &stitchData = m_document->pattern()->stitches();
 
-            if (knot->colorIndex == m_originalIndex) {
-                m_knots.append(knot);
-                knot->colorIndex = m_replacementIndex;
-            }
-        }
+    if (m_usage.isEmpty()) {
+        // the usage index holds positions rather than pointers, so it remains
+        // valid when other commands reallocate the stitches between calls as
+        // long as they restore the order of the items when undone
+        m_usage = stitchData.colorUsage(m_originalIndex);
     }
 
+    stitchData.recolor(m_usage, m_replacementIndex);
+    CommandStatistics::stitchesTouched(m_usage.cells.count() + m_usage.overflow.count() + m_usage.backstitches.count() + m_usage.knots.count());
+
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
     m_document->palette()->update();
@@ -1149,23 +1514,10 @@ void PaletteReplaceColorCommand::redo()
 
 void PaletteReplaceColorCommand::undo()
 {
-    QListIterator<Stitch *> stitchIterator(m_stitches);
-
-    while (stitchIterator.hasNext()) {
-        stitchIterator.next()->colorIndex = m_originalIndex;
-    }
+    CommandMonitor monitor(Q_FUNC_INFO);
 
-    QListIterator<Backstitch *> backstitchIterator(m_backstitches);
-
-    while (backstitchIterator.hasNext()) {
-        backstitchIterator.next()->colorIndex = m_originalIndex;
-    }
-
-    QListIterator<Knot *> knotIterator(m_knots);
-
-    while (knotIterator.hasNext()) {
-        knotIterator.next()->colorIndex = m_originalIndex;
-    }
+    m_document->pattern()->stitches().recolor(m_usage, m_originalIndex);
+    CommandStatistics::stitchesTouched(m_usage.cells.count() + m_usage.overflow.count() + m_usage.backstitches.count() + m_usage.knots.count());
 
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -1184,16 +1536,26 @@ PaletteSwapColorCommand::PaletteSwapColorCommand(Document *document, int origina
 
 void PaletteSwapColorCommand::redo()
 {
-    m_document->pattern()->palette().swap(m_originalIndex, m_swappedIndex);
-    m_document->editor()->drawContents();
-    m_document->preview()->drawContents();
-    m_document->palette()->update();
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
 }
 
 
 void PaletteSwapColorCommand::undo()
 {
-    redo();
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
+}
+
+
+void PaletteSwapColorCommand::apply()
+{
+    m_document->pattern()->palette().swap(m_originalIndex, m_swappedIndex);
+    m_document->editor()->drawContents();
+    m_document->preview()->drawContents();
+    m_document->palette()->update();
 }
 
 
@@ -1207,15 +1569,25 @@ UpdatePrinterConfigurationCommand::UpdatePrinterConfigurationCommand(Document *d
 
 void UpdatePrinterConfigurationCommand::redo()
 {
-    PrinterConfiguration original = m_document->printerConfiguration();
-    m_document->setPrinterConfiguration(m_printerConfiguration);
-    m_printerConfiguration = original;
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
 }
 
 
 void UpdatePrinterConfigurationCommand::undo()
 {
-    redo();
+    CommandMonitor monitor(Q_FUNC_INFO);
+
+    apply();
+}
+
+
+void UpdatePrinterConfigurationCommand::apply()
+{
+    PrinterConfiguration original = m_document->printerConfiguration();
+    m_document->setPrinterConfiguration(m_printerConfiguration);
+    m_printerConfiguration = original;
 }
 
 
@@ -1240,6 +1612,8 @@ EditCutCommand::~EditCutCommand()
 
 void EditCutCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_originalPattern = m_document->pattern()->cut(m_selectionArea, m_colorMask, m_stitchMasks, m_excludeBackstitches, m_excludeKnots);
 
     QByteArray data;
@@ -1258,6 +1632,8 @@ void EditCutCommand::redo()
 
 void EditCutCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->paste(m_originalPattern, m_selectionArea.topLeft(), true);
     delete m_originalPattern;
     m_originalPattern = nullptr;
@@ -1279,9 +1655,12 @@ EditPasteCommand::EditPasteCommand(Document *document, Pattern *pattern, const Q
 
 void EditPasteCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QDataStream stream(&m_originalPattern, QIODevice::WriteOnly);
     stream << *(m_document->pattern());
     m_document->pattern()->paste(m_pastePattern, m_cell, m_merge);
+    CommandStatistics::bytesRetained(m_originalPattern.size());
 
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -1291,6 +1670,8 @@ void EditPasteCommand::redo()
 
 void EditPasteCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QDataStream stream(&m_originalPattern, QIODevice::ReadOnly);
     m_document->pattern()->clear();
     stream >> *(m_document->pattern());
@@ -1328,11 +1709,14 @@ MirrorSelectionCommand::~MirrorSelectionCommand()
 
 void MirrorSelectionCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     if (!m_copies) {
         delete m_document->pattern()->cut(m_selectionArea, m_colorMask, m_stitchMasks, m_excludeBackstitches, m_excludeKnots);
     }
 
     m_document->pattern()->paste(m_invertedPattern, m_pasteCell, m_merge);
+    CommandStatistics::bytesRetained(m_originalPatternData.size());
 
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -1341,6 +1725,8 @@ void MirrorSelectionCommand::redo()
 
 void MirrorSelectionCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->stitches().clear();
     QDataStream stream(&m_originalPatternData, QIODevice::ReadOnly);
     stream >> m_document->pattern()->stitches();
@@ -1376,11 +1762,14 @@ RotateSelectionCommand::~RotateSelectionCommand()
 
 void RotateSelectionCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     if (!m_copies) {
         delete m_document->pattern()->cut(m_selectionArea, m_colorMask, m_stitchMasks, m_excludeBackstitches, m_excludeKnots);
     }
 
     m_document->pattern()->paste(m_rotatedPattern, m_pasteCell, m_merge);
+    CommandStatistics::bytesRetained(m_originalPatternData.size());
 
     m_document->editor()->drawContents();
     m_document->preview()->drawContents();
@@ -1389,6 +1778,8 @@ void RotateSelectionCommand::redo()
 
 void RotateSelectionCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     m_document->pattern()->stitches().clear();
     QDataStream stream(&m_originalPatternData, QIODevice::ReadOnly);
     stream >> m_document->pattern()->stitches();
@@ -1413,6 +1804,8 @@ AlphabetCommand::~AlphabetCommand()
 
 void AlphabetCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     for (int i = 0 ; i < m_children.size() ; ++i) {
         m_children.at(i)->redo();
     }
@@ -1421,6 +1814,8 @@ void AlphabetCommand::redo()
 
 void AlphabetCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     for (int i = m_children.size() - 1 ; i >= 0 ; --i) {
         m_children.at(i)->undo();
     }
@@ -1460,6 +1855,8 @@ ConfigurationCommand::ConfigurationCommand(MainWindow *mainWindow)
 
 void ConfigurationCommand::redo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::redo();
     m_mainWindow->loadSettings();
 }
@@ -1467,6 +1864,8 @@ void ConfigurationCommand::redo()
 
 void ConfigurationCommand::undo()
 {
+    CommandMonitor monitor(Q_FUNC_INFO);
+
     QUndoCommand::undo();
     m_mainWindow->loadSettings();
 }
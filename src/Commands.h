@@ -258,6 +258,7 @@ private:
     QPoint      m_end;
     int         m_colorIndex;
     Backstitch  *m_backstitch;
+    int         m_index;
 };
 
 
@@ -291,6 +292,7 @@ private:
     QPoint      m_snap;
     int         m_colorIndex;
     Knot        *m_knot;
+    int         m_index;
 };
 
 
@@ -337,6 +339,8 @@ public:
     virtual void undo() Q_DECL_OVERRIDE;
 
 private:
+    void apply();
+
     Document        *m_document;
     QSharedPointer<BackgroundImage> m_backgroundImage;
     QRect           m_rect;
@@ -353,6 +357,8 @@ public:
     virtual void undo() Q_DECL_OVERRIDE;
 
 private:
+    void apply();
+
     Document        *m_document;
     QSharedPointer<BackgroundImage> m_backgroundImage;
     bool            m_visible;
@@ -417,6 +423,8 @@ public:
     virtual void undo() Q_DECL_OVERRIDE;
 
 private:
+    void apply();
+
     Document        *m_document;
     int             m_key;
     DocumentFloss   *m_documentFloss;
@@ -440,8 +448,11 @@ private:
 class ResizeDocumentCommand : public QUndoCommand
 {
 public:
-    ResizeDocumentCommand(Document *, int, int, QUndoCommand *parent = nullptr);
-    virtual ~ResizeDocumentCommand() = default;
+    ResizeDocumentCommand(Document *, int, int, QUndoCommand *parent = nullptr, StitchData *stitchData = nullptr);
+    virtual ~ResizeDocumentCommand();
+
+    static QPoint resize(StitchData &, int, int);
+    static QPoint resizeOffset(const StitchData &, int, int);
 
     void redo() Q_DECL_OVERRIDE;
     void undo() Q_DECL_OVERRIDE;
@@ -455,14 +466,34 @@ private:
     int         m_xOffset;
     int         m_yOffset;
     QPoint      m_snapOffset;
+    StitchData  *m_stitchData;
+};
+
+
+class ReplaceStitchDataCommand : public QUndoCommand
+{
+public:
+    ReplaceStitchDataCommand(Document *, StitchData *, QUndoCommand *parent = nullptr);
+    virtual ~ReplaceStitchDataCommand();
+
+    void redo() Q_DECL_OVERRIDE;
+    void undo() Q_DECL_OVERRIDE;
+
+private:
+    void apply();
+
+    Document    *m_document;
+    StitchData  *m_stitchData;
 };
 
 
 class CropToPatternCommand : public QUndoCommand
 {
 public:
-    explicit CropToPatternCommand(Document *);
-    virtual ~CropToPatternCommand() = default;
+    explicit CropToPatternCommand(Document *, StitchData *stitchData = nullptr);
+    virtual ~CropToPatternCommand();
+
+    static QPoint crop(StitchData &);
 
     void redo() Q_DECL_OVERRIDE;
     void undo() Q_DECL_OVERRIDE;
@@ -474,6 +505,7 @@ private:
     int         m_xOffset;
     int         m_yOffset;
     QRect       m_extents;
+    StitchData  *m_stitchData;
 };
 
 
@@ -526,8 +558,10 @@ private:
 class ExtendPatternCommand : public QUndoCommand
 {
 public:
-    ExtendPatternCommand(Document *, int, int, int, int);
-    virtual ~ExtendPatternCommand() = default;
+    ExtendPatternCommand(Document *, int, int, int, int, StitchData *stitchData = nullptr);
+    virtual ~ExtendPatternCommand();
+
+    static void extend(StitchData &, int, int, int, int);
 
     void redo() Q_DECL_OVERRIDE;
     void undo() Q_DECL_OVERRIDE;
@@ -538,14 +572,18 @@ private:
     int         m_left;
     int         m_right;
     int         m_bottom;
+    StitchData  *m_stitchData;
 };
 
 
 class CentrePatternCommand : public QUndoCommand
 {
 public:
-    explicit CentrePatternCommand(Document *);
-    virtual ~CentrePatternCommand() = default;
+    explicit CentrePatternCommand(Document *, StitchData *stitchData = nullptr);
+    virtual ~CentrePatternCommand();
+
+    static QPoint centre(StitchData &);
+    static QPoint centreOffset(const StitchData &);
 
     void redo() Q_DECL_OVERRIDE;
     void undo() Q_DECL_OVERRIDE;
@@ -554,6 +592,7 @@ private:
     Document    *m_document;
     int         m_xOffset;
     int         m_yOffset;
+    StitchData  *m_stitchData;
 };
 
 
@@ -567,6 +606,8 @@ public:
     void undo() Q_DECL_OVERRIDE;
 
 private:
+    void apply();
+
     Document        *m_document;
     DocumentPalette m_palette;
 };
@@ -598,6 +639,8 @@ public:
     void undo() Q_DECL_OVERRIDE;
 
 private:
+    void apply();
+
     Editor  *m_editor;
 };
 
@@ -612,6 +655,8 @@ public:
     void undo() Q_DECL_OVERRIDE;
 
 private:
+    void apply();
+
     Preview *m_preview;
 };
 
@@ -629,9 +674,7 @@ private:
     Document    *m_document;
     int         m_originalIndex;
     int         m_replacementIndex;
-    QList<Stitch *>     m_stitches;
-    QList<Backstitch *> m_backstitches;
-    QList<Knot *>       m_knots;
+    ColorUsage  m_usage;
 };
 
 
@@ -645,6 +688,8 @@ public:
     void undo() Q_DECL_OVERRIDE;
 
 private:
+    void apply();
+
     Document    *m_document;
     int         m_originalIndex;
     int         m_swappedIndex;
@@ -661,6 +706,8 @@ public:
     void undo() Q_DECL_OVERRIDE;
 
 private:
+    void apply();
+
     Document                *m_document;
     PrinterConfiguration    m_printerConfiguration;
 };
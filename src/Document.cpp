@@ -11,13 +11,17 @@
 
 #include "Document.h"
 
+#include <QColor>
 #include <QDataStream>
 #include <QFile>
 #include <QVariant>
+#include <QVector>
+#include <QtEndian>
 
 #include <KLocalizedString>
 #include <KMessageBox>
 
+#include "BackgroundImage.h"
 #include "Editor.h"
 #include "Exceptions.h"
 #include "Floss.h"
@@ -215,10 +219,26 @@ void Document::readKXStitch(QDataStream &stream)
         // a current KXStitchDoc format file
         stream.device()->seek(11);
         Layers layers;
+        SectionTable sections;
         qint32 version;
         stream >> version;
 
         switch (version) {
+        case 105:
+            stream.setVersion(QDataStream::Qt_4_0); // maintain consistancy in the qt types
+            sections = readSectionTable(stream);
+            seekSection(stream, sections, PropertiesSection);
+            stream >> m_properties;
+            seekSection(stream, sections, PaletteSection);
+            stream >> m_pattern->palette();
+            seekSection(stream, sections, StitchesSection);
+            stream >> m_pattern->stitches();
+            seekSection(stream, sections, BackgroundImagesSection);
+            stream >> m_backgroundImages;
+            seekSection(stream, sections, PrinterConfigurationSection);
+            stream >> m_printerConfiguration;
+            break;
+
         case 104:
             stream.setVersion(QDataStream::Qt_4_0); // maintain consistancy in the qt types
             stream >> m_properties;
@@ -321,19 +341,182 @@ void Document::readPCStitch(QDataStream &stream)
 }
 
 
-void Document::write(QDataStream &stream)
+/**
+    Write the document as a version 105 file.  The header is followed by a
+    table of contents giving the tag, offset and size of each section, then the
+    sections themselves.  The sections are streamed straight to the device and
+    the table of contents filled in afterwards, so the device must be seekable.
+    @param stream the stream to write to
+    @param progress if set, called with the percentage written as each section is completed
+    */
+void Document::write(QDataStream &stream, const std::function<void(int)> &progress)
 {
+    QIODevice *device = stream.device();
+    SectionTable sections;
+    qint64 start;
+
     stream.setVersion(QDataStream::Qt_4_0); // maintain consistancy in the qt types
     stream.writeRawData("KXStitchDoc", 11);
     stream << version;
+    stream << qint32(sectionCount);
+
+    // the table of contents is written empty to reserve its space, then again once the sections have been written
+    qint64 table = device->pos();
+
+    for (int i = 0 ; i < sectionCount ; ++i) {
+        stream << quint32(0) << qint64(0) << qint64(0);
+    }
+
+    auto endSection = [&stream, &sections, &progress, device](Section section, qint64 offset) {
+        if (stream.status() != QDataStream::Ok) {
+            throw FailedWriteFile(stream.status());
+        }
+
+        sections.insert(section, qMakePair(offset, device->pos() - offset));
+
+        if (progress) {
+            progress(sections.count() * 100 / (sectionCount + 1));
+        }
+    };
+
+    start = device->pos();
     stream << m_properties;
+    endSection(PropertiesSection, start);
+
+    start = device->pos();
+    stream << m_pattern->palette();
+    endSection(PaletteSection, start);
+
+    start = device->pos();
+    stream << m_pattern->stitches();
+    endSection(StitchesSection, start);
+
+    start = device->pos();
     stream << m_backgroundImages;
-    stream << *m_pattern;
+    endSection(BackgroundImagesSection, start);
+
+    start = device->pos();
     stream << m_printerConfiguration;
+    endSection(PrinterConfigurationSection, start);
 
-    if (stream.status() != QDataStream::Ok) {
+    qint64 end = device->pos();
+
+    if (!device->seek(table)) {
+        throw FailedWriteFile(QDataStream::WriteFailed);
+    }
+
+    for (SectionTable::const_iterator i = sections.constBegin() ; i != sections.constEnd() ; ++i) {
+        stream << i.key();
+        stream << i.value().first;
+        stream << i.value().second;
+    }
+
+    if (!device->seek(end) || stream.status() != QDataStream::Ok) {
         throw FailedWriteFile(stream.status());
     }
+
+    if (progress) {
+        progress(100);
+    }
+}
+
+
+/**
+    Create a copy of the document for saving on a worker thread.  The copy has
+    its own properties, palette, background images and printer configuration,
+    so the document can be edited while the copy is written.  The stitches
+    are encoded by StitchData::snapshot rather than copied.
+    The copy has no views and an empty undo stack, it must be created and
+    deleted on the GUI thread.
+    @return a pointer to the new Document, owned by the caller
+    */
+Document *Document::snapshot()
+{
+    Document *document = new Document;
+
+    document->m_url = m_url;
+    document->m_properties = m_properties;
+    document->m_printerConfiguration = m_printerConfiguration;
+
+    QListIterator<QSharedPointer<BackgroundImage> > backgroundImageIterator = m_backgroundImages.backgroundImages();
+
+    while (backgroundImageIterator.hasNext()) {
+        document->m_backgroundImages.addBackgroundImage(QSharedPointer<BackgroundImage>(new BackgroundImage(*backgroundImageIterator.next())));
+    }
+
+    // the flosses are copied rather than sharing the palette data as pointers to them are held elsewhere
+    DocumentPalette &palette = m_pattern->palette();
+    DocumentPalette &paletteCopy = document->m_pattern->palette();
+    QMap<int, DocumentFloss *> flosses = palette.flosses();
+
+    paletteCopy.setSchemeName(palette.schemeName());
+    paletteCopy.setSymbolLibrary(palette.symbolLibrary());
+
+    for (QMap<int, DocumentFloss *>::const_iterator i = flosses.constBegin() ; i != flosses.constEnd() ; ++i) {
+        paletteCopy.add(i.key(), new DocumentFloss(i.value()));
+    }
+
+    paletteCopy.setCurrentIndex(palette.currentIndex());
+
+    document->m_pattern->stitches().snapshot(m_pattern->stitches());
+
+    return document;
+}
+
+
+/**
+    Read the table of contents of a version 105 file, checking that each
+    section lies within the file.
+    @param stream the stream positioned after the version
+    @return the offset and size of each section by tag
+    */
+Document::SectionTable Document::readSectionTable(QDataStream &stream)
+{
+    SectionTable sections;
+    qint32 count;
+    qint64 fileSize = stream.device()->size();
+
+    stream >> count;
+
+    if (count < 0 || count > 256) {
+        throw FailedReadFile(QString(i18n("Invalid table of contents")));
+    }
+
+    while (count--) {
+        quint32 tag;
+        qint64 offset;
+        qint64 size;
+
+        stream >> tag;
+        stream >> offset;
+        stream >> size;
+
+        if (offset < 0 || size < 0 || offset > fileSize - size) {
+            throw FailedReadFile(QString(i18n("Invalid table of contents")));
+        }
+
+        sections.insert(tag, qMakePair(offset, size));
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        throw FailedReadFile(stream.status());
+    }
+
+    return sections;
+}
+
+
+/**
+    Position the stream at the start of a section.
+    @param stream the stream to position
+    @param sections the table of contents
+    @param section the section required, an exception is thrown if the file does not have it
+    */
+void Document::seekSection(QDataStream &stream, const SectionTable &sections, Section section)
+{
+    if (!sections.contains(section) || !stream.device()->seek(sections.value(section).first)) {
+        throw FailedReadFile(QString(i18n("Missing section %1", int(section))));
+    }
 }
 
 
@@ -357,6 +540,245 @@ void Document::setProperty(const QString &name, const QVariant &value)
 }
 
 
+const QMap<QString, QVariant> &Document::properties() const
+{
+    return m_properties;
+}
+
+
+/**
+    Conversion of the PC Stitch stitch types to KXStitch.  The types not listed
+    are not valid, 0xff being used for an empty cell.
+    */
+static const Stitch::Type PCStitchTypes[] = {Stitch::Delete, Stitch::Full, Stitch::TL3Qtr, Stitch::TR3Qtr, Stitch::BL3Qtr, Stitch::BR3Qtr, Stitch::TBHalf, Stitch::BTHalf, Stitch::Delete, Stitch::TLQtr, Stitch::TRQtr, Stitch::BLQtr, Stitch::BRQtr};
+// TODO above needs to include petite stitches
+
+
+/**
+    Convert a PC Stitch stitch type.
+    @param type the PC Stitch type, which must not be 0xff
+    @return the Stitch::Type, Stitch::Delete if no stitch is added
+    */
+static Stitch::Type pcStitchType(quint8 type)
+{
+    if (type >= sizeof(PCStitchTypes) / sizeof(PCStitchTypes[0])) {
+        throw FailedReadFile(QString(i18n("Invalid data read.")));
+    }
+
+    return PCStitchTypes[type];
+}
+
+
+/**
+    Convert a PC Stitch color to a palette index.
+    @param color the 1 based index of the PC Stitch color list
+    @param colors the number of colors in the palette
+    @return the 0 based palette index
+    */
+static int pcStitchColor(int color, int colors)
+{
+    if (color < 1 || color > colors) {
+        throw FailedReadFile(QString(i18n("Invalid data read.")));
+    }
+
+    return color - 1;
+}
+
+
+/**
+    Resize the pattern for a PC Stitch file.  Each run of stitches covers at most
+    65535 cells in four bytes, so a size needing more runs than the rest of the
+    file could hold is rejected before the cells are allocated.
+    @param stream the stream being read, positioned after the size
+    @param stitchData the StitchData to resize
+    @param width the width read
+    @param height the height read
+    */
+static void resizePCStitch(QDataStream &stream, StitchData &stitchData, int width, int height)
+{
+    qint64 runs = (qint64(width) * height + 65534) / 65535;
+
+    if (stream.status() != QDataStream::Ok || stream.device()->bytesAvailable() < runs * 4) {
+        throw FailedReadFile(QString(i18n("Invalid data read.")));
+    }
+
+    stitchData.resize(width, height);
+}
+
+
+/**
+    Read the run length encoded stitches of a PC Stitch file straight into the
+    cells of the pattern.  Each run is a quint16 cell count, a quint8 color and
+    a quint8 type, the runs going down the columns from the top left.  The runs
+    are peeked from the device a block at a time, only the bytes of the runs
+    used being skipped so the stream is left at the extras that follow.  The
+    cells are all empty before the runs are read, so the stitches are queued
+    without merging them.
+    @param stream the stream being read, positioned at the first run
+    @param stitchData the StitchData, resized to the pattern
+    @param colors the number of colors in the palette
+    */
+static void readPCStitchRuns(QDataStream &stream, StitchData &stitchData, int colors)
+{
+    int width = stitchData.width();
+    int height = stitchData.height();
+    qint64 cells = qint64(width) * height;
+
+    QVector<StitchQueue **> rows(height);
+
+    for (int y = 0 ; y < height ; ++y) {
+        rows[y] = stitchData.stitchQueueRow(y);
+    }
+
+    QIODevice *device = stream.device();
+    char block[16384];
+    qint64 cell = 0;
+
+    while (cell < cells) {
+        qint64 length = device->peek(block, sizeof(block)) & ~qint64(3);
+
+        if (length <= 0) {
+            throw FailedReadFile(QString(i18n("Stream error")));
+        }
+
+        const uchar *run = reinterpret_cast<const uchar *>(block);
+        const uchar *end = run + length;
+
+        while (run < end && cell < cells) {
+            int cellCount = qFromLittleEndian<quint16>(run);
+            quint8 color = run[2];
+            quint8 type = run[3];
+            run += 4;
+
+            if (cellCount == 0) {
+                throw FailedReadFile(QString(i18n("Invalid data read.")));
+            }
+
+            qint64 last = qMin(cells, cell + cellCount);
+            Stitch::Type stitchType = (type == 0xff) ? Stitch::Delete : pcStitchType(type);
+
+            if (stitchType != Stitch::Delete) {
+                int colorIndex = pcStitchColor(color, colors);     // color-1 because PCStitch uses 1 based array
+
+                for ( ; cell < last ; ++cell) {
+                    StitchQueue *&stitchQueue = rows.at(int(cell % height))[cell / height];
+
+                    if (stitchQueue == nullptr) {
+                        stitchQueue = new StitchQueue;
+                    }
+
+                    stitchQueue->enqueue(new Stitch(stitchType, colorIndex));
+                }
+            }
+
+            cell = last;
+        }
+
+        stream.skipRawData(int(run - reinterpret_cast<const uchar *>(block)));
+    }
+}
+
+
+/**
+    Read the extra stitches of a PC Stitch file, up to four for each cell given,
+    merging them with any stitches already in the cell.
+    @param stream the stream being read, positioned at the count of extras
+    @param stitchData the StitchData the stitches are added to
+    @param colors the number of colors in the palette
+    */
+template <class Coordinate>
+static void readPCStitchExtras(QDataStream &stream, StitchData &stitchData, int colors)
+{
+    quint32 extras;
+    stream >> extras;
+
+    while (extras-- && stream.status() == QDataStream::Ok) {
+        Coordinate x;
+        Coordinate y;
+        stream >> x >> y;
+
+        for (int dx = 0 ; dx < 4 ; dx++) {
+            quint8 color;
+            quint8 type;
+            stream >> color >> type;
+
+            Stitch::Type stitchType = (type == 0xff) ? Stitch::Delete : pcStitchType(type);
+
+            if (stitchType != Stitch::Delete) {
+                if (!stitchData.isValid(x - 1, y - 1)) {
+                    throw FailedReadFile(QString(i18n("Invalid data read.")));
+                }
+
+                stitchData.addStitch(QPoint(x - 1, y - 1), stitchType, pcStitchColor(color, colors));
+            }
+        }
+    }
+}
+
+
+/**
+    Read the french knots of a PC Stitch file, rejecting knots outside the pattern.
+    @param stream the stream being read, positioned at the count of knots
+    @param stitchData the StitchData the knots are added to
+    @param colors the number of colors in the palette
+    */
+template <class Coordinate, class Color>
+static void readPCStitchKnots(QDataStream &stream, StitchData &stitchData, int colors)
+{
+    quint32 knots;
+    stream >> knots;
+
+    while (knots-- && stream.status() == QDataStream::Ok) {
+        Coordinate x;
+        Coordinate y;
+        Color color;
+        stream >> x >> y >> color;
+
+        // knots are at the snap points, from the top left corner to the bottom right corner of the pattern
+        QPoint position(x - 1, y - 1);
+
+        if (position.x() < 0 || position.x() > stitchData.width() * 2 || position.y() < 0 || position.y() > stitchData.height() * 2) {
+            throw FailedReadFile(QString(i18n("Invalid data read.")));
+        }
+
+        stitchData.addFrenchKnot(position, pcStitchColor(color, colors));
+    }
+}
+
+
+/**
+    Read the backstitches of a PC Stitch file.  The ends are given as a cell and
+    one of the nine snap points of the cell, numbered 1 to 9 from the top left,
+    the cells being checked to be within the pattern.
+    @param stream the stream being read, positioned at the count of backstitches
+    @param stitchData the StitchData the backstitches are added to
+    @param colors the number of colors in the palette
+    */
+template <class Coordinate, class Color>
+static void readPCStitchBackstitches(QDataStream &stream, StitchData &stitchData, int colors)
+{
+    quint32 backstitches;
+    stream >> backstitches;
+
+    while (backstitches-- && stream.status() == QDataStream::Ok) {
+        Coordinate sx;
+        Coordinate sy;
+        Coordinate sp;
+        Coordinate ex;
+        Coordinate ey;
+        Coordinate ep;
+        Color color;
+        stream >> sx >> sy >> sp >> ex >> ey >> ep >> color;
+
+        if (!stitchData.isValid(sx - 1, sy - 1) || !stitchData.isValid(ex - 1, ey - 1) || sp < 1 || sp > 9 || ep < 1 || ep > 9) {
+            throw FailedReadFile(QString(i18n("Invalid data read.")));
+        }
+
+        stitchData.addBackstitch(QPoint((sx - 1) * 2 + ((sp - 1) % 3), (sy - 1) * 2 + ((sp - 1) / 3)), QPoint((ex - 1) * 2 + ((ep - 1) % 3), (ey - 1) * 2 + ((ep - 1) / 3)), pcStitchColor(color, colors));
+    }
+}
+
+
 void Document::readPCStitch5File(QDataStream &stream)
 {
     /* File Format
@@ -447,7 +869,7 @@ void Document::readPCStitch5File(QDataStream &stream)
     stream >> width;
     stream >> height;
 
-    m_pattern->stitches().resize(width, height);
+    resizePCStitch(stream, m_pattern->stitches(), width, height);
     setProperty(QStringLiteral("unitsFormat"), Configuration::EnumDocument_UnitsFormat::Stitches);
 
     quint16 clothCount;
@@ -542,85 +964,13 @@ void Document::readPCStitch5File(QDataStream &stream)
 
     m_pattern->palette().setCurrentIndex(-1);
 
-    Stitch::Type stitchType[] = {Stitch::Delete, Stitch::Full, Stitch::TL3Qtr, Stitch::TR3Qtr, Stitch::BL3Qtr, Stitch::BR3Qtr, Stitch::TBHalf, Stitch::BTHalf, Stitch::Delete, Stitch::TLQtr, Stitch::TRQtr, Stitch::BLQtr, Stitch::BRQtr}; // conversion of PCStitch to KXStitch
+    StitchData &stitchData = m_pattern->stitches();
+    int colors = m_pattern->palette().flosses().count();
 
-    int documentWidth = m_pattern->stitches().width();
-    int documentHeight = m_pattern->stitches().height();
-    int cells = documentWidth * documentHeight;
-
-    quint16 cellCount;
-
-    for (int i = 0 ; i < cells ; i += cellCount) {
-        quint8 color;
-        quint8 type;
-
-        stream >> cellCount;
-        stream >> color;
-        stream >> type;
-
-        if (type != 0xff) {
-            for (int c = 0 ; c < cellCount ; c++) {
-                int xc = (i + c) / documentHeight;
-                int yc = (i + c) % documentHeight;
-                m_pattern->stitches().addStitch(QPoint(xc, yc), stitchType[type], color - 1); // color-1 because PCStitch uses 1 based array
-            }
-        }
-    }
-
-    quint32 extras;
-    stream >> extras;
-
-    while (extras--) {
-        quint16 x;
-        quint16 y;
-        quint8 color;
-        quint8 type;
-
-        stream >> x;
-        stream >> y;
-
-        for (int dx = 0 ; dx < 4 ; dx++) {
-            stream >> color;
-            stream >> type;
-
-            if (type != 0xff) {
-                m_pattern->stitches().addStitch(QPoint(x - 1, y - 1), stitchType[type], color - 1);
-            }
-        }
-    }
-
-    // read french knots
-
-    quint32 knots;
-    stream >> knots;
-
-    while (knots--) {
-        quint16 x;
-        quint16 y;
-        quint8 color;
-
-        stream >> x;
-        stream >> y;
-        stream >> color;
-        m_pattern->stitches().addFrenchKnot(QPoint(x - 1, y - 1), color - 1);
-    }
-
-    // read backstitches
-
-    quint32 backstitches;
-    stream >> backstitches;
-
-    while (backstitches--) {
-        quint16 sx;
-        quint16 sy;
-        quint16 sp;
-        quint16 ex;
-        quint16 ey;
-        quint16 ep;
-        quint8 color;
-        stream >> sx >> sy >> sp >> ex >> ey >> ep >> color;
-        m_pattern->stitches().addBackstitch(QPoint(--sx * 2 + ((sp - 1) % 3), --sy * 2 + ((sp - 1) / 3)), QPoint(--ex * 2 + ((ep - 1) % 3), --ey * 2 + ((ep - 1) / 3)), color - 1);
-    }
+    readPCStitchRuns(stream, stitchData, colors);
+    readPCStitchExtras<quint16>(stream, stitchData, colors);
+    readPCStitchKnots<quint16, quint8>(stream, stitchData, colors);
+    readPCStitchBackstitches<quint16, quint8>(stream, stitchData, colors);
 
     if (stream.status() != QDataStream::Ok) {
         throw FailedReadFile(QString(i18n("Stream error")));
@@ -725,7 +1075,7 @@ void Document::readPCStitch6File(QDataStream &stream)
     stream >> width;
     stream >> height;
 
-    m_pattern->stitches().resize(width, height);
+    resizePCStitch(stream, m_pattern->stitches(), width, height);
     setProperty(QStringLiteral("unitsFormat"), Configuration::EnumDocument_UnitsFormat::Stitches);
 
     quint16 clothCount;
@@ -823,85 +1173,13 @@ void Document::readPCStitch6File(QDataStream &stream)
 
     m_pattern->palette().setCurrentIndex(-1);
 
-    Stitch::Type stitchType[] = {Stitch::Delete, Stitch::Full, Stitch::TL3Qtr, Stitch::TR3Qtr, Stitch::BL3Qtr, Stitch::BR3Qtr, Stitch::TBHalf, Stitch::BTHalf, Stitch::Delete, Stitch::TLQtr, Stitch::TRQtr, Stitch::BLQtr, Stitch::BRQtr}; // conversion of PCStitch to KXStitch
-
-    int documentWidth = m_pattern->stitches().width();
-    int documentHeight = m_pattern->stitches().height();
-    int cells = documentWidth * documentHeight;
-
-    quint16 cellCount;
-
-    for (int i = 0 ; i < cells ; i += cellCount) {
-        quint8 color;
-        quint8 type;
-
-        stream >> cellCount;
-        stream >> color;
-        stream >> type;
-
-        if (type != 0xff) {
-            for (int c = 0 ; c < cellCount ; c++) {
-                int xc = (i + c) / documentHeight;
-                int yc = (i + c) % documentHeight;
-                m_pattern->stitches().addStitch(QPoint(xc, yc), stitchType[type], color - 1); // color-1 because PCStitch uses 1 based array
-            }
-        }
-    }
-
-    quint32 extras;
-    stream >> extras;
-
-    while (extras--) {
-        qint16 x;
-        qint16 y;
-        quint8 color;
-        quint8 type;
-
-        stream >> x;
-        stream >> y;
+    StitchData &stitchData = m_pattern->stitches();
+    int colors = m_pattern->palette().flosses().count();
 
-        for (int dx = 0 ; dx < 4 ; dx++) {
-            stream >> color;
-            stream >> type;
-
-            if (type != 0xff) {
-                m_pattern->stitches().addStitch(QPoint(x - 1, y - 1), stitchType[type], color - 1);
-            }
-        }
-    }
-
-    // read french knots
-
-    quint32 knots;
-    stream >> knots;
-
-    while (knots--) {
-        qint16 x;
-        qint16 y;
-        quint8 color;
-
-        stream >> x;
-        stream >> y;
-        stream >> color;
-        m_pattern->stitches().addFrenchKnot(QPoint(x - 1, y - 1), color - 1);
-    }
-
-    // read backstitches
-
-    qint32 backstitches;
-    stream >> backstitches;
-
-    while (backstitches--) {
-        qint16 sx;
-        qint16 sy;
-        qint16 sp;
-        qint16 ex;
-        qint16 ey;
-        qint16 ep;
-        quint16 color;
-        stream >> sx >> sy >> sp >> ex >> ey >> ep >> color;
-        m_pattern->stitches().addBackstitch(QPoint(--sx * 2 + ((sp - 1) % 3), --sy * 2 + ((sp - 1) / 3)), QPoint(--ex * 2 + ((ep - 1) % 3), --ey * 2 + ((ep - 1) / 3)), color - 1);
-    }
+    readPCStitchRuns(stream, stitchData, colors);
+    readPCStitchExtras<qint16>(stream, stitchData, colors);
+    readPCStitchKnots<qint16, quint8>(stream, stitchData, colors);
+    readPCStitchBackstitches<qint16, quint16>(stream, stitchData, colors);
 
     if (stream.status() != QDataStream::Ok) {
         throw FailedReadFile(QString(i18n("Stream error")));
@@ -1016,7 +1294,7 @@ void Document::readPCStitch7File(QDataStream &stream)
     stream >> width;
     stream >> height;
 
-    m_pattern->stitches().resize(width, height);
+    resizePCStitch(stream, m_pattern->stitches(), width, height);
     setProperty(QStringLiteral("unitsFormat"), Configuration::EnumDocument_UnitsFormat::Stitches);
 
     quint16 clothCount;
@@ -1123,85 +1401,13 @@ void Document::readPCStitch7File(QDataStream &stream)
 
     m_pattern->palette().setCurrentIndex(-1);
 
-    Stitch::Type stitchType[] = {Stitch::Delete, Stitch::Full, Stitch::TL3Qtr, Stitch::TR3Qtr, Stitch::BL3Qtr, Stitch::BR3Qtr, Stitch::TBHalf, Stitch::BTHalf, Stitch::Delete, Stitch::TLQtr, Stitch::TRQtr, Stitch::BLQtr, Stitch::BRQtr}; // conversion of PCStitch to KXStitch
-    // TODO above needs to include petite stitches
-    int documentWidth = m_pattern->stitches().width();
-    int documentHeight = m_pattern->stitches().height();
-    int cells = documentWidth * documentHeight;
-
-    quint16 cellCount;
-
-    for (int i = 0 ; i < cells ; i += cellCount) {
-        quint8 color;
-        quint8 type;
-
-        stream >> cellCount;
-        stream >> color;
-        stream >> type;
-
-        if (type != 0xff) {
-            for (int c = 0 ; c < cellCount ; c++) {
-                int xc = (i + c) / documentHeight;
-                int yc = (i + c) % documentHeight;
-                m_pattern->stitches().addStitch(QPoint(xc, yc), stitchType[type], color - 1); // color-1 because PCStitch uses 1 based array
-            }
-        }
-    }
-
-    quint32 extras;
-    stream >> extras;
-
-    while (extras--) {
-        quint16 x;
-        quint16 y;
-        quint8 color;
-        quint8 type;
-
-        stream >> x;
-        stream >> y;
-
-        for (int dx = 0 ; dx < 4 ; dx++) {
-            stream >> color;
-            stream >> type;
-
-            if (type != 0xff) {
-                m_pattern->stitches().addStitch(QPoint(x - 1, y - 1), stitchType[type], color - 1);
-            }
-        }
-    }
-
-    // read french knots
+    StitchData &stitchData = m_pattern->stitches();
+    int colors = m_pattern->palette().flosses().count();
 
-    quint32 knots;
-    stream >> knots;
-
-    while (knots--) {
-        quint16 x;
-        quint16 y;
-        quint16 color;
-
-        stream >> x;
-        stream >> y;
-        stream >> color;
-        m_pattern->stitches().addFrenchKnot(QPoint(x - 1, y - 1), color - 1);
-    }
-
-    // read backstitches
-
-    quint32 backstitches;
-    stream >> backstitches;
-
-    while (backstitches--) {
-        quint16 sx;
-        quint16 sy;
-        quint16 sp;
-        quint16 ex;
-        quint16 ey;
-        quint16 ep;
-        quint16 color;
-        stream >> sx >> sy >> sp >> ex >> ey >> ep >> color;
-        m_pattern->stitches().addBackstitch(QPoint(--sx * 2 + ((sp - 1) % 3), --sy * 2 + ((sp - 1) / 3)), QPoint(--ex * 2 + ((ep - 1) % 3), --ey * 2 + ((ep - 1) / 3)), color - 1);
-    }
+    readPCStitchRuns(stream, stitchData, colors);
+    readPCStitchExtras<quint16>(stream, stitchData, colors);
+    readPCStitchKnots<quint16, quint16>(stream, stitchData, colors);
+    readPCStitchBackstitches<quint16, quint16>(stream, stitchData, colors);
 
     if (stream.status() != QDataStream::Ok) {
         throw FailedReadFile(QString(i18n("Stream error")));
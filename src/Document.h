@@ -13,10 +13,14 @@
 #define Document_H
 
 
+#include <QMap>
+#include <QPair>
 #include <QPolygon>
 #include <QUndoStack>
 #include <QUrl>
 
+#include <functional>
+
 #include "BackgroundImages.h"
 #include "configuration.h"
 #include "Exceptions.h"
@@ -24,6 +28,8 @@
 #include "PrinterConfiguration.h"
 
 
+class QIODevice;
+
 class Editor;
 class Palette;
 class Preview;
@@ -39,7 +45,8 @@ public:
 
     void readKXStitch(QDataStream &);
     void readPCStitch(QDataStream &);
-    void write(QDataStream &);
+    void write(QDataStream &, const std::function<void(int)> &progress = std::function<void(int)>());
+    Document *snapshot();
 
     void setUrl(const QUrl &);
     QUrl url() const;
@@ -54,6 +61,7 @@ public:
 
     QVariant property(const QString &) const;
     void setProperty(const QString &, const QVariant &);
+    const QMap<QString, QVariant> &properties() const;
 
     QUndoStack &undoStack();
 
@@ -63,6 +71,24 @@ public:
     void setPrinterConfiguration(const PrinterConfiguration &);
 
 private:
+    /**
+        The sections of a version 105 file, the table of contents holds the
+        tag, offset from the start of the file and size of each section.
+        Tag 2 is not used.
+        */
+    enum Section {
+        PropertiesSection = 1,
+        PaletteSection = 3,
+        StitchesSection,
+        BackgroundImagesSection,
+        PrinterConfigurationSection
+    };
+
+    typedef QMap<quint32, QPair<qint64, qint64> > SectionTable;
+
+    static SectionTable readSectionTable(QDataStream &);
+    static void seekSection(QDataStream &, const SectionTable &, Section);
+
     void readPCStitch5File(QDataStream &);
     void readPCStitch6File(QDataStream &);
     void readPCStitch7File(QDataStream &);
@@ -75,7 +101,8 @@ private:
     void readKXStitchV6File(QDataStream &);
     void readKXStitchV7File(QDataStream &);
 
-    static const int version = 104;
+    static const int version = 105;
+    static const int sectionCount = 5;
 
     QMap<QString, QVariant> m_properties;
 
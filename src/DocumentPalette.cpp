@@ -11,6 +11,9 @@
 
 #include "DocumentPalette.h"
 
+#include <QCoreApplication>
+#include <QThread>
+
 #include <KLocalizedString>
 #include <KMessageBox>
 
@@ -230,11 +233,7 @@ int DocumentPalette::add(const QColor &srcColor)
     int colorIndex = -1;
 
     FlossScheme *scheme = SchemeManager::scheme(d->m_schemeName);
-    Floss *floss = scheme->find(srcColor);
-
-    if (floss == nullptr) {
-        floss = scheme->convert(srcColor);
-    }
+    Floss *floss = scheme->convert(srcColor);
 
     for (QMap<int, DocumentFloss*>::const_iterator i = d->m_documentFlosses.constBegin() ; i != d->m_documentFlosses.constEnd() ; ++i) {
         if (i.value()->flossColor() == floss->color()) {
@@ -430,8 +429,18 @@ QDataStream &operator>>(QDataStream &stream, DocumentPalette &documentPalette)
 
     // missingSymbols will contain pointers to DocumentFloss where the symbol index is not in the symbol library
     // check there is a sufficient quantity of symbols to allocate to the remaining flosses
+    // the message boxes can only be shown on the GUI thread, a palette read on
+    // another thread fails rather than asking and does not report the changes
+    bool interactive = (QCoreApplication::instance() && QThread::currentThread() == QCoreApplication::instance()->thread());
+
     if (missingSymbols.count() > indexes.count()) {
-        if (KMessageBox::Cancel == KMessageBox::warningContinueCancel(nullptr, QString(i18n("There are insufficient symbols available in the symbol library for this pattern. An extra %1 are required.", missingSymbols.count() - indexes.count())))) {
+        QString warning(i18n("There are insufficient symbols available in the symbol library for this pattern. An extra %1 are required.", missingSymbols.count() - indexes.count()));
+
+        if (!interactive) {
+            throw FailedReadFile(warning);
+        }
+
+        if (KMessageBox::Cancel == KMessageBox::warningContinueCancel(nullptr, warning)) {
             throw FailedReadFile(QString(i18n("Canceled: Insufficient symbols available")));
         }
     }
@@ -447,7 +456,7 @@ QDataStream &operator>>(QDataStream &stream, DocumentPalette &documentPalette)
         }
     }
 
-    if (int count = missingSymbols.count()) {
+    if (int count = (interactive) ? missingSymbols.count() : 0) {
         // display an information box to show symbols have been allocated
         QString information(i18np("The following floss color has had its symbol\nreplaced because it did not exist in the symbol library.\n\n",
                                   "The following floss colors have had their symbols\nreplaced because they did not exist in the symbol library.\n\n",
@@ -33,6 +33,7 @@
 #include <math.h>
 
 #include "BackgroundImage.h"
+#include "CommandStatistics.h"
 #include "Commands.h"
 #include "Document.h"
 #include "Floss.h"
@@ -312,6 +313,8 @@ void Editor::drawContents(const QRect &cells)
 
     painter.end();
 
+    CommandStatistics::redrawn(cells);
+
     update();
 }
 
@@ -718,7 +721,8 @@ bool Editor::event(QEvent *e)
         int colorIndex = -1;
         QPoint cell = contentsToCell(helpEvent->pos());
         int zone = contentsToZone(helpEvent->pos());
-        StitchQueue *queue = m_document->pattern()->stitches().stitchQueueAt(cell);
+        const StitchData &stitchData = m_document->pattern()->stitches();
+        const StitchQueue *queue = stitchData.stitchQueueAt(cell);
 
         if (queue) {
             Stitch::Type type = stitchMap[0][zone];
@@ -1351,7 +1355,8 @@ void Editor::renderBackgroundImages(QPainter &painter, const QRect &updateRectan
         if (backgroundImage->isVisible()) {
             if (backgroundImage->location().intersects(updateRectangle)) {
                 painter.setClipRect(updateRectangle.x(), updateRectangle.y(), updateRectangle.width(), updateRectangle.height());
-                painter.drawImage(backgroundImage->location(), backgroundImage->image());
+                QSize size = painter.combinedTransform().mapRect(QRectF(backgroundImage->location())).size().toSize();
+                painter.drawImage(backgroundImage->location(), backgroundImage->image(size));
                 painter.setClipping(false);
             }
         }
@@ -2087,7 +2092,8 @@ void Editor::mouseMoveEvent_ColorPicker(QMouseEvent*)
 void Editor::mouseReleaseEvent_ColorPicker(QMouseEvent *e)
 {
     int colorIndex = -1;
-    StitchQueue *queue = m_document->pattern()->stitches().stitchQueueAt(contentsToCell(e->pos()));
+    const StitchData &stitchData = m_document->pattern()->stitches();
+    const StitchQueue *queue = stitchData.stitchQueueAt(contentsToCell(e->pos()));
 
     if (queue) {
         Stitch::Type type = stitchMap[0][m_zoneStart];
@@ -94,6 +94,18 @@ FailedWriteFile::FailedWriteFile(QDataStream::Status status)
 }
 
 
+/**
+ * Constructor
+ *
+ * @param message the message for the event causing the error
+ */
+FailedWriteFile::FailedWriteFile(const QString &message)
+    :   m_status(QDataStream::WriteFailed),
+        m_message(message)
+{
+}
+
+
 /**
  * Get the status message of the QDataStream::Status
  *
@@ -101,6 +113,10 @@ FailedWriteFile::FailedWriteFile(QDataStream::Status status)
  */
 QString FailedWriteFile::statusMessage() const
 {
+    if (!m_message.isEmpty()) {
+        return m_message;
+    }
+
 #if QT_VERSION >= 0x040800
 
     if (m_status == QDataStream::WriteFailed) {
@@ -78,11 +78,13 @@ class FailedWriteFile
 {
 public:
     explicit FailedWriteFile(QDataStream::Status status);
+    explicit FailedWriteFile(const QString &message);
 
     QString statusMessage() const;
 
 private:
     QDataStream::Status m_status;   /**< the status of the error */
+    QString             m_message;  /**< the message for an error not caused by the stream */
 };
 
 
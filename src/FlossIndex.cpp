@@ -0,0 +1,583 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+/**
+    @file
+    Implement classes for LabColor and FlossIndex.
+    */
+
+
+#include "FlossIndex.h"
+
+#include <QRunnable>
+#include <QThreadPool>
+#include <QtMath>
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "Floss.h"
+
+
+/**
+    The number of candidates found by euclidean distance that are compared
+    using CIEDE2000.  The two measures rarely disagree by more than a few places,
+    when the CIEDE2000 nearest floss is missed the one returned is a near tie.
+    */
+const int CandidateCount = 16;
+
+
+/**
+    The number of colors matched together by the batch kernel.
+    */
+const int BlockSize = 8;
+
+
+static double linearize(double c)
+{
+    return (c <= 0.04045) ? c / 12.92 : qPow((c + 0.055) / 1.055, 2.4);
+}
+
+
+static double labFunction(double t)
+{
+    return (t > 216.0 / 24389.0) ? std::cbrt(t) : ((24389.0 / 27.0) * t + 16.0) / 116.0;
+}
+
+
+LabColor::LabColor()
+    :   L(0.0),
+        a(0.0),
+        b(0.0)
+{
+}
+
+
+LabColor::LabColor(const QColor &color)
+{
+    double red = linearize(color.redF());
+    double green = linearize(color.greenF());
+    double blue = linearize(color.blueF());
+
+    double x = labFunction((0.4124564 * red + 0.3575761 * green + 0.1804375 * blue) / 0.95047);
+    double y = labFunction(0.2126729 * red + 0.7151522 * green + 0.0721750 * blue);
+    double z = labFunction((0.0193339 * red + 0.1191920 * green + 0.9503041 * blue) / 1.08883);
+
+    L = 116.0 * y - 16.0;
+    a = 500.0 * (x - y);
+    b = 200.0 * (y - z);
+}
+
+
+double LabColor::component(int axis) const
+{
+    return (axis == 0) ? L : (axis == 1) ? a : b;
+}
+
+
+/**
+    The square of the CIE76 color difference.
+    @param other the color to compare with
+    @return the squared euclidean distance in CIELAB
+    */
+double LabColor::distanceSquared(const LabColor &other) const
+{
+    double dL = L - other.L;
+    double da = a - other.a;
+    double db = b - other.b;
+
+    return dL * dL + da * da + db * db;
+}
+
+
+/**
+    The CIEDE2000 color difference.
+    @param other the color to compare with
+    @return the color difference, 1.0 being roughly a just noticeable difference
+    */
+double LabColor::deltaE2000(const LabColor &other) const
+{
+    const double pow25To7 = 6103515625.0;
+
+    double C1 = std::hypot(a, b);
+    double C2 = std::hypot(other.a, other.b);
+    double meanC7 = qPow((C1 + C2) / 2.0, 7.0);
+    double G = 0.5 * (1.0 - qSqrt(meanC7 / (meanC7 + pow25To7)));
+
+    double a1 = (1.0 + G) * a;
+    double a2 = (1.0 + G) * other.a;
+    double C1p = std::hypot(a1, b);
+    double C2p = std::hypot(a2, other.b);
+    double h1p = (C1p == 0.0) ? 0.0 : qRadiansToDegrees(qAtan2(b, a1));
+    double h2p = (C2p == 0.0) ? 0.0 : qRadiansToDegrees(qAtan2(other.b, a2));
+
+    if (h1p < 0.0) {
+        h1p += 360.0;
+    }
+
+    if (h2p < 0.0) {
+        h2p += 360.0;
+    }
+
+    double dLp = other.L - L;
+    double dCp = C2p - C1p;
+    double dhp = 0.0;
+    double meanHp = h1p + h2p;
+
+    if (C1p * C2p != 0.0) {
+        dhp = h2p - h1p;
+
+        if (dhp > 180.0) {
+            dhp -= 360.0;
+        } else if (dhp < -180.0) {
+            dhp += 360.0;
+        }
+
+        if (qAbs(h1p - h2p) <= 180.0) {
+            meanHp = (h1p + h2p) / 2.0;
+        } else if (h1p + h2p < 360.0) {
+            meanHp = (h1p + h2p + 360.0) / 2.0;
+        } else {
+            meanHp = (h1p + h2p - 360.0) / 2.0;
+        }
+    }
+
+    double dHp = 2.0 * qSqrt(C1p * C2p) * qSin(qDegreesToRadians(dhp / 2.0));
+    double meanLp = (L + other.L) / 2.0;
+    double meanCp = (C1p + C2p) / 2.0;
+
+    double T = 1.0 - 0.17 * qCos(qDegreesToRadians(meanHp - 30.0))
+                   + 0.24 * qCos(qDegreesToRadians(2.0 * meanHp))
+                   + 0.32 * qCos(qDegreesToRadians(3.0 * meanHp + 6.0))
+                   - 0.20 * qCos(qDegreesToRadians(4.0 * meanHp - 63.0));
+    double dTheta = 30.0 * qExp(-((meanHp - 275.0) / 25.0) * ((meanHp - 275.0) / 25.0));
+    double meanCp7 = qPow(meanCp, 7.0);
+    double RC = 2.0 * qSqrt(meanCp7 / (meanCp7 + pow25To7));
+    double meanLp50 = (meanLp - 50.0) * (meanLp - 50.0);
+    double SL = 1.0 + (0.015 * meanLp50) / qSqrt(20.0 + meanLp50);
+    double SC = 1.0 + 0.045 * meanCp;
+    double SH = 1.0 + 0.015 * meanCp * T;
+    double RT = -qSin(qDegreesToRadians(2.0 * dTheta)) * RC;
+
+    double lightness = dLp / SL;
+    double chroma = dCp / SC;
+    double hue = dHp / SH;
+
+    return qSqrt(lightness * lightness + chroma * chroma + hue * hue + RT * chroma * hue);
+}
+
+
+/**
+    The closest flosses found so far, ordered by distance and then by floss
+    position so that equally close flosses are found in the scheme order.
+    */
+class FlossIndex::Candidates
+{
+public:
+    Candidates()
+        :   count(0)
+    {
+    }
+
+    double worst() const
+    {
+        return (count < CandidateCount) ? std::numeric_limits<double>::max() : distances[count - 1];
+    }
+
+    void insert(int floss, double distance)
+    {
+        int i;
+
+        if (count < CandidateCount) {
+            i = count++;
+        } else if (isCloser(floss, distance, CandidateCount - 1)) {
+            i = CandidateCount - 1;
+        } else {
+            return;
+        }
+
+        while (i > 0 && isCloser(floss, distance, i - 1)) {
+            flosses[i] = flosses[i - 1];
+            distances[i] = distances[i - 1];
+            --i;
+        }
+
+        flosses[i] = floss;
+        distances[i] = distance;
+    }
+
+    int     count;
+    int     flosses[CandidateCount];
+    double  distances[CandidateCount];
+
+private:
+    bool isCloser(int floss, double distance, int i) const
+    {
+        return (distance < distances[i]) || (distance == distances[i] && floss < flosses[i]);
+    }
+};
+
+
+/**
+    Match a range of rows on a pool thread.
+    */
+class NearestRows : public QRunnable
+{
+public:
+    NearestRows(const FlossIndex *index, const QRgb *colors, int *flosses, int count)
+        :   m_index(index),
+            m_colors(colors),
+            m_flosses(flosses),
+            m_count(count)
+    {
+    }
+
+    virtual void run() Q_DECL_OVERRIDE
+    {
+        m_index->nearest(m_colors, m_flosses, m_count);
+    }
+
+private:
+    const FlossIndex    *m_index;
+    const QRgb          *m_colors;
+    int                 *m_flosses;
+    int                 m_count;
+};
+
+
+/**
+    Constructor.
+    @param flosses the flosses of the scheme, the index returned by nearest
+    is a position in this list
+    */
+FlossIndex::FlossIndex(const QList<Floss *> &flosses)
+    :   m_root(-1)
+{
+    m_colors.reserve(flosses.count());
+    m_nodes.reserve(flosses.count());
+
+    QVector<int> positions;
+    positions.reserve(flosses.count());
+
+    for (int i = 0 ; i < flosses.count() ; ++i) {
+        LabColor color(flosses.at(i)->color());
+        m_colors.append(color);
+        m_L.append(color.L);
+        m_a.append(color.a);
+        m_b.append(color.b);
+        positions.append(i);
+    }
+
+    m_root = build(positions, 0, positions.count());
+}
+
+
+int FlossIndex::count() const
+{
+    return m_colors.count();
+}
+
+
+/**
+    Get the CIELAB color of a floss.
+    @param floss the position of the floss in the scheme
+    @return a const reference to the LabColor
+    */
+const LabColor &FlossIndex::color(int floss) const
+{
+    return m_colors.at(floss);
+}
+
+
+/**
+    Find the floss perceptually closest to a color.
+    @param color the sRGB color to match
+    @return the position of the floss in the scheme, -1 if the scheme is empty
+    */
+int FlossIndex::nearest(const QColor &color) const
+{
+    return nearest(LabColor(color));
+}
+
+
+int FlossIndex::nearest(const LabColor &lab) const
+{
+    Candidates candidates;
+    search(m_root, lab, candidates);
+
+    return refine(lab, candidates);
+}
+
+
+/**
+    Find the flosses perceptually closest to a sequence of colors.
+    @param colors the sRGB colors to match, the alpha channel is ignored
+    @param flosses receives the position of the floss for each color, -1 if the scheme is empty
+    @param count the number of colors
+    */
+void FlossIndex::nearest(const QRgb *colors, int *flosses, int count) const
+{
+    if (m_colors.isEmpty()) {
+        std::fill(flosses, flosses + count, -1);
+        return;
+    }
+
+    for (int i = 0 ; i < count ; i += BlockSize) {
+        int colorCount = qMin(BlockSize, count - i);
+        LabColor block[BlockSize];
+        Candidates candidates[BlockSize];
+
+        // a partial block is padded by repeating the last color
+        for (int j = 0 ; j < BlockSize ; ++j) {
+            block[j] = LabColor(QColor(colors[i + qMin(j, colorCount - 1)]));
+        }
+
+        search(block, candidates);
+
+        for (int j = 0 ; j < colorCount ; ++j) {
+            flosses[i + j] = refine(block[j], candidates[j]);
+        }
+    }
+}
+
+
+/**
+    Find the flosses perceptually closest to rows of colors, the rows are shared
+    between the threads of a thread pool.
+    @param colors the sRGB colors to match, rows are contiguous
+    @param flosses receives the position of the floss for each color
+    @param width the number of colors in a row
+    @param height the number of rows
+    @param maxThreadCount the number of threads used, if 0 the number of cores
+    */
+void FlossIndex::nearest(const QRgb *colors, int *flosses, int width, int height, int maxThreadCount) const
+{
+    QThreadPool pool;
+
+    if (maxThreadCount > 0) {
+        pool.setMaxThreadCount(maxThreadCount);
+    }
+
+    int rowsPerTask = qMax(1, height / (pool.maxThreadCount() * 4));
+
+    for (int row = 0 ; row < height ; row += rowsPerTask) {
+        int offset = row * width;
+        pool.start(new NearestRows(this, colors + offset, flosses + offset, qMin(rowsPerTask, height - row) * width));
+    }
+
+    pool.waitForDone();
+}
+
+
+/**
+    Choose the candidate with the smallest CIEDE2000 difference.
+    @return the position of the floss, -1 if there are no candidates
+    */
+int FlossIndex::refine(const LabColor &lab, const Candidates &candidates) const
+{
+    int matched = -1;
+    double closest = std::numeric_limits<double>::max();
+
+    for (int i = 0 ; i < candidates.count ; ++i) {
+        int floss = candidates.flosses[i];
+        double distance = lab.deltaE2000(m_colors.at(floss));
+
+        if (distance < closest || (distance == closest && floss < matched)) {
+            matched = floss;
+            closest = distance;
+        }
+    }
+
+    return matched;
+}
+
+
+/**
+    Build the tree for a range of positions, splitting on the median of the axis
+    with the widest spread.
+    @return the node index of the subtree root, -1 for an empty range
+    */
+int FlossIndex::build(QVector<int> &positions, int begin, int end)
+{
+    if (begin == end) {
+        return -1;
+    }
+
+    int axis = 0;
+    double widest = -1.0;
+
+    for (int i = 0 ; i < 3 ; ++i) {
+        double minimum = std::numeric_limits<double>::max();
+        double maximum = -std::numeric_limits<double>::max();
+
+        for (int j = begin ; j < end ; ++j) {
+            double value = m_colors.at(positions.at(j)).component(i);
+            minimum = qMin(minimum, value);
+            maximum = qMax(maximum, value);
+        }
+
+        if (maximum - minimum > widest) {
+            widest = maximum - minimum;
+            axis = i;
+        }
+    }
+
+    int median = begin + (end - begin) / 2;
+    std::nth_element(positions.begin() + begin, positions.begin() + median, positions.begin() + end, [=](int lhs, int rhs) {
+        return m_colors.at(lhs).component(axis) < m_colors.at(rhs).component(axis);
+    });
+
+    int node = m_nodes.count();
+    m_nodes.append(Node());
+    m_nodes[node].floss = positions.at(median);
+    m_nodes[node].axis = axis;
+
+    int left = build(positions, begin, median);
+    int right = build(positions, median + 1, end);
+    m_nodes[node].left = left;
+    m_nodes[node].right = right;
+
+    return node;
+}
+
+
+void FlossIndex::search(int node, const LabColor &lab, Candidates &candidates) const
+{
+    if (node == -1) {
+        return;
+    }
+
+    const Node &n = m_nodes.at(node);
+    const LabColor &color = m_colors.at(n.floss);
+    candidates.insert(n.floss, lab.distanceSquared(color));
+
+    double delta = lab.component(n.axis) - color.component(n.axis);
+    search((delta < 0.0) ? n.left : n.right, lab, candidates);
+
+    if (delta * delta <= candidates.worst()) {
+        search((delta < 0.0) ? n.right : n.left, lab, candidates);
+    }
+}
+
+
+/**
+    The batch kernel, find the closest candidates by euclidean distance for a block
+    of colors by comparing each color with every floss.  The floss colors are
+    broadcast and compared with all the colors of the block at once, the
+    candidates are only updated for colors where a floss is closer than the
+    current worst candidate.
+    @param colors BlockSize colors
+    @param candidates BlockSize candidate lists to be filled
+    */
+void FlossIndex::search(const LabColor *colors, Candidates *candidates) const
+{
+    float L[BlockSize];
+    float a[BlockSize];
+    float b[BlockSize];
+    float worst[BlockSize];
+    float distances[BlockSize];
+
+    for (int i = 0 ; i < BlockSize ; ++i) {
+        L[i] = colors[i].L;
+        a[i] = colors[i].a;
+        b[i] = colors[i].b;
+        worst[i] = std::numeric_limits<float>::max();
+    }
+
+    const float *flossL = m_L.constData();
+    const float *flossA = m_a.constData();
+    const float *flossB = m_b.constData();
+    int flossCount = m_L.count();
+
+#if defined(__AVX__)
+    __m256 blockL = _mm256_loadu_ps(L);
+    __m256 blockA = _mm256_loadu_ps(a);
+    __m256 blockB = _mm256_loadu_ps(b);
+    __m256 threshold = _mm256_loadu_ps(worst);
+#elif defined(__SSE__)
+    __m128 blockL[2] = { _mm_loadu_ps(L), _mm_loadu_ps(L + 4) };
+    __m128 blockA[2] = { _mm_loadu_ps(a), _mm_loadu_ps(a + 4) };
+    __m128 blockB[2] = { _mm_loadu_ps(b), _mm_loadu_ps(b + 4) };
+    __m128 threshold[2] = { _mm_loadu_ps(worst), _mm_loadu_ps(worst + 4) };
+#endif
+
+    for (int floss = 0 ; floss < flossCount ; ++floss) {
+        int mask = 0;
+
+#if defined(__AVX__)
+        __m256 dL = _mm256_sub_ps(blockL, _mm256_set1_ps(flossL[floss]));
+        __m256 dA = _mm256_sub_ps(blockA, _mm256_set1_ps(flossA[floss]));
+        __m256 dB = _mm256_sub_ps(blockB, _mm256_set1_ps(flossB[floss]));
+        __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dL, dL), _mm256_mul_ps(dA, dA)), _mm256_mul_ps(dB, dB));
+        mask = _mm256_movemask_ps(_mm256_cmp_ps(distance, threshold, _CMP_LT_OQ));
+
+        if (mask) {
+            _mm256_storeu_ps(distances, distance);
+        }
+#elif defined(__SSE__)
+        __m128 flossColorL = _mm_set1_ps(flossL[floss]);
+        __m128 flossColorA = _mm_set1_ps(flossA[floss]);
+        __m128 flossColorB = _mm_set1_ps(flossB[floss]);
+        __m128 distance[2];
+
+        for (int half = 0 ; half < 2 ; ++half) {
+            __m128 dL = _mm_sub_ps(blockL[half], flossColorL);
+            __m128 dA = _mm_sub_ps(blockA[half], flossColorA);
+            __m128 dB = _mm_sub_ps(blockB[half], flossColorB);
+            distance[half] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dL, dL), _mm_mul_ps(dA, dA)), _mm_mul_ps(dB, dB));
+            mask |= _mm_movemask_ps(_mm_cmplt_ps(distance[half], threshold[half])) << (half * 4);
+        }
+
+        if (mask) {
+            _mm_storeu_ps(distances, distance[0]);
+            _mm_storeu_ps(distances + 4, distance[1]);
+        }
+#else
+        for (int i = 0 ; i < BlockSize ; ++i) {
+            float dL = L[i] - flossL[floss];
+            float dA = a[i] - flossA[floss];
+            float dB = b[i] - flossB[floss];
+            distances[i] = dL * dL + dA * dA + dB * dB;
+
+            if (distances[i] < worst[i]) {
+                mask |= 1 << i;
+            }
+        }
+#endif
+
+        if (mask == 0) {
+            continue;
+        }
+
+        for (int i = 0 ; i < BlockSize ; ++i) {
+            if (mask & (1 << i)) {
+                candidates[i].insert(floss, distances[i]);
+
+                if (candidates[i].count == CandidateCount) {
+                    worst[i] = candidates[i].worst();
+                }
+            }
+        }
+
+#if defined(__AVX__)
+        threshold = _mm256_loadu_ps(worst);
+#elif defined(__SSE__)
+        threshold[0] = _mm_loadu_ps(worst);
+        threshold[1] = _mm_loadu_ps(worst + 4);
+#endif
+    }
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+/**
+ * @file
+ * Header file for the nearest floss search used by FlossScheme.
+ */
+
+
+#ifndef FlossIndex_H
+#define FlossIndex_H
+
+
+#include <QColor>
+#include <QList>
+#include <QVector>
+
+
+class Floss;
+
+
+/**
+ * @brief A color in the CIE L*a*b* color space.
+ *
+ * Converted from sRGB using the D65 white point.
+ */
+class LabColor
+{
+public:
+    LabColor();
+    explicit LabColor(const QColor &);
+
+    double component(int) const;
+    double distanceSquared(const LabColor &) const;
+    double deltaE2000(const LabColor &) const;
+
+    double  L;
+    double  a;
+    double  b;
+};
+
+
+/**
+ * @brief Perceptual nearest color search over the flosses of a scheme.
+ *
+ * The floss colors are held in a k-d tree in CIELAB.  A search collects
+ * the closest candidates by euclidean distance, which is cheap to prune
+ * the tree with, and returns the candidate with the smallest CIEDE2000
+ * difference.
+ *
+ * Colors can also be matched in batches, where the candidates are found
+ * by a brute force kernel over a structure of arrays copy of the floss
+ * colors.  This evaluates the distances for several colors at once using
+ * SSE or AVX when the compiler targets them, and can be spread over rows
+ * on several threads.
+ *
+ * The index refers to flosses by their position in the list it was
+ * built from and has to be rebuilt when that list or a floss color
+ * changes.
+ */
+class FlossIndex
+{
+public:
+    explicit FlossIndex(const QList<Floss *> &);
+
+    int count() const;
+    const LabColor &color(int) const;
+    int nearest(const QColor &) const;
+    int nearest(const LabColor &) const;
+    void nearest(const QRgb *, int *, int) const;
+    void nearest(const QRgb *, int *, int, int, int maxThreadCount = 0) const;
+
+private:
+    class Node
+    {
+    public:
+        int floss;
+        int axis;
+        int left;
+        int right;
+    };
+
+    class Candidates;
+
+    int build(QVector<int> &, int, int);
+    void search(int, const LabColor &, Candidates &) const;
+    void search(const LabColor *, Candidates *) const;
+    int refine(const LabColor &, const Candidates &) const;
+
+    QVector<LabColor>   m_colors;
+    QVector<Node>       m_nodes;
+    int                 m_root;
+    QVector<float>      m_L;
+    QVector<float>      m_a;
+    QVector<float>      m_b;
+};
+
+
+#endif // FlossIndex_H
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+/**
+    @file
+    Implement the FlossLookup class.
+    */
+
+
+#include "FlossLookup.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "Floss.h"
+#include "FlossIndex.h"
+
+
+const int CubeSize = 64 * 64 * 64;
+const quint32 CubeMagic = 0x4b58534c;      // KXSL
+const qint32 CubeVersion = 1;              // increment when the way the cube is built changes
+
+
+/**
+    Constructor.  The cube is read from the cache if a valid copy exists,
+    otherwise it is built from the index and saved to the cache.
+    @param flosses the flosses of the scheme
+    @param index the nearest color index built from the same flosses
+    */
+FlossLookup::FlossLookup(const QList<Floss *> &flosses, const FlossIndex *index)
+{
+    if (flosses.isEmpty()) {
+        return;
+    }
+
+    QString path = cachePath(key(flosses));
+
+    if (!path.isEmpty() && load(path, flosses.count())) {
+        return;
+    }
+
+    QVector<QRgb> colors;
+    colors.reserve(CubeSize);
+
+    for (int i = 0 ; i < CubeSize ; ++i) {
+        colors.append(cellColor(i));
+    }
+
+    // match the cell centers in rows of constant red and green
+    QVector<int> matched(CubeSize);
+    index->nearest(colors.constData(), matched.data(), 64, 64 * 64);
+
+    m_table.resize(CubeSize);
+
+    for (int i = 0 ; i < CubeSize ; ++i) {
+        m_table[i] = matched.at(i);
+    }
+
+    if (!path.isEmpty()) {
+        save(path);
+    }
+}
+
+
+QByteArray FlossLookup::key(const QList<Floss *> &flosses)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(CubeVersion));
+
+    foreach (Floss *floss, flosses) {
+        hash.addData(floss->name().toUtf8());
+        hash.addData(QByteArray::number(floss->color().rgb()));
+    }
+
+    return hash.result().toHex();
+}
+
+
+QString FlossLookup::cachePath(const QByteArray &key)
+{
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+
+    if (cacheDir.isEmpty()) {
+        return QString();
+    }
+
+    return cacheDir + QLatin1String("/lookup/") + QString::fromLatin1(key) + QLatin1String(".cube");
+}
+
+
+/**
+    Read a cached cube, checking it is complete and refers only to existing flosses.
+    @param path the path of the cache file
+    @param flossCount the number of flosses in the scheme
+    @return true if the cube was read, false otherwise
+    */
+bool FlossLookup::load(const QString &path, int flossCount)
+{
+    QFile file(path);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32 magic;
+    qint32 version;
+    QVector<quint16> table;
+
+    stream >> magic >> version;
+
+    if (stream.status() != QDataStream::Ok || magic != CubeMagic || version != CubeVersion) {
+        return false;
+    }
+
+    stream >> table;
+
+    if (stream.status() != QDataStream::Ok || table.count() != CubeSize) {
+        return false;
+    }
+
+    foreach (quint16 floss, table) {
+        if (floss >= flossCount) {
+            return false;
+        }
+    }
+
+    m_table = table;
+
+    return true;
+}
+
+
+void FlossLookup::save(const QString &path) const
+{
+    if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+        return;
+    }
+
+    QSaveFile file(path);
+
+    if (file.open(QIODevice::WriteOnly)) {
+        QDataStream stream(&file);
+        stream << CubeMagic << CubeVersion << m_table;
+
+        if (stream.status() == QDataStream::Ok) {
+            file.commit();
+        }
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+/**
+ * @file
+ * Header file for the precomputed color to floss lookup of a FlossScheme.
+ */
+
+
+#ifndef FlossLookup_H
+#define FlossLookup_H
+
+
+#include <QByteArray>
+#include <QColor>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+
+class Floss;
+class FlossIndex;
+
+
+/**
+ * @brief A cube of floss positions indexed by quantized RGB.
+ *
+ * Each channel is reduced to 6 bits giving 64x64x64 cells, each cell holds
+ * the position in the scheme of the floss nearest to the cell center as
+ * found by the FlossIndex.  Finding the floss for a color is then a single
+ * table read.
+ *
+ * Building the cube is comparatively expensive, so it is saved in the
+ * cache directory keyed by a hash of the floss colors and reused when the
+ * scheme is next loaded.
+ */
+class FlossLookup
+{
+public:
+    FlossLookup(const QList<Floss *> &, const FlossIndex *);
+
+    int nearest(QRgb) const;
+
+    static int cell(QRgb);
+    static QRgb cellColor(int);
+
+private:
+    static QByteArray key(const QList<Floss *> &);
+    static QString cachePath(const QByteArray &);
+
+    bool load(const QString &, int);
+    void save(const QString &) const;
+
+    QVector<quint16>    m_table;
+};
+
+
+/**
+    Find the floss for a color.
+    @param rgb the color, the alpha channel is ignored
+    @return the position of the floss in the scheme, -1 if the scheme is empty
+    */
+inline int FlossLookup::nearest(QRgb rgb) const
+{
+    if (m_table.isEmpty()) {
+        return -1;
+    }
+
+    return m_table.at(cell(rgb));
+}
+
+
+/**
+    Get the cell of the cube holding a color.
+    @param rgb the color, the alpha channel is ignored
+    @return the index of the cell
+    */
+inline int FlossLookup::cell(QRgb rgb)
+{
+    return ((qRed(rgb) >> 2) << 12) | ((qGreen(rgb) >> 2) << 6) | (qBlue(rgb) >> 2);
+}
+
+
+/**
+    Get the color at the center of a cell.
+    @param cell the index of the cell
+    @return the color matched for the cell
+    */
+inline QRgb FlossLookup::cellColor(int cell)
+{
+    return qRgb(((cell >> 10) & 0xfc) + 2, ((cell >> 4) & 0xfc) + 2, ((cell << 2) & 0xfc) + 2);
+}
+
+
+#endif // FlossLookup_H
@@ -0,0 +1,628 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+/**
+    @file
+    Implement the FlossQuantizer class.
+    */
+
+
+#include "FlossQuantizer.h"
+
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include <math.h>
+
+#include "Floss.h"
+#include "FlossIndex.h"
+#include "FlossLookup.h"
+
+
+const int CellCount = 64 * 64 * 64;
+const int MaximumIterations = 16;
+const int StripRows = 32;
+const int PrimingRows = 8;
+const int ErrorRows = 3;
+const int ErrorMargin = 2;
+
+
+/**
+    The share of the error of a pixel passed to a neighbour, in 16ths.
+    dx is mirrored when a row is scanned from right to left.
+    */
+struct Diffusion {
+    int dx;
+    int dy;
+    int weight;
+};
+
+
+const Diffusion FloydSteinbergDiffusion[] = {
+    {1, 0, 7}, {-1, 1, 3}, {0, 1, 5}, {1, 1, 1}, {0, 0, 0}
+};
+
+// Atkinson passes on 6/8 of the error, losing the rest
+const Diffusion AtkinsonDiffusion[] = {
+    {1, 0, 2}, {2, 0, 2}, {-1, 1, 2}, {0, 1, 2}, {1, 1, 2}, {0, 2, 2}, {0, 0, 0}
+};
+
+
+const int BayerMatrix[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21}
+};
+
+
+/**
+    Process a band of rows on a pool thread.
+    */
+class BandTask : public QRunnable
+{
+public:
+    BandTask(const std::function<void(int, int, int)> &function, int band, int begin, int end)
+        :   m_function(function),
+            m_band(band),
+            m_begin(begin),
+            m_end(end)
+    {
+    }
+
+    virtual void run() Q_DECL_OVERRIDE
+    {
+        m_function(m_band, m_begin, m_end);
+    }
+
+private:
+    std::function<void(int, int, int)>  m_function;
+    int m_band;
+    int m_begin;
+    int m_end;
+};
+
+
+static int bandRows(int rows)
+{
+    return qMax(16, rows / (QThread::idealThreadCount() * 4));
+}
+
+
+/**
+    Call a function for bands of rows, sharing the bands between the threads of a pool.
+    @param rows the number of rows
+    @param step the number of rows in each band
+    @param maxThreadCount the number of threads used
+    @param function called with the band number and the first and last + 1 rows of the band
+    */
+static void forEachBand(int rows, int step, int maxThreadCount, const std::function<void(int, int, int)> &function)
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(maxThreadCount);
+
+    for (int row = 0, band = 0 ; row < rows ; row += step, ++band) {
+        pool.start(new BandTask(function, band, row, qMin(rows, row + step)));
+    }
+
+    pool.waitForDone();
+}
+
+
+static void forEachBand(int rows, int maxThreadCount, const std::function<void(int, int, int)> &function)
+{
+    forEachBand(rows, bandRows(rows), maxThreadCount, function);
+}
+
+
+/**
+    Match cells of the lookup cube to a set of flosses.
+    @param index the index of the flosses
+    @param flosses the flosses
+    @param cells the cells to be matched
+    @param maxThreadCount the number of threads used
+    @return a QVector of floss colors indexed by cell, cells not matched are 0
+    */
+static QVector<QRgb> matchCells(const FlossIndex &index, const QList<Floss *> &flosses, const QVector<int> &cells, int maxThreadCount)
+{
+    // match the cells in rows of 64, padding the last row with its last cell
+    int rows = (cells.count() + 63) / 64;
+    QVector<QRgb> cellColors(rows * 64);
+
+    for (int i = 0 ; i < cellColors.count() ; ++i) {
+        cellColors[i] = FlossLookup::cellColor(cells.at(qMin(i, cells.count() - 1)));
+    }
+
+    QVector<int> matched(cellColors.count());
+    index.nearest(cellColors.constData(), matched.data(), 64, rows, maxThreadCount);
+
+    QVector<QRgb> cellFlossColors(CellCount, 0);
+
+    for (int i = 0 ; i < cells.count() ; ++i) {
+        cellFlossColors[cells.at(i)] = flosses.at(matched.at(i))->color().rgb();
+    }
+
+    return cellFlossColors;
+}
+
+
+/**
+    Divide an accumulated error in 16ths, rounding to the nearest.
+    */
+static inline int sixteenths(int error)
+{
+    return (error >= 0) ? (error + 8) / 16 : -((8 - error) / 16);
+}
+
+
+/**
+    Map the pixels to the floss colors of their cells.
+    */
+static void mapPixels(QImage &image, const QVector<QRgb> &cellColors, const QAtomicInt *canceled, int maxThreadCount)
+{
+    // detach once here rather than from the threads
+    uchar *bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+
+    forEachBand(image.height(), maxThreadCount, [&](int, int begin, int end) {
+        for (int dy = begin ; dy < end ; ++dy) {
+            if (canceled && canceled->load()) {
+                return;
+            }
+
+            uchar *rgba = bits + dy * bytesPerLine;
+
+            for (int dx = 0 ; dx < image.width() ; ++dx, rgba += 4) {
+                if (rgba[3] != 0) {
+                    QRgb rgb = cellColors.at(FlossLookup::cell(qRgb(rgba[0], rgba[1], rgba[2])));
+                    rgba[0] = qRed(rgb);
+                    rgba[1] = qGreen(rgb);
+                    rgba[2] = qBlue(rgb);
+                }
+            }
+        }
+    });
+}
+
+
+/**
+    Map the pixels to the floss colors diffusing the error of each pixel to its
+    neighbours.  The image is processed in strips of StripRows in parallel, each
+    strip first diffusing the PrimingRows above it without writing them, so the
+    error arriving at the first row of the strip is close to that of a single
+    pass.  The strips are a fixed size so the result does not depend on the
+    number of threads.
+    @param image the image to be mapped
+    @param cellColors the floss colors indexed by cell, every cell must be matched
+    @param diffusion the distribution of the error, terminated by a 0 weight
+    @param serpentine true to scan alternate rows from right to left
+    @param canceled if not null, the mapping is abandoned when this becomes non zero
+    @param maxThreadCount the number of threads used
+    */
+static void diffuse(QImage &image, const QVector<QRgb> &cellColors, const Diffusion *diffusion, bool serpentine, const QAtomicInt *canceled, int maxThreadCount)
+{
+    // the strips read rows written by the strip above
+    const QImage source = image.copy();
+    uchar *bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+    int width = image.width();
+    int rowLength = (width + 2 * ErrorMargin) * 3;
+
+    forEachBand(image.height(), StripRows, maxThreadCount, [&](int, int begin, int end) {
+        // the accumulated errors of the current row and the two below it
+        QVector<int> errors(ErrorRows * rowLength, 0);
+
+        for (int dy = qMax(0, begin - PrimingRows) ; dy < end ; ++dy) {
+            if (canceled && canceled->load()) {
+                return;
+            }
+
+            int *current = errors.data() + (dy % ErrorRows) * rowLength;
+            const uchar *rgba = source.constScanLine(dy);
+            uchar *target = (dy >= begin) ? bits + dy * bytesPerLine : nullptr;
+            int step = (serpentine && (dy & 1)) ? -1 : 1;
+
+            for (int i = 0, dx = (step < 0) ? width - 1 : 0 ; i < width ; ++i, dx += step) {
+                const uchar *pixel = rgba + dx * 4;
+
+                if (pixel[3] == 0) {
+                    continue;
+                }
+
+                const int *error = current + (dx + ErrorMargin) * 3;
+                int red = qBound(0, pixel[0] + sixteenths(error[0]), 255);
+                int green = qBound(0, pixel[1] + sixteenths(error[1]), 255);
+                int blue = qBound(0, pixel[2] + sixteenths(error[2]), 255);
+                QRgb rgb = cellColors.at(FlossLookup::cell(qRgb(red, green, blue)));
+
+                red -= qRed(rgb);
+                green -= qGreen(rgb);
+                blue -= qBlue(rgb);
+
+                for (const Diffusion *d = diffusion ; d->weight ; ++d) {
+                    int *neighbour = errors.data() + ((dy + d->dy) % ErrorRows) * rowLength + (dx + d->dx * step + ErrorMargin) * 3;
+                    neighbour[0] += red * d->weight;
+                    neighbour[1] += green * d->weight;
+                    neighbour[2] += blue * d->weight;
+                }
+
+                if (target) {
+                    target[dx * 4] = qRed(rgb);
+                    target[dx * 4 + 1] = qGreen(rgb);
+                    target[dx * 4 + 2] = qBlue(rgb);
+                }
+            }
+
+            // clear the row for reuse as the row two below
+            std::fill(current, current + rowLength, 0);
+        }
+    });
+}
+
+
+/**
+    Get the strength of ordered dithering for a set of flosses, being the mean
+    distance in RGB from each floss to its closest neighbour.
+    */
+static int orderedSpread(const QList<Floss *> &flosses)
+{
+    if (flosses.count() < 2) {
+        return 0;
+    }
+
+    double total = 0.0;
+
+    for (int i = 0 ; i < flosses.count() ; ++i) {
+        QColor color = flosses.at(i)->color();
+        int closest = std::numeric_limits<int>::max();
+
+        for (int j = 0 ; j < flosses.count() ; ++j) {
+            if (j != i) {
+                QColor other = flosses.at(j)->color();
+                int red = color.red() - other.red();
+                int green = color.green() - other.green();
+                int blue = color.blue() - other.blue();
+                closest = qMin(closest, red * red + green * green + blue * blue);
+            }
+        }
+
+        total += sqrt(static_cast<double>(closest));
+    }
+
+    return qBound(8, qRound(total / flosses.count()), 64);
+}
+
+
+/**
+    Map the pixels to the floss colors offsetting each pixel by a Bayer matrix
+    threshold.  The pixels are independent, so the bands are simply shared
+    between the threads.
+    @param image the image to be mapped
+    @param cellColors the floss colors indexed by cell, every cell must be matched
+    @param spread the range of the offsets
+    @param canceled if not null, the mapping is abandoned when this becomes non zero
+    @param maxThreadCount the number of threads used
+    */
+static void orderedDither(QImage &image, const QVector<QRgb> &cellColors, int spread, const QAtomicInt *canceled, int maxThreadCount)
+{
+    uchar *bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+
+    forEachBand(image.height(), maxThreadCount, [&](int, int begin, int end) {
+        for (int dy = begin ; dy < end ; ++dy) {
+            if (canceled && canceled->load()) {
+                return;
+            }
+
+            uchar *rgba = bits + dy * bytesPerLine;
+
+            for (int dx = 0 ; dx < image.width() ; ++dx, rgba += 4) {
+                if (rgba[3] != 0) {
+                    int offset = ((BayerMatrix[dy & 7][dx & 7] * 2 - 63) * spread) / 128;
+                    QRgb rgb = cellColors.at(FlossLookup::cell(qRgb(qBound(0, rgba[0] + offset, 255), qBound(0, rgba[1] + offset, 255), qBound(0, rgba[2] + offset, 255))));
+                    rgba[0] = qRed(rgb);
+                    rgba[1] = qGreen(rgb);
+                    rgba[2] = qBlue(rgb);
+                }
+            }
+        }
+    });
+}
+
+
+/**
+    Constructor.
+    @param flosses the flosses of the scheme
+    @param index the nearest color index of the scheme
+    @param lookup the color lookup of the scheme
+    */
+FlossQuantizer::FlossQuantizer(const QList<Floss *> &flosses, const FlossIndex *index, const FlossLookup *lookup)
+    :   m_flosses(flosses),
+        m_index(index),
+        m_lookup(lookup),
+        m_maxThreadCount(QThread::idealThreadCount())
+{
+}
+
+
+/**
+    Set the number of threads each step of the quantization is shared between,
+    by default the number of cores.
+    @param maxThreadCount the number of threads
+    */
+void FlossQuantizer::setMaxThreadCount(int maxThreadCount)
+{
+    m_maxThreadCount = qMax(1, maxThreadCount);
+}
+
+
+/**
+    Reduce an image to a number of flosses.
+    @param image a QImage in QImage::Format_RGBA8888, the colors of the pixels are replaced
+    with the floss colors, pixels with an alpha of 0 are left unchanged
+    @param colors the maximum number of flosses to use
+    @param dithering the dithering applied when mapping the pixels to the selected flosses
+    @param canceled if not null, the quantization is abandoned when this becomes non zero
+    @return the positions in the scheme of the selected flosses, empty if the image was not
+    changed
+    */
+QVector<int> FlossQuantizer::quantize(QImage &image, int colors, Dithering dithering, const QAtomicInt *canceled) const
+{
+    if (m_flosses.isEmpty() || colors <= 0) {
+        return QVector<int>();
+    }
+
+    QVector<qint64> counts = histogram(image);
+
+    if (canceled && canceled->load()) {
+        return QVector<int>();
+    }
+
+    QVector<int> selected = select(counts, colors);
+
+    if (canceled && canceled->load()) {
+        return QVector<int>();
+    }
+
+    remap(image, selected, dithering, canceled);
+
+    return selected;
+}
+
+
+/**
+    Count the pixels nearest to each floss of the scheme.
+    @return a QVector of counts indexed by the floss position
+    */
+QVector<qint64> FlossQuantizer::histogram(const QImage &image) const
+{
+    int step = bandRows(image.height());
+    QVector<QVector<qint64> > bandCounts((image.height() + step - 1) / step);
+
+    forEachBand(image.height(), m_maxThreadCount, [&](int band, int begin, int end) {
+        QVector<qint64> counts(m_flosses.count(), 0);
+
+        for (int dy = begin ; dy < end ; ++dy) {
+            const uchar *rgba = image.constScanLine(dy);
+
+            for (int dx = 0 ; dx < image.width() ; ++dx, rgba += 4) {
+                if (rgba[3] != 0) {
+                    counts[m_lookup->nearest(qRgb(rgba[0], rgba[1], rgba[2]))]++;
+                }
+            }
+        }
+
+        bandCounts[band] = counts;
+    });
+
+    QVector<qint64> counts(m_flosses.count(), 0);
+
+    foreach (const QVector<qint64> &band, bandCounts) {
+        for (int i = 0 ; i < band.count() ; ++i) {
+            counts[i] += band.at(i);
+        }
+    }
+
+    return counts;
+}
+
+
+/**
+    Select the flosses to be used.
+    @param counts the number of pixels nearest to each floss
+    @param colors the maximum number of flosses
+    @return the positions of the selected flosses
+    */
+QVector<int> FlossQuantizer::select(const QVector<qint64> &counts, int colors) const
+{
+    QVector<int> used;
+
+    for (int i = 0 ; i < counts.count() ; ++i) {
+        if (counts.at(i)) {
+            used.append(i);
+        }
+    }
+
+    if (used.count() <= colors) {
+        return used;
+    }
+
+    // seed the clusters with the most used floss, then repeatedly with the floss
+    // having the largest use weighted squared distance to the seeds chosen so far
+    QVector<int> selected;
+    QVector<double> distances(used.count(), std::numeric_limits<double>::max());
+    int seed = 0;
+
+    for (int i = 1 ; i < used.count() ; ++i) {
+        if (counts.at(used.at(i)) > counts.at(used.at(seed))) {
+            seed = i;
+        }
+    }
+
+    while (selected.count() < colors) {
+        selected.append(used.at(seed));
+        const LabColor &seedColor = m_index->color(used.at(seed));
+        double farthest = -1.0;
+
+        for (int i = 0 ; i < used.count() ; ++i) {
+            distances[i] = qMin(distances.at(i), seedColor.distanceSquared(m_index->color(used.at(i))));
+            double weighted = distances.at(i) * counts.at(used.at(i));
+
+            if (weighted > farthest) {
+                farthest = weighted;
+                seed = i;
+            }
+        }
+    }
+
+    // k-means, with the cluster centers moved to the nearest floss of the scheme
+    for (int iteration = 0 ; iteration < MaximumIterations ; ++iteration) {
+        QVector<LabColor> sums(selected.count());
+        QVector<double> weights(selected.count(), 0.0);
+
+        foreach (int floss, used) {
+            const LabColor &color = m_index->color(floss);
+            int cluster = 0;
+            double closest = std::numeric_limits<double>::max();
+
+            for (int i = 0 ; i < selected.count() ; ++i) {
+                double distance = color.distanceSquared(m_index->color(selected.at(i)));
+
+                if (distance < closest) {
+                    closest = distance;
+                    cluster = i;
+                }
+            }
+
+            double weight = counts.at(floss);
+            sums[cluster].L += color.L * weight;
+            sums[cluster].a += color.a * weight;
+            sums[cluster].b += color.b * weight;
+            weights[cluster] += weight;
+        }
+
+        QVector<int> centers;
+
+        for (int i = 0 ; i < selected.count() ; ++i) {
+            int center = selected.at(i);
+
+            if (weights.at(i) > 0.0) {
+                LabColor mean;
+                mean.L = sums.at(i).L / weights.at(i);
+                mean.a = sums.at(i).a / weights.at(i);
+                mean.b = sums.at(i).b / weights.at(i);
+                center = m_index->nearest(mean);
+            }
+
+            // clusters moving to the same floss are merged
+            if (!centers.contains(center)) {
+                centers.append(center);
+            }
+        }
+
+        if (centers == selected) {
+            break;
+        }
+
+        selected = centers;
+    }
+
+    return selected;
+}
+
+
+/**
+    Map every pixel to the nearest selected floss.  Without dithering only the
+    cells of the lookup cube used by the image are matched against the selected
+    flosses.  Dithering moves the colors so any cell may be needed, rather than
+    matching the whole cube each scheme floss is matched once to its nearest
+    selected floss, and each cell takes the selected floss of the scheme floss
+    the lookup gives for it, as the flosses were selected from those.  The
+    pixels are then mapped through the matched cells.
+    */
+void FlossQuantizer::remap(QImage &image, const QVector<int> &selected, Dithering dithering, const QAtomicInt *canceled) const
+{
+    QList<Floss *> flosses;
+
+    foreach (int floss, selected) {
+        flosses.append(m_flosses.at(floss));
+    }
+
+    FlossIndex index(flosses);
+    QVector<int> cells;
+    QVector<QRgb> cellColors;
+
+    if (dithering == Undithered) {
+        QVector<quint8> used(CellCount, 0);
+
+        for (int dy = 0 ; dy < image.height() ; ++dy) {
+            const uchar *rgba = image.constScanLine(dy);
+
+            for (int dx = 0 ; dx < image.width() ; ++dx, rgba += 4) {
+                if (rgba[3] != 0) {
+                    used[FlossLookup::cell(qRgb(rgba[0], rgba[1], rgba[2]))] = 1;
+                }
+            }
+        }
+
+        for (int i = 0 ; i < CellCount ; ++i) {
+            if (used.at(i)) {
+                cells.append(i);
+            }
+        }
+
+        if (cells.isEmpty()) {
+            return;
+        }
+
+        cellColors = matchCells(index, flosses, cells, m_maxThreadCount);
+    } else {
+        // the selected floss color for each floss of the scheme
+        QVector<QRgb> flossColors(m_flosses.count());
+
+        for (int i = 0 ; i < m_flosses.count() ; ++i) {
+            flossColors[i] = flosses.at(index.nearest(m_index->color(i)))->color().rgb();
+        }
+
+        cellColors.resize(CellCount);
+
+        for (int i = 0 ; i < CellCount ; ++i) {
+            cellColors[i] = flossColors.at(m_lookup->nearest(FlossLookup::cellColor(i)));
+        }
+    }
+
+    switch (dithering) {
+    case FloydSteinberg:
+        diffuse(image, cellColors, FloydSteinbergDiffusion, true, canceled, m_maxThreadCount);
+        break;
+
+    case Atkinson:
+        diffuse(image, cellColors, AtkinsonDiffusion, false, canceled, m_maxThreadCount);
+        break;
+
+    case Ordered:
+        orderedDither(image, cellColors, orderedSpread(flosses), canceled, m_maxThreadCount);
+        break;
+
+    default:
+        mapPixels(image, cellColors, canceled, m_maxThreadCount);
+        break;
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+/**
+ * @file
+ * Header file for the quantizer reducing an image to a limited set of flosses.
+ */
+
+
+#ifndef FlossQuantizer_H
+#define FlossQuantizer_H
+
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QList>
+#include <QVector>
+
+
+class Floss;
+class FlossIndex;
+class FlossLookup;
+
+
+/**
+ * @brief Reduce an image to the best set of flosses of a scheme.
+ *
+ * Every pixel is first matched to its nearest floss through the scheme
+ * lookup and the use of each floss is counted.  When more flosses are used
+ * than allowed, the used flosses are clustered with a k-means in CIELAB
+ * weighted by their use, each cluster center being moved to the nearest
+ * floss of the scheme so the clusters are always real flosses.  Finally
+ * every pixel is mapped to the nearest of the selected flosses, optionally
+ * dithered.
+ *
+ * Floyd-Steinberg and Atkinson error diffusion are applied to strips of rows
+ * in parallel, each strip first diffusing the rows above it without writing
+ * them so the error carries over the join.  Ordered dithering uses an 8x8
+ * Bayer matrix scaled to the spacing of the selected flosses.
+ *
+ * Counting and mapping are shared between threads in bands of rows.  The
+ * index and lookup are only read, so they must have been created before
+ * the quantizer is used on a worker thread.
+ */
+class FlossQuantizer
+{
+public:
+    enum Dithering {Undithered, FloydSteinberg, Atkinson, Ordered};
+
+    FlossQuantizer(const QList<Floss *> &, const FlossIndex *, const FlossLookup *);
+
+    void setMaxThreadCount(int);
+    QVector<int> quantize(QImage &, int, Dithering = Undithered, const QAtomicInt *canceled = nullptr) const;
+
+private:
+    QVector<qint64> histogram(const QImage &) const;
+    QVector<int> select(const QVector<qint64> &, int) const;
+    void remap(QImage &, const QVector<int> &, Dithering, const QAtomicInt *) const;
+
+    QList<Floss *>      m_flosses;
+    const FlossIndex    *m_index;
+    const FlossLookup   *m_lookup;
+    int                 m_maxThreadCount;
+};
+
+
+#endif // FlossQuantizer_H
@@ -11,37 +11,32 @@
 
 #include "FlossScheme.h"
 
+#include "FlossIndex.h"
+#include "FlossLookup.h"
+
 
 FlossScheme::FlossScheme()
-    :   m_map(nullptr)
+    :   m_index(nullptr),
+        m_lookup(nullptr)
 {
 }
 
 
 FlossScheme::~FlossScheme()
 {
-    delete m_map;
+    delete m_index;
+    delete m_lookup;
 }
 
 
+/**
+    Convert a color to the perceptually closest floss in the scheme.
+    @param color the color to convert
+    @return pointer to the closest Floss, null if the scheme is empty
+    */
 Floss *FlossScheme::convert(const QColor &color)
 {
-    createImageMap();
-
-    char c[3];
-    c[0] = (char)color.red();
-    c[1] = (char)color.green();
-    c[2] = (char)color.blue();
-#if MagickLibVersion >= 0x642
-    Magick::Image image = Magick::Image(1, 1, "RGB", MagickCore::CharPixel, c);
-#else
-    Magick::Image image = Magick::Image(1, 1, "RGB", MagickLib::CharPixel, c);
-#endif
-    image.map(*m_map);
-
-    const Magick::ColorRGB rgb = image.pixelColor(0,0);
-
-    return find(QColor((int)(255*rgb.red()), (int)(255*rgb.green()), (int)(255*rgb.blue())));
+    return find(color);
 }
 
 
@@ -61,27 +56,16 @@ Floss *FlossScheme::find(const QString &name) const
 }
 
 
+/**
+    Find the floss closest to a color, using the CIEDE2000 color difference.
+    @param color the color to find
+    @return pointer to the closest Floss, null if the scheme is empty
+    */
 Floss *FlossScheme::find(const QColor &color) const
 {
-    QListIterator<Floss *> flossIterator(m_flosses);
-
-    Floss *matched = nullptr;
-    int closest = 100;
-
-    while (flossIterator.hasNext()) {
-        Floss *floss = flossIterator.next();
-        QColor c = floss->color();
+    int index = createIndex()->nearest(color);
 
-        // the color mapping may not be perfect so search for a near match.
-        int distance = abs(color.red()-c.red()) + abs(color.green()-c.green()) + abs(color.blue()-c.blue());
-
-        if (distance < closest) {
-            matched = floss;
-            closest = distance;
-        }
-    }
-
-    return matched;
+    return (index == -1) ? nullptr : m_flosses.at(index);
 }
 
 
@@ -106,8 +90,7 @@ const QList<Floss *> &FlossScheme::flosses() const
 void FlossScheme::addFloss(Floss *floss)
 {
     m_flosses.append(floss);
-    delete m_map;
-    m_map = nullptr;
+    flossesChanged();
 }
 
 
@@ -115,51 +98,60 @@ void FlossScheme::clearScheme()
 {
     qDeleteAll(m_flosses);
     m_flosses.clear();
+    flossesChanged();
+}
+
 
-    delete m_map;
-    m_map = nullptr;
+/**
+    Discard the color index and lookup, to be called when the flosses or
+    their colors have been changed.  They will be recreated when next required.
+    */
+void FlossScheme::flossesChanged()
+{
+    delete m_index;
+    m_index = nullptr;
+
+    delete m_lookup;
+    m_lookup = nullptr;
 }
 
 
-void FlossScheme::setSchemeName(const QString &name)
+/**
+    Get the nearest color index for the scheme, creating it if required.
+    @return pointer to the FlossIndex
+    */
+const FlossIndex *FlossScheme::createIndex() const
 {
-    m_schemeName = name;
+    if (m_index == nullptr) {
+        m_index = new FlossIndex(m_flosses);
+    }
+
+    return m_index;
 }
 
 
-void FlossScheme::setPath(const QString &name)
+/**
+    Get the color lookup cube for the scheme, creating it if required.  This
+    may take a while if the cube is not in the cache.
+    @return pointer to the FlossLookup
+    */
+const FlossLookup *FlossScheme::createLookup() const
 {
-    m_path = name;
+    if (m_lookup == nullptr) {
+        m_lookup = new FlossLookup(m_flosses, createIndex());
+    }
+
+    return m_lookup;
 }
 
 
-Magick::Image *FlossScheme::createImageMap()
+void FlossScheme::setSchemeName(const QString &name)
 {
-    if (m_map == nullptr) {
-        char *pixels = new char[(m_flosses.size() + 1) * 4];
-        char *pixel = pixels;
-        QListIterator<Floss *> flossIterator(m_flosses);
-
-        while (flossIterator.hasNext()) {
-            Floss *floss = flossIterator.next();
-            *pixel++ = (char)(floss->color().red());
-            *pixel++ = (char)(floss->color().green());
-            *pixel++ = (char)(floss->color().blue());
-            *pixel++ = (char)(0xff);
-        }
+    m_schemeName = name;
+}
 
-        // transparent pixel
-        *pixel++ = (char)0xff;
-        *pixel++ = (char)0xff;
-        *pixel++ = (char)0xff;
-        *pixel++ = (char)0;
-#if MagickLibVersion >= 0x642
-        m_map = new Magick::Image(m_flosses.size() + 1, 1, "RGBA", MagickCore::CharPixel, pixels);
-#else
-        m_map = new Magick::Image(m_flosses.size() + 1, 1, "RGBA", MagickLib::CharPixel, pixels);
-#endif
-        delete[] pixels;
-    }
 
-    return m_map;
+void FlossScheme::setPath(const QString &name)
+{
+    m_path = name;
 }
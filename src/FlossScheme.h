@@ -18,15 +18,13 @@
 #include <QListIterator>
 #include <QString>
 
-// wrap include to silence unused-parameter warning from Magick++ include file
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-#include <Magick++.h>
-#pragma GCC diagnostic pop
-
 #include "Floss.h"
 
 
+class FlossIndex;
+class FlossLookup;
+
+
 class FlossScheme
 {
 public:
@@ -42,7 +40,9 @@ public:
 
     void addFloss(Floss *floss);
     void clearScheme();
-    Magick::Image *createImageMap();
+    void flossesChanged();
+    const FlossIndex *createIndex() const;
+    const FlossLookup *createLookup() const;
     void setSchemeName(const QString &name);
     void setPath(const QString &name);
 
@@ -50,7 +50,8 @@ private:
     QString     m_schemeName;
     QString     m_path;
     QList<Floss *>  m_flosses;
-    Magick::Image   *m_map;
+    mutable FlossIndex  *m_index;
+    mutable FlossLookup *m_lookup;
 };
 
 #endif // FlossScheme_H
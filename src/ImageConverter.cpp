@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include "ImageConverter.h"
+
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+
+#include "FlossScheme.h"
+#include "Stitch.h"
+#include "StitchData.h"
+
+
+const int BandPixels = 65536;
+
+
+int ImageConverter::maxThreadCount = QThread::idealThreadCount();
+
+
+/**
+    Constructor.
+    @param image the image mapped to floss colors, the image is shared not copied
+    @param useFractionals true if each pixel is a quarter stitch, false for full stitches
+    @param ignoreColor true if pixels of ignoreRgb are not converted
+    @param ignoreRgb the color being ignored
+    */
+ImageConverter::ImageConverter(const Magick::Image &image, bool useFractionals, bool ignoreColor, QRgb ignoreRgb)
+    :   m_image(image),
+        m_useFractionals(useFractionals),
+        m_ignoreColor(ignoreColor),
+        m_ignoreRgb(ignoreRgb)
+{
+    int width = qMax(1, static_cast<int>(m_image.columns()));
+
+    // keep the bands an even number of rows so fractionals do not straddle bands
+    m_bandRows = qMax(2, (BandPixels / width) & ~1);
+    m_pool.setMaxThreadCount(maxThreadCount);
+}
+
+
+/**
+    Set the number of threads used by each converter and reduce, by default the
+    number of cores.  Converters already constructed are not changed.
+    @param threads the number of threads
+    */
+void ImageConverter::setMaxThreadCount(int threads)
+{
+    maxThreadCount = qMax(1, threads);
+}
+
+
+/**
+    Crop, scale and reduce an image to flosses of a scheme ready to be converted.
+    @param image the image, replaced by the reduced image
+    @param crop the area of the image to use, ignored if not valid
+    @param size the size of the reduced image in pixels
+    @param colors the maximum number of flosses
+    @param dithering the dithering used when mapping to the flosses
+    @param scheme the scheme, its index and lookup must have been created if this
+    is called from a worker thread
+    @param canceled if not null, the reduction is abandoned when this becomes non zero
+    @param sampled if set, called with the scaled pixels before they are reduced so
+    they can be shown while the flosses are selected
+    @return a QImage in QImage::Format_RGBA8888 of the reduced image, alpha 0 is transparent,
+    a null QImage if the image could not be reduced or the reduction was canceled
+    */
+QImage ImageConverter::reduce(Magick::Image &image, const QRect &crop, const QSize &size, int colors, FlossQuantizer::Dithering dithering, const FlossScheme *scheme, const QAtomicInt *canceled, const std::function<void(const QImage &)> &sampled)
+{
+    int width = size.width();
+    int height = size.height();
+
+    if (width <= 0 || height <= 0) {
+        return QImage();
+    }
+
+    QImage mappedImage(width, height, QImage::Format_RGBA8888);
+
+    try {
+        if (crop.isValid()) {
+            image.chop(Magick::Geometry(crop.left(), crop.top()));
+            image.crop(Magick::Geometry(crop.width(), crop.height()));
+        }
+
+        Magick::Geometry geometry(width, height);
+        geometry.percent(false);
+        geometry.aspect(true);      // set to true to ignore maintaining the aspect ratio
+        image.sample(geometry);
+
+        if (canceled && canceled->load()) {
+            return QImage();
+        }
+
+#if MagickLibVersion >= 0x642
+        image.write(0, 0, width, height, "RGBA", MagickCore::CharPixel, mappedImage.bits());
+#else
+        image.write(0, 0, width, height, "RGBA", MagickLib::CharPixel, mappedImage.bits());
+#endif
+
+        if (sampled) {
+            sampled(mappedImage);
+        }
+
+        FlossQuantizer quantizer(scheme->flosses(), scheme->createIndex(), scheme->createLookup());
+        quantizer.setMaxThreadCount(maxThreadCount);
+        quantizer.quantize(mappedImage, colors, dithering, canceled);
+
+        if (canceled && canceled->load()) {
+            return QImage();
+        }
+
+#if MagickLibVersion >= 0x642
+        image.read(width, height, "RGBA", MagickCore::CharPixel, mappedImage.constBits());
+#else
+        image.read(width, height, "RGBA", MagickLib::CharPixel, mappedImage.constBits());
+#endif
+    } catch (const Magick::Exception &) {
+        return QImage();
+    }
+
+    return mappedImage;
+}
+
+
+/**
+    Get the size of the pattern created.
+    @return a QSize in stitches
+    */
+QSize ImageConverter::patternSize() const
+{
+    int width = m_image.columns();
+    int height = m_image.rows();
+
+    return (m_useFractionals) ? QSize(width / 2, height / 2) : QSize(width, height);
+}
+
+
+int ImageConverter::bands() const
+{
+    return (static_cast<int>(m_image.rows()) + m_bandRows - 1) / m_bandRows;
+}
+
+
+/**
+    Create the stitches for a cell from the colors of its four zones.  The zones
+    of each color are combined into a single stitch where there is a stitch type
+    for them, so a uniform cell is a full stitch, a diagonal pair a half stitch
+    and three zones a three quarter stitch.  Pairs along a side of the cell have
+    no stitch type and remain two quarter stitches.
+    @param zones the color indexes of the top left, top right, bottom left and
+    bottom right zones, -1 for an empty zone
+    @return a new StitchQueue, null if all the zones are empty
+    */
+static StitchQueue *classifyCell(const int *zones)
+{
+    StitchQueue *stitchQueue = nullptr;
+    int classified = 0;
+
+    for (int zone = 0 ; zone < 4 ; ++zone) {
+        int colorIndex = zones[zone];
+
+        if (colorIndex == -1 || (classified & (1 << zone))) {
+            continue;
+        }
+
+        // the zone bits match the quarter stitch types, TLQtr, TRQtr, BLQtr and BRQtr
+        int mask = 0;
+
+        for (int other = zone ; other < 4 ; ++other) {
+            if (zones[other] == colorIndex) {
+                mask |= 1 << other;
+            }
+        }
+
+        classified |= mask;
+
+        if (stitchQueue == nullptr) {
+            stitchQueue = new StitchQueue;
+        }
+
+        switch (mask) {
+        case Stitch::TLQtr | Stitch::TRQtr:
+        case Stitch::TLQtr | Stitch::BLQtr:
+        case Stitch::TRQtr | Stitch::BRQtr:
+        case Stitch::BLQtr | Stitch::BRQtr:
+            for (int bit = 1 ; bit < 16 ; bit <<= 1) {
+                if (mask & bit) {
+                    stitchQueue->enqueue(new Stitch(static_cast<Stitch::Type>(bit), colorIndex));
+                }
+            }
+
+            break;
+
+        default:
+            stitchQueue->enqueue(new Stitch(static_cast<Stitch::Type>(mask), colorIndex));
+            break;
+        }
+    }
+
+    return stitchQueue;
+}
+
+
+/**
+    Classify the cells of a range of cell rows on a pool thread.
+    */
+class ClassifyRows : public QRunnable
+{
+public:
+    ClassifyRows(const QVector<int> &indexes, int stride, bool useFractionals, const QVector<StitchQueue **> &rows, int begin, int end, int width)
+        :   m_indexes(indexes),
+            m_stride(stride),
+            m_useFractionals(useFractionals),
+            m_rows(rows),
+            m_begin(begin),
+            m_end(end),
+            m_width(width)
+    {
+    }
+
+    virtual void run() Q_DECL_OVERRIDE
+    {
+        int zones[4];
+
+        for (int row = m_begin ; row < m_end ; ++row) {
+            StitchQueue **cells = m_rows.at(row);
+
+            if (m_useFractionals) {
+                const int *top = m_indexes.constData() + 2 * row * m_stride;
+                const int *bottom = top + m_stride;
+
+                for (int x = 0 ; x < m_width ; ++x) {
+                    zones[0] = top[2 * x];
+                    zones[1] = top[2 * x + 1];
+                    zones[2] = bottom[2 * x];
+                    zones[3] = bottom[2 * x + 1];
+                    replace(cells + x, classifyCell(zones));
+                }
+            } else {
+                const int *pixels = m_indexes.constData() + row * m_stride;
+
+                for (int x = 0 ; x < m_width ; ++x) {
+                    zones[0] = zones[1] = zones[2] = zones[3] = pixels[x];
+                    replace(cells + x, classifyCell(zones));
+                }
+            }
+        }
+    }
+
+private:
+    static void replace(StitchQueue **cell, StitchQueue *stitchQueue)
+    {
+        if (stitchQueue) {
+            delete *cell;
+            *cell = stitchQueue;
+        }
+    }
+
+    const QVector<int>              &m_indexes;
+    int                             m_stride;
+    bool                            m_useFractionals;
+    const QVector<StitchQueue **>   &m_rows;
+    int                             m_begin;
+    int                             m_end;
+    int                             m_width;
+};
+
+
+/**
+    Convert a band of rows.  The pixels are first numbered by color, then the
+    cells of the band are classified in parallel, each 2x2 block of pixels being
+    one cell when using fractionals.  The bands may be converted in any order,
+    but the numbering of the colors follows the order the bands are converted in.
+    @param band the band to convert
+    @param stitchData the StitchData to add the stitches to, it must have been
+    resized to the patternSize, any cells of the band having stitches are replaced
+    @return true if the band was converted, false if the image could not be read
+    */
+bool ImageConverter::convertBand(int band, StitchData &stitchData)
+{
+    int width = m_image.columns();
+    int top = band * m_bandRows;
+    int rows = qMin(m_bandRows, static_cast<int>(m_image.rows()) - top);
+
+    if (rows <= 0) {
+        return false;
+    }
+
+    if (m_band.isNull()) {
+        m_band = QImage(width, m_bandRows, QImage::Format_RGBA8888);
+    }
+
+    // the alpha byte is 0 for fully transparent pixels on both V6 and V7,
+    // images without an alpha channel are exported as opaque
+    try {
+#if MagickLibVersion >= 0x642
+        m_image.write(0, top, width, rows, "RGBA", MagickCore::CharPixel, m_band.bits());
+#else
+        m_image.write(0, top, width, rows, "RGBA", MagickLib::CharPixel, m_band.bits());
+#endif
+    } catch (const Magick::Exception &) {
+        return false;
+    }
+
+    // number the pixels by color in order, -1 for pixels not converted
+    QVector<int> indexes(width * rows);
+    int *index = indexes.data();
+    QRgb lastRgb = 0;
+    int lastIndex = -1;
+
+    for (int row = 0 ; row < rows ; ++row) {
+        const uchar *rgba = m_band.constScanLine(row);
+
+        for (int dx = 0 ; dx < width ; ++dx, rgba += 4) {
+            QRgb rgb = qRgb(rgba[0], rgba[1], rgba[2]);
+            int colorIndex = -1;
+
+            if (rgba[3] == 0 || (m_ignoreColor && rgb == m_ignoreRgb)) {
+                // transparent or ignored
+            } else if (rgb == lastRgb && lastIndex != -1) {
+                colorIndex = lastIndex;
+            } else {
+                colorIndex = m_colorIndexes.value(rgb, -1);
+
+                if (colorIndex == -1) {
+                    colorIndex = m_colors.count();
+                    m_colors.append(rgb);
+                    m_colorIndexes.insert(rgb, colorIndex);
+                }
+
+                lastRgb = rgb;
+                lastIndex = colorIndex;
+            }
+
+            *index++ = colorIndex;
+        }
+    }
+
+    // the odd last column and row of an image using fractionals are dropped
+    QSize size = patternSize();
+    int cellTop = (m_useFractionals) ? top / 2 : top;
+    int cellRows = qMin((m_useFractionals) ? rows / 2 : rows, size.height() - cellTop);
+    QVector<StitchQueue **> cellRowPointers(cellRows);
+
+    for (int row = 0 ; row < cellRows ; ++row) {
+        cellRowPointers[row] = stitchData.stitchQueueRow(cellTop + row);
+    }
+
+    int step = qMax(1, cellRows / (m_pool.maxThreadCount() * 2));
+
+    for (int row = 0 ; row < cellRows ; row += step) {
+        m_pool.start(new ClassifyRows(indexes, width, m_useFractionals, cellRowPointers, row, qMin(cellRows, row + step), size.width()));
+    }
+
+    m_pool.waitForDone();
+
+    return true;
+}
+
+
+/**
+    Get the colors found so far.
+    @return a QList of the colors, the position in the list being the color index used for the stitches
+    */
+QList<QRgb> ImageConverter::colors() const
+{
+    return m_colors;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef ImageConverter_H
+#define ImageConverter_H
+
+
+#include <QAtomicInt>
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QRect>
+#include <QSize>
+#include <QThreadPool>
+
+#include <functional>
+
+// wrap include to silence unused-parameter warning from Magick++ include file
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#include <Magick++.h>
+#pragma GCC diagnostic pop
+
+#include "FlossQuantizer.h"
+
+
+class FlossScheme;
+class StitchData;
+
+
+/**
+    Convert an image mapped to floss colors into stitches, the image being
+    prepared by reduce.
+    The image is read in bands of rows into a buffer reused for each band and
+    the stitches are added directly to a StitchData, so the memory used apart
+    from the image and the stitches is bounded by the band size.  The cells
+    of each band are classified on a thread pool owned by the converter, so
+    its threads are reused from band to band.  The number of threads used by
+    the converters and by reduce can be limited when several images are
+    converted at once.  The colors are numbered in the
+    order they are first found, the caller adds the matching flosses to the
+    document palette once all the bands are converted.
+    */
+class ImageConverter
+{
+public:
+    ImageConverter(const Magick::Image &, bool, bool, QRgb);
+
+    static void setMaxThreadCount(int);
+    static QImage reduce(Magick::Image &, const QRect &, const QSize &, int, FlossQuantizer::Dithering, const FlossScheme *, const QAtomicInt *canceled = nullptr, const std::function<void(const QImage &)> &sampled = std::function<void(const QImage &)>());
+
+    QSize patternSize() const;
+    int bands() const;
+    bool convertBand(int, StitchData &);
+    QList<QRgb> colors() const;
+
+private:
+    Magick::Image       m_image;
+    bool                m_useFractionals;
+    bool                m_ignoreColor;
+    QRgb                m_ignoreRgb;
+    int                 m_bandRows;
+    QImage              m_band;
+    QHash<QRgb, int>    m_colorIndexes;
+    QList<QRgb>         m_colors;
+    QThreadPool         m_pool;
+
+    static int          maxThreadCount;
+};
+
+
+#endif // ImageConverter_H
@@ -12,14 +12,15 @@
 #include "ImportImageDlg.h"
 
 #include <QApplication>
+#include <QImage>
 #include <QPainter>
-#include <QProgressDialog>
 
 #include <KHelpClient>
 #include <KLocalizedString>
 
 #include "configuration.h"
 #include "FlossScheme.h"
+#include "ImportPreviewJob.h"
 #include "SchemeManager.h"
 #include "SymbolManager.h"
 #include "SymbolLibrary.h"
@@ -47,10 +48,16 @@ const uchar alphaData[] = {
 };
 
 
+// the size of the preview cache in KB
+const int PreviewCacheSize = 64 * 1024;
+
+
 ImportImageDlg::ImportImageDlg(QWidget *parent, const Magick::Image &originalImage)
     :   QDialog(parent),
         m_alphaSelect(nullptr),
-        m_originalImage(originalImage)
+        m_originalImage(originalImage),
+        m_job(nullptr),
+        m_previewCache(PreviewCacheSize)
 {
     ui.setupUi(this);
 
@@ -62,6 +69,7 @@ ImportImageDlg::ImportImageDlg(QWidget *parent, const Magick::Image &originalIma
     ui.FlossScheme->blockSignals(true);
     ui.UseMaximumColors->blockSignals(true);
     ui.MaximumColors->blockSignals(true);
+    ui.Dithering->blockSignals(true);
     ui.IgnoreColor->blockSignals(true);
     ui.ColorButton->blockSignals(true);
     ui.HorizontalClothCount->blockSignals(true);
@@ -76,13 +84,14 @@ ImportImageDlg::ImportImageDlg(QWidget *parent, const Magick::Image &originalIma
     ui.CropReset->setIcon(QIcon::fromTheme(QStringLiteral("edit-undo")));
 
     resetImportParameters();
-    createImageMap();
+    createLookup();
     renderPixmap();
 
     // unblock signals now the dialog is setup
     ui.FlossScheme->blockSignals(false);
     ui.UseMaximumColors->blockSignals(false);
     ui.MaximumColors->blockSignals(false);
+    ui.Dithering->blockSignals(false);
     ui.IgnoreColor->blockSignals(false);
     ui.ColorButton->blockSignals(false);
     ui.HorizontalClothCount->blockSignals(false);
@@ -96,6 +105,15 @@ ImportImageDlg::ImportImageDlg(QWidget *parent, const Magick::Image &originalIma
 }
 
 
+ImportImageDlg::~ImportImageDlg()
+{
+    cancelPreview();
+
+    // wait for any canceled jobs still running, they use the scheme lookup
+    qDeleteAll(findChildren<ImportPreviewJob *>());
+}
+
+
 void ImportImageDlg::updateWindowTitle()
 {
     QString caption = i18n("Import Image - Image Size %1 x %2 pixels", m_crop.width(), m_crop.height());
@@ -171,7 +189,7 @@ void ImportImageDlg::showEvent(QShowEvent *event)
 
 void ImportImageDlg::on_FlossScheme_currentIndexChanged(const QString&)
 {
-    createImageMap();
+    createLookup();
     renderPixmap();
 }
 
@@ -192,6 +210,13 @@ void ImportImageDlg::on_MaximumColors_valueChanged(int)
 }
 
 
+void ImportImageDlg::on_Dithering_currentIndexChanged(int)
+{
+    killTimer(m_timer);
+    m_timer = startTimer(500);
+}
+
+
 void ImportImageDlg::on_IgnoreColor_toggled(bool checked)
 {
     Q_UNUSED(checked);
@@ -306,11 +331,11 @@ void ImportImageDlg::on_CropReset_clicked(bool checked)
 
 void ImportImageDlg::imageCropped(const QRectF &rectF)
 {
-    // rectF is new crop rectangle relative to m_convertedImage size
-    // scale rect from m_convertedImage size to m_originalSize
+    // rectF is new crop rectangle relative to the preview size
+    // scale rect from the preview size to m_originalSize
     // m_original size may be cropped from m_originalImage, but is not scaled.
     // add new crop to original one.
-    double scaleFactor = (double)m_originalSize.width() / (double)m_convertedImage.columns();
+    double scaleFactor = (double)m_originalSize.width() / (double)m_pixmap.width();
     QRect scaledCrop = QRect(scaleFactor*rectF.left(), scaleFactor*rectF.top(), scaleFactor*rectF.width(), scaleFactor*rectF.height());
     m_crop = QRect(m_crop.left()+scaledCrop.left(), m_crop.top()+scaledCrop.top(), scaledCrop.width(), scaledCrop.height());
     
@@ -331,116 +356,175 @@ void ImportImageDlg::on_UseFractionals_toggled(bool checked)
 
 void ImportImageDlg::calculateSizes()
 {
-    m_convertedImage = m_originalImage;
-    
     if (m_crop.isValid()) {
-        m_convertedImage.chop(Magick::Geometry(m_crop.left(),m_crop.top()));
-        m_convertedImage.crop(Magick::Geometry(m_crop.width(),m_crop.height()));
-        m_originalSize = QSize(m_convertedImage.columns(), m_convertedImage.rows());
+        m_originalSize = m_crop.size();
     }
-    
-    m_preferredSize = m_originalSize * ui.PatternScale->value() / 100;    
-    QSize imageSize = m_preferredSize;
+
+    m_preferredSize = m_originalSize * ui.PatternScale->value() / 100;
+    m_imageSize = m_preferredSize;
 
     if (ui.UseFractionals->isChecked()) {
-        imageSize *= 2;
+        m_imageSize *= 2;
     }
 
-    Magick::Geometry geometry(imageSize.width(), imageSize.height());
-    geometry.percent(false);
-    geometry.aspect(true);      // set to true to ignore maintaining the aspect ratio
-    m_convertedImage.sample(geometry);
     on_HorizontalClothCount_valueChanged(ui.HorizontalClothCount->value());
 }
 
 
-void ImportImageDlg::createImageMap()
+/**
+    Create the index and lookup of the selected scheme here, rather than on the
+    conversion threads.  This may take a while if the lookup is not in the cache.
+    */
+void ImportImageDlg::createLookup()
 {
-    FlossScheme *scheme = SchemeManager::scheme(ui.FlossScheme->currentText());
-    m_colorMap = *(scheme->createImageMap());
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    SchemeManager::scheme(ui.FlossScheme->currentText())->createLookup();
+    QApplication::restoreOverrideCursor();
 }
 
 
+/**
+    Start converting the image with the current settings on a worker thread,
+    canceling any conversion already running.  The preview is updated as the
+    conversion progresses.
+    */
 void ImportImageDlg::renderPixmap()
 {
-    QPixmap alpha;
-    alpha.loadFromData(alphaData, 143);
+    cancelPreview();
+    calculateSizes();
+
+    int colors = SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes().count();
+
+    if (ui.UseMaximumColors->isChecked()) {
+        colors = std::min(ui.MaximumColors->value(), colors);
+    }
+
+    QRgb ignoreRgb = qRgb(qRound(255*m_ignoreColorValue.red()), qRound(255*m_ignoreColorValue.green()), qRound(255*m_ignoreColorValue.blue()));
+
+    FlossQuantizer::Dithering dithering = static_cast<FlossQuantizer::Dithering>(ui.Dithering->currentIndex());
+    QRgb previewIgnoreRgb = ui.IgnoreColor->isChecked() ? ignoreRgb : 0;
+    QString key = previewKey(colors, dithering, previewIgnoreRgb);
+
+    if (CachedPreview *cachedPreview = m_previewCache.object(key)) {
+        m_convertedImage = cachedPreview->convertedImage;
+        m_mappedImage = cachedPreview->mappedImage;
+        m_pixmap = cachedPreview->pixmap;
+        ui.ImagePreview->setPixmap(m_pixmap);
+        ui.ImagePreview->setCursor(Qt::ArrowCursor);
+        return;
+    }
 
     ui.ImagePreview->setCursor(Qt::WaitCursor);
-    calculateSizes();
-    m_convertedImage.modifyImage();
 
-    m_pixmap = QPixmap(m_convertedImage.columns(), m_convertedImage.rows());
-    m_pixmap.fill();
+    // the previous results do not match the new settings, they are replaced when the job finishes
+    m_convertedImage = Magick::Image();
+    m_mappedImage = QImage();
 
-    m_convertedImage.quantizeColorSpace(Magick::RGBColorspace);
-    m_convertedImage.quantizeColors(ui.UseMaximumColors->isChecked() ?
-                                    std::min(ui.MaximumColors->value(), SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes().count()) :
-                                    SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes().count());
-    m_convertedImage.quantize();
-    m_convertedImage.map(m_colorMap);
-    m_convertedImage.modifyImage();
+    m_jobKey = key;
+    m_job = new ImportPreviewJob(m_originalImage, m_crop, m_imageSize, colors, dithering, SchemeManager::scheme(ui.FlossScheme->currentText()), ui.IgnoreColor->isChecked(), ignoreRgb, this);
+    connect(m_job, &ImportPreviewJob::previewUpdated, this, &ImportImageDlg::previewUpdated);
+    connect(m_job, &QThread::finished, this, &ImportImageDlg::previewFinished);
+    m_job->start();
+}
 
-    QPainter painter;
-    painter.begin(&m_pixmap);
-    painter.drawTiledPixmap(m_pixmap.rect(), alpha);
-    int width = m_convertedImage.columns();
-    int height = m_convertedImage.rows();
-    int pixelCount = width * height;
 
-    QProgressDialog progress(i18n("Rendering preview"), i18n("Cancel"), 0, pixelCount, this);
-    progress.setWindowModality(Qt::WindowModal);
+/**
+    Cancel the conversion running, if any.  The job deletes itself when it
+    finishes and its signals are ignored.
+    */
+void ImportImageDlg::cancelPreview()
+{
+    if (m_job) {
+        disconnect(m_job, nullptr, this, nullptr);
+        connect(m_job, &QThread::finished, m_job, &QObject::deleteLater);
+        m_job->cancel();
+        m_job = nullptr;
+    }
+}
 
-/*
- * ImageMagick prior to V7 used matte (opacity) to determine if an image has transparency.
- * 0.0 for transparent to 1.0 for opaque
- * 
- * ImageMagick V7 now uses alpha (transparency).
- * 1.0 for transparent to 0.0 for opaque
- * 
- * Access to pixels has changed too, V7 can use pixelColor to access the color of a particular
- * pixel, but although this was available in V6, it doesn't appear to produce the same result
- * and has resulted in black images when importing.
- */
-#if MagickLibVersion < 0x700
-    bool hasTransparency = m_convertedImage.matte();
-    double transparent = 1.0;
-    const Magick::PixelPacket *pixels = m_convertedImage.getConstPixels(0, 0, width, height);
-#else
-    bool hasTransparency = m_convertedImage.alpha();
-    double transparent = 0.0;
-#endif
-    
-    for (int dy = 0 ; dy < height ; dy++) {
-        QApplication::processEvents();
-        progress.setValue(dy * width);
 
-        if (progress.wasCanceled()) {
-            break;
-        }
+/**
+    Take the results of the conversion, waiting for it to finish if required.
+    If the conversion failed the results are left empty.
+    */
+void ImportImageDlg::finishPreview()
+{
+    m_job->wait();
 
-        for (int dx = 0 ; dx < width ; dx++) {
-#if MagickLibVersion < 0x700
-            Magick::ColorRGB rgb = Magick::Color(*pixels++);
-#else
-            Magick::ColorRGB rgb = m_convertedImage.pixelColor(dx, dy);
-#endif
-
-            if (hasTransparency && (rgb.alpha() == transparent)) {
-                //ignore this pixel as it is transparent
-            } else {
-                if (!(ui.IgnoreColor->isChecked() && rgb == m_ignoreColorValue)) {
-                    QColor color((int)(255*rgb.red()), (int)(255*rgb.green()), (int)(255*rgb.blue()));
-                    painter.setPen(QPen(color));
-                    painter.drawPoint(dx, dy);
-                }
-            }
-        }
+    if (!m_job->isCanceled()) {
+        m_convertedImage = m_job->convertedImage();
+        m_mappedImage = m_job->mappedImage();
+        showPreview(m_job->preview());
+
+        CachedPreview *cachedPreview = new CachedPreview;
+        cachedPreview->convertedImage = m_convertedImage;
+        cachedPreview->mappedImage = m_mappedImage;
+        cachedPreview->pixmap = m_pixmap;
+
+        // the converted image is costed at 8 bytes a pixel, 16 bit RGBA
+        int pixels = m_mappedImage.width() * m_mappedImage.height();
+        m_previewCache.insert(m_jobKey, cachedPreview, (pixels * (4 + 4 + 8)) / 1024 + 1);
     }
 
+    m_job->deleteLater();
+    m_job = nullptr;
+
+    ui.ImagePreview->setCursor(Qt::ArrowCursor);
+}
+
+
+void ImportImageDlg::previewUpdated(const QImage &preview)
+{
+    if (sender() == m_job) {
+        showPreview(preview);
+    }
+}
+
+
+void ImportImageDlg::previewFinished()
+{
+    if (sender() == m_job) {
+        finishPreview();
+    }
+}
+
+
+void ImportImageDlg::showPreview(const QImage &preview)
+{
+    QPixmap alpha;
+    alpha.loadFromData(alphaData, 143);
+
+    m_pixmap = QPixmap(preview.size());
+    m_pixmap.fill();
+
+    QPainter painter;
+    painter.begin(&m_pixmap);
+    painter.drawTiledPixmap(m_pixmap.rect(), alpha);
+    painter.drawImage(0, 0, preview);
     painter.end();
+
     ui.ImagePreview->setPixmap(m_pixmap);
-    ui.ImagePreview->setCursor(Qt::ArrowCursor);
+}
+
+
+/**
+    Get the key of the preview cache for the current settings.
+    @param colors the maximum number of colors
+    @param dithering the dithering used
+    @param ignoreRgb the color ignored, 0 if no color is ignored
+    @return a QString identifying the settings
+    */
+QString ImportImageDlg::previewKey(int colors, int dithering, QRgb ignoreRgb) const
+{
+    QStringList values;
+    values << QString::number(m_crop.left()) << QString::number(m_crop.top()) << QString::number(m_crop.width()) << QString::number(m_crop.height())
+           << QString::number(m_imageSize.width()) << QString::number(m_imageSize.height())
+           << ui.FlossScheme->currentText()
+           << QString::number(colors)
+           << QString::number(dithering)
+           << QString::number(ignoreRgb, 16);
+
+    return values.join(QLatin1Char(','));
 }
 
 
@@ -466,20 +550,25 @@ void ImportImageDlg::pickColor()
 
 void ImportImageDlg::selectColor(const QPoint &p)
 {
-    QSize trueSize(m_convertedImage.columns(), m_convertedImage.rows());
+    QSize trueSize = m_mappedImage.size();
     QRect pixmapRect = m_alphaSelect->pixmapRect();
 
     delete m_alphaSelect;
     m_alphaSelect = nullptr;
 
+    if (trueSize.isEmpty()) {
+        return;     // no conversion has finished yet
+    }
+
     // convert p that is relative to the ScaledImageLabel to the pixmap size
     int x = (((p.x() - pixmapRect.left()) * trueSize.width()) / pixmapRect.width());
     int y = (((p.y() - pixmapRect.top()) * trueSize.height()) / pixmapRect.height());
 
-    x = (x < 0) ? 0 : std::min(x, trueSize.width());
-    y = (y < 0) ? 0 : std::min(y, trueSize.height());
+    x = (x < 0) ? 0 : std::min(x, trueSize.width() - 1);
+    y = (y < 0) ? 0 : std::min(y, trueSize.height() - 1);
 
-    m_ignoreColorValue = m_convertedImage.pixelColor(x, y);
+    QRgb rgb = m_mappedImage.pixel(x, y);
+    m_ignoreColorValue = Magick::ColorRGB(qRed(rgb) / 255.0, qGreen(rgb) / 255.0, qBlue(rgb) / 255.0);
     QPixmap swatch(ui.ColorButton->size());
     swatch.fill(QColor((int)(255*m_ignoreColorValue.red()), (int)(255*m_ignoreColorValue.green()), (int)(255*m_ignoreColorValue.blue())));
     ui.ColorButton->setIcon(swatch);
@@ -490,6 +579,16 @@ void ImportImageDlg::selectColor(const QPoint &p)
 
 void ImportImageDlg::on_DialogButtonBox_accepted()
 {
+    if (m_job) {
+        finishPreview();
+    }
+
+    if (m_mappedImage.isNull()) {
+        // the conversion failed, try again rather than import nothing
+        renderPixmap();
+        return;
+    }
+
     accept();
 }
 
@@ -609,4 +708,5 @@ void ImportImageDlg::resetImportParameters()
     ui.MaximumColors->setValue(Configuration::import_MaximumColors());
     ui.MaximumColors->setMaximum(SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes().count());
     ui.MaximumColors->setToolTip(QString(i18n("Colors limited to %1 due to the number of symbols available", ui.MaximumColors->maximum())));
+    ui.Dithering->setCurrentIndex(Configuration::import_Dithering());
 }
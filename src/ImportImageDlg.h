@@ -14,7 +14,9 @@
 
 
 #include <QAction>
+#include <QCache>
 #include <QDialog>
+#include <QImage>
 #include <QPixmap>
 #include <QSize>
 #include <QTimer>
@@ -30,18 +32,32 @@
 #include "ui_ImportImage.h"
 
 
+class ImportPreviewJob;
 class SchemeManager;
 class QHideEvent;
 class QShowEvent;
 
 
+/**
+    The results of a conversion kept so returning to settings already seen
+    does not convert the image again.
+    */
+class CachedPreview
+{
+public:
+    Magick::Image   convertedImage;     /**< the image mapped to the floss colors */
+    QImage          mappedImage;        /**< the same image in QImage::Format_RGBA8888 */
+    QPixmap         pixmap;             /**< the preview as shown */
+};
+
+
 class ImportImageDlg : public QDialog
 {
     Q_OBJECT
 
 public:
     ImportImageDlg(QWidget *, const Magick::Image &);
-    virtual ~ImportImageDlg() = default;
+    virtual ~ImportImageDlg();
 
     Magick::Image convertedImage() const;
     bool ignoreColor() const;
@@ -61,6 +77,7 @@ private slots:
     void on_FlossScheme_currentIndexChanged(const QString &);
     void on_UseMaximumColors_toggled(bool);
     void on_MaximumColors_valueChanged(int);
+    void on_Dithering_currentIndexChanged(int);
     void on_IgnoreColor_toggled(bool);
     void on_ColorButton_clicked(bool);
     void on_HorizontalClothCount_valueChanged(double);
@@ -76,27 +93,37 @@ private slots:
     void on_DialogButtonBox_rejected();
     void on_DialogButtonBox_helpRequested();
     void on_DialogButtonBox_clicked(QAbstractButton *);
+    void previewUpdated(const QImage &);
+    void previewFinished();
 
 private:
     void updateWindowTitle();
     void resetImportParameters();
     void clothCountChanged(double, double);
     void calculateSizes();
-    void createImageMap();
+    void createLookup();
     void renderPixmap();
+    void cancelPreview();
+    void finishPreview();
+    void showPreview(const QImage &);
     void pickColor();
+    QString previewKey(int, int, QRgb) const;
 
     Ui::ImportImage ui;
 
     QPixmap     m_pixmap;
     QSize       m_originalSize;
     QSize       m_preferredSize;
+    QSize       m_imageSize;
     int         m_timer;
     AlphaSelect *m_alphaSelect;
     Magick::ColorRGB    m_ignoreColorValue;
     Magick::Image       m_originalImage;
     Magick::Image       m_convertedImage;
-    Magick::Image       m_colorMap;
+    QImage              m_mappedImage;
+    ImportPreviewJob    *m_job;
+    QString             m_jobKey;
+    QCache<QString, CachedPreview>  m_previewCache;
     QRect       m_crop;
 };
 
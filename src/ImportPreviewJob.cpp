@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include "ImportPreviewJob.h"
+
+#include "ImageConverter.h"
+
+
+/**
+    Constructor.
+    @param image the original image, it is copied so the caller may continue to use it
+    @param crop the area of the original image to use, ignored if not valid
+    @param size the size of the converted image in pixels
+    @param colors the maximum number of flosses
+    @param dithering the dithering used when mapping to the flosses
+    @param scheme the selected scheme
+    @param ignoreColor true if pixels of ignoreRgb are left out of the preview
+    @param ignoreRgb the color being ignored
+    @param parent the parent QObject
+    */
+ImportPreviewJob::ImportPreviewJob(const Magick::Image &image, const QRect &crop, const QSize &size, int colors, FlossQuantizer::Dithering dithering, const FlossScheme *scheme, bool ignoreColor, QRgb ignoreRgb, QObject *parent)
+    :   QThread(parent),
+        m_image(image),
+        m_crop(crop),
+        m_size(size),
+        m_colors(colors),
+        m_dithering(dithering),
+        m_scheme(scheme),
+        m_ignoreColor(ignoreColor),
+        m_ignoreRgb(ignoreRgb),
+        m_canceled(0)
+{
+}
+
+
+ImportPreviewJob::~ImportPreviewJob()
+{
+    cancel();
+    wait();
+}
+
+
+bool ImportPreviewJob::isCanceled() const
+{
+    return m_canceled.load();
+}
+
+
+/**
+    Get the converted image, only valid once the job has finished without being canceled.
+    @return the Magick::Image mapped to the floss colors
+    */
+Magick::Image ImportPreviewJob::convertedImage() const
+{
+    return m_image;
+}
+
+
+/**
+    Get the converted pixels, only valid once the job has finished without being canceled.
+    @return a QImage in QImage::Format_RGBA8888 mapped to the floss colors, alpha 0 is transparent
+    */
+QImage ImportPreviewJob::mappedImage() const
+{
+    return m_mappedImage;
+}
+
+
+QImage ImportPreviewJob::preview() const
+{
+    return m_preview;
+}
+
+
+void ImportPreviewJob::cancel()
+{
+    m_canceled.store(1);
+}
+
+
+void ImportPreviewJob::run()
+{
+    int width = m_size.width();
+    int height = m_size.height();
+
+    if (width <= 0 || height <= 0) {
+        cancel();
+        return;
+    }
+
+    // the scaled image is shown while the flosses are selected and mapped, the dialog showing the final preview when the job finishes
+    m_mappedImage = ImageConverter::reduce(m_image, m_crop, m_size, m_colors, m_dithering, m_scheme, &m_canceled, [this](const QImage &sampled) {
+        emit previewUpdated(createPreview(sampled));
+    });
+
+    if (m_mappedImage.isNull()) {
+        cancel();
+        return;
+    }
+
+    m_preview = createPreview(m_mappedImage);
+}
+
+
+/**
+    Create a preview of the pixels of an image.
+    @param image a QImage in QImage::Format_RGBA8888, alpha 0 is transparent
+    @return a QImage in QImage::Format_ARGB32, transparent and ignored pixels being left transparent
+    */
+QImage ImportPreviewJob::createPreview(const QImage &image) const
+{
+    int width = image.width();
+    int height = image.height();
+
+    QImage preview(width, height, QImage::Format_ARGB32);
+    preview.fill(Qt::transparent);
+
+    for (int dy = 0 ; dy < height ; dy++) {
+        const uchar *rgba = image.constScanLine(dy);
+        QRgb *line = reinterpret_cast<QRgb *>(preview.scanLine(dy));
+
+        for (int dx = 0 ; dx < width ; dx++, rgba += 4) {
+            QRgb rgb = qRgb(rgba[0], rgba[1], rgba[2]);
+
+            // leave transparent and ignored pixels transparent
+            if (rgba[3] != 0 && !(m_ignoreColor && rgb == m_ignoreRgb)) {
+                line[dx] = rgb | 0xff000000;
+            }
+        }
+    }
+
+    return preview;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef ImportPreviewJob_H
+#define ImportPreviewJob_H
+
+
+#include <QAtomicInt>
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QThread>
+
+// wrap include to silence unused-parameter warning from Magick++ include file
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#include <Magick++.h>
+#pragma GCC diagnostic pop
+
+#include "FlossQuantizer.h"
+
+
+class FlossScheme;
+
+
+/**
+    Convert an image for import on a worker thread.
+    The original image is cropped and scaled, then reduced to the best set
+    of flosses of the scheme by a FlossQuantizer.  The scaled image is sent to
+    the dialog as a preview while the flosses are selected and mapped, the
+    final preview being taken when the job finishes.  Ignored and transparent
+    pixels are left transparent in the preview.
+    The index and lookup of the scheme must have been created before the job
+    is started and must not be changed until it has finished.
+    */
+class ImportPreviewJob : public QThread
+{
+    Q_OBJECT
+
+public:
+    ImportPreviewJob(const Magick::Image &, const QRect &, const QSize &, int, FlossQuantizer::Dithering, const FlossScheme *, bool, QRgb, QObject *parent = nullptr);
+    virtual ~ImportPreviewJob();
+
+    bool isCanceled() const;
+    Magick::Image convertedImage() const;
+    QImage mappedImage() const;
+    QImage preview() const;
+
+public slots:
+    void cancel();
+
+signals:
+    void previewUpdated(const QImage &);
+
+protected:
+    virtual void run() Q_DECL_OVERRIDE;
+
+private:
+    QImage createPreview(const QImage &) const;
+
+    Magick::Image       m_image;
+    QRect               m_crop;
+    QSize               m_size;
+    int                 m_colors;
+    FlossQuantizer::Dithering   m_dithering;
+    const FlossScheme   *m_scheme;
+    bool                m_ignoreColor;
+    QRgb                m_ignoreRgb;
+    QImage              m_mappedImage;
+    QImage              m_preview;
+    QAtomicInt          m_canceled;
+};
+
+
+#endif // ImportPreviewJob_H
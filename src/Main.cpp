@@ -65,8 +65,14 @@
 #include <KAboutData>
 #include <KLocalizedString>
 
+#include "BatchConverter.h"
 #include "configuration.h"
 #include "MainWindow.h"
+#include "Migrator.h"
+
+#if defined(WITH_BENCHMARK)
+#include "Benchmark.h"
+#endif
 
 
 /**
@@ -82,9 +88,27 @@
     created using an empty QUrl, creating a new document, which is then shown on the desktop.
 
     The KApplication instance is then executed which begins the event loop allowing user interaction.
+
+    If the batch option is given the images on the command line are converted to patterns by a
+    BatchConverter instead, using the offscreen platform so no display is required, and the
+    application exits without starting the event loop.  The migrate option re-saves the patterns
+    given in the current format with a Migrator in the same way.  The benchmark option, when built with
+    WITH_BENCHMARK, runs a Benchmark in the same way, on the PC Stitch files given if there are any.
     */
 int main(int argc, char *argv[])
 {
+    bool batch = BatchConverter::requested(argc, argv);
+    bool migrate = Migrator::requested(argc, argv);
+#if defined(WITH_BENCHMARK)
+    bool benchmark = Benchmark::requested(argc, argv);
+#else
+    bool benchmark = false;
+#endif
+
+    if (batch || migrate || benchmark) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
     QApplication app(argc, argv);
     KLocalizedString::setApplicationDomain("kxstitch");
 
@@ -120,11 +144,52 @@ int main(int argc, char *argv[])
     parser.addVersionOption();
 
     parser.addPositionalArgument(QStringLiteral("urls"), i18n("Document to open."), QStringLiteral("[urls...]"));
+    BatchConverter::addOptions(parser);
+    Migrator::addOptions(parser);
+#if defined(WITH_BENCHMARK)
+    Benchmark::addOptions(parser);
+#endif
 
     parser.process(app);
 
     aboutData.processCommandLine(&parser);
 
+    if (batch) {
+        BatchConverter batchConverter;
+
+        if (!batchConverter.setOptions(parser)) {
+            return 1;
+        }
+
+        return (batchConverter.convert(BatchConverter::expand(parser.positionalArguments())) == 0) ? 0 : 1;
+    }
+
+    if (migrate) {
+        Migrator migrator;
+
+        if (!migrator.setOptions(parser)) {
+            return 1;
+        }
+
+        return (migrator.migrate(Migrator::find(parser.positionalArguments())) == 0) ? 0 : 1;
+    }
+
+#if defined(WITH_BENCHMARK)
+    if (benchmark) {
+        Benchmark documentBenchmark;
+
+        if (!documentBenchmark.setOptions(parser)) {
+            return 1;
+        }
+
+        if (!parser.positionalArguments().isEmpty()) {
+            return documentBenchmark.runPCStitch(BatchConverter::expand(parser.positionalArguments()));
+        }
+
+        return documentBenchmark.run();
+    }
+#endif
+
     MainWindow *mainWindow;
 
     QStringList urls = parser.positionalArguments();
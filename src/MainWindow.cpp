@@ -17,7 +17,10 @@
 #include <QDataStream>
 #include <QDockWidget>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QGridLayout>
+#include <QHash>
+#include <QImageReader>
 #include <QMenu>
 #include <QMimeData>
 #include <QPainter>
@@ -29,6 +32,7 @@
 #include <QPrintPreviewDialog>
 #include <QSaveFile>
 #include <QScrollArea>
+#include <QStatusBar>
 #include <QTemporaryFile>
 #include <QUndoView>
 #include <QUrl>
@@ -44,6 +48,8 @@
 #include <KXMLGUIFactory>
 
 #include "BackgroundImage.h"
+#include "CommandStatistics.h"
+#include "CommandStatisticsView.h"
 #include "configuration.h"
 #include "ConfigurationDialogs.h"
 #include "Commands.h"
@@ -53,7 +59,9 @@
 #include "FilePropertiesDlg.h"
 #include "Floss.h"
 #include "FlossScheme.h"
+#include "ImageConverter.h"
 #include "ImportImageDlg.h"
+#include "OXSFile.h"
 #include "Palette.h"
 #include "PaletteManagerDlg.h"
 #include "PaperSizes.h"
@@ -62,20 +70,30 @@
 #include "QVariantPtr.h"
 #include "Scale.h"
 #include "ScaledPixmapLabel.h"
+#include "SaveJob.h"
 #include "SchemeManager.h"
+#include "StitchDataJob.h"
 #include "SymbolLibrary.h"
 #include "SymbolManager.h"
 
 
 MainWindow::MainWindow()
-    :   m_printer(nullptr)
+    :   m_printer(nullptr),
+        m_saveJob(nullptr),
+        m_saveSerial(0),
+        m_changes(0),
+        m_savedChanges(0)
 {
     setupActions();
 }
 
 
 MainWindow::MainWindow(const QUrl &url)
-    :   m_printer(nullptr)
+    :   m_printer(nullptr),
+        m_saveJob(nullptr),
+        m_saveSerial(0),
+        m_changes(0),
+        m_savedChanges(0)
 {
     setupMainWindow();
     setupLayout();
@@ -89,11 +107,16 @@ MainWindow::MainWindow(const QUrl &url)
     setupActionsFromDocument();
     setCaption(m_document->url().fileName(), !m_document->undoStack().isClean());
     this->findChild<QDockWidget *>(QStringLiteral("ImportedImage#"))->hide();
+    this->findChild<QDockWidget *>(QStringLiteral("CommandStatistics#"))->hide();
 }
 
 
 MainWindow::MainWindow(const QString &source)
-    :   m_printer(nullptr)
+    :   m_printer(nullptr),
+        m_saveJob(nullptr),
+        m_saveSerial(0),
+        m_changes(0),
+        m_savedChanges(0)
 {
     setupMainWindow();
     setupLayout();
@@ -107,6 +130,7 @@ MainWindow::MainWindow(const QString &source)
     setupActionsFromDocument();
     setCaption(m_document->url().fileName(), !m_document->undoStack().isClean());
     this->findChild<QDockWidget *>(QStringLiteral("ImportedImage#"))->show();
+    this->findChild<QDockWidget *>(QStringLiteral("CommandStatistics#"))->hide();
 }
 
 
@@ -178,6 +202,10 @@ void MainWindow::setupConnections()
     connect(&(m_document->undoStack()), &QUndoStack::undoTextChanged, this, &MainWindow::undoTextChanged);
     connect(&(m_document->undoStack()), &QUndoStack::redoTextChanged, this, &MainWindow::redoTextChanged);
     connect(&(m_document->undoStack()), &QUndoStack::cleanChanged, this, &MainWindow::documentModified);
+    connect(&(m_document->undoStack()), &QUndoStack::indexChanged, m_commandStatistics, &CommandStatisticsView::refresh);
+    connect(&(m_document->undoStack()), &QUndoStack::indexChanged, this, [this]() {
+        ++m_changes;    // counts undo and redo as well, the index alone does not identify the state
+    });
     connect(m_palette, &Palette::colorSelected, m_editor, static_cast<void (Editor::*)()>(&Editor::drawContents));
     connect(m_palette, static_cast<void (Palette::*)(int, int)>(&Palette::swapColors), this, &MainWindow::paletteSwapColors);
     connect(m_palette, static_cast<void (Palette::*)(int, int)>(&Palette::replaceColor), this, &MainWindow::paletteReplaceColor);
@@ -208,6 +236,7 @@ void MainWindow::setupActionDefaults()
 
 MainWindow::~MainWindow()
 {
+    delete m_saveJob;
     delete m_printer;
 }
 
@@ -232,6 +261,8 @@ Palette *MainWindow::palette()
 
 bool MainWindow::queryClose()
 {
+    waitForSave();
+
     if (m_document->undoStack().isClean()) {
         return true;
     }
@@ -242,6 +273,7 @@ bool MainWindow::queryClose()
         switch (messageBoxResult) {
         case KMessageBox::Yes :
             fileSave();
+            waitForSave();
 
             if (m_document->undoStack().isClean()) {
                 return true;
@@ -282,7 +314,7 @@ void MainWindow::fileNew()
 
 void MainWindow::fileOpen()
 {
-    fileOpen(QFileDialog::getOpenFileUrl(this, i18n("Open file"), QUrl::fromLocalFile(QDir::homePath()), i18n("KXStitch Patterns (*.kxs);;PC Stitch Patterns (*.pat);;All Files (*)")));
+    fileOpen(QFileDialog::getOpenFileUrl(this, i18n("Open file"), QUrl::fromLocalFile(QDir::homePath()), i18n("KXStitch Patterns (*.kxs);;PC Stitch Patterns (*.pat);;Open Cross Stitch Patterns (*.oxs);;All Files (*)")));
 }
 
 
@@ -313,7 +345,16 @@ void MainWindow::fileOpen(const QUrl &url)
                         try {
                             m_document->readPCStitch(stream);
                         } catch (const InvalidFile &e) {
-                            KMessageBox::sorry(nullptr, i18n("The file does not appear to be a recognized cross stitch file."));
+                            stream.device()->seek(0);
+
+                            try {
+                                OXSFile::read(*m_document, stream.device());
+                            } catch (const InvalidFile &e) {
+                                KMessageBox::sorry(nullptr, i18n("The file does not appear to be a recognized cross stitch file."));
+                            } catch (const FailedReadFile &e) {
+                                KMessageBox::error(nullptr, i18n("Failed to read the file.\n%1.", e.status));
+                                m_document->initialiseNew();
+                            }
                         }
                     } catch (const InvalidFileVersion &e) {
                         KMessageBox::sorry(nullptr, i18n("This version of the file is not supported.\n%1", e.version));
@@ -341,6 +382,12 @@ void MainWindow::fileOpen(const QUrl &url)
 }
 
 
+/**
+    Save the document on a worker thread.  A snapshot of the document is
+    taken so editing can continue while it is written, the document is only
+    marked clean if it has not been changed by the time the save finishes.
+    A save already in progress is finished first so saves complete in order.
+    */
 void MainWindow::fileSave()
 {
     QUrl url = m_document->url();
@@ -348,29 +395,70 @@ void MainWindow::fileSave()
     if (url.toString() == i18n("Untitled")) {
         fileSaveAs();
     } else {
+        waitForSave();
+
         // ### Why use QUrl everywhere if this only supports local files?
-        QSaveFile file(url.toLocalFile());
+        int serial = ++m_saveSerial;
+        m_savedChanges = m_changes;
+        m_saveJob = new SaveJob(m_document->snapshot(), url.toLocalFile(), this);
 
-        if (file.open(QIODevice::WriteOnly)) {
-            QDataStream stream(&file);
+        connect(m_saveJob, &SaveJob::progress, this, &MainWindow::saveProgress);
+        connect(m_saveJob, &QThread::finished, this, [this, serial]() {
+            saveFinished(serial);
+        });
 
-            try {
-                m_document->write(stream);
+        m_saveJob->start();
+    }
+}
 
-                if (!file.commit()) {
-                    throw FailedWriteFile(stream.status());
-                }
 
-                m_document->undoStack().setClean();
-            } catch (const FailedWriteFile &e) {
-                KMessageBox::error(nullptr, QString(i18n("Failed to save the file.\n%1", file.errorString())));
-                file.cancelWriting();
-            }
-        } else {
-            KMessageBox::error(nullptr, QString(i18n("Failed to open the file.\n%1", file.errorString())));
+void MainWindow::saveProgress(int percent)
+{
+    if (m_saveJob) {
+        statusBar()->showMessage(i18n("Saving %1 (%2%)", QFileInfo(m_saveJob->fileName()).fileName(), percent));
+    }
+}
+
+
+/**
+    Complete a save once its job has finished, reporting any error.
+    @param serial the number of the save, a save already completed by
+    waitForSave is ignored
+    */
+void MainWindow::saveFinished(int serial)
+{
+    if (m_saveJob == nullptr || serial != m_saveSerial) {
+        return;
+    }
+
+    SaveJob *saveJob = m_saveJob;
+    m_saveJob = nullptr;
+    saveJob->wait();
+
+    if (saveJob->isSaved()) {
+        if (m_changes == m_savedChanges) {
+            m_document->undoStack().setClean();
         }
+
+        statusBar()->showMessage(i18n("Saved %1", QFileInfo(saveJob->fileName()).fileName()), 2000);
+    } else {
+        statusBar()->clearMessage();
+        KMessageBox::error(nullptr, QString(i18n("Failed to save the file.\n%1", saveJob->errorString())));
     }
 
+    saveJob->deleteLater();
+}
+
+
+/**
+    Wait for a save in progress to finish and complete it.
+    */
+void MainWindow::waitForSave()
+{
+    if (m_saveJob) {
+        m_saveJob->wait();
+        saveFinished(m_saveSerial);
+    }
 }
 
 
@@ -398,6 +486,8 @@ void MainWindow::fileSaveAs()
 
 void MainWindow::fileRevert()
 {
+    waitForSave();
+
     if (!m_document->undoStack().isClean()) {
         if (KMessageBox::warningYesNo(this, i18n("Revert changes to document?")) == KMessageBox::Yes) {
             m_document->undoStack().setIndex(m_document->undoStack().cleanIndex());
@@ -522,117 +612,93 @@ void MainWindow::fileImportImage()
 }
 
 
+/**
+    Export the document as an Open Cross Stitch file for other programs.  The
+    document itself is not changed and keeps its own url.
+    */
+void MainWindow::fileExportOXS()
+{
+    QUrl url = QFileDialog::getSaveFileUrl(this, i18n("Export Open Cross Stitch"), QUrl::fromLocalFile(QDir::homePath()), i18n("Open Cross Stitch Patterns (*.oxs)"));
+
+    if (!url.isValid()) {
+        return;
+    }
+
+    // ### Why use QUrl everywhere if this only supports local files?
+    QSaveFile file(url.toLocalFile());
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        KMessageBox::error(nullptr, i18n("Failed to open the file.\n%1", file.errorString()));
+        return;
+    }
+
+    try {
+        OXSFile::write(*m_document, &file);
+
+        if (!file.commit()) {
+            KMessageBox::error(nullptr, i18n("Failed to save the file.\n%1", file.errorString()));
+        }
+    } catch (const FailedWriteFile &e) {
+        file.cancelWriting();
+        KMessageBox::error(nullptr, i18n("Failed to save the file.\n%1", e.statusMessage()));
+    }
+}
+
+
 void MainWindow::convertImage(const QString &source)
 {
     Magick::Image image(source.toStdString());
 
-    QMap<int, QColor> documentFlosses;
     QList<qint16> symbolIndexes = SymbolManager::library(Configuration::palette_DefaultSymbolLibrary())->indexes();
 
     QPointer<ImportImageDlg> importImageDlg = new ImportImageDlg(this, image);
 
     if (importImageDlg->exec()) {
-        Magick::Image convertedImage = importImageDlg->convertedImage();
-
-        int imageWidth = convertedImage.columns();
-        int imageHeight = convertedImage.rows();
-        int documentWidth = imageWidth;
-        int documentHeight = imageHeight;
-
-        bool useFractionals = importImageDlg->useFractionals();
+        Magick::ColorRGB ignoreColorValue = importImageDlg->ignoreColorValue();
+        QRgb ignoreRgb = qRgb(qRound(255*ignoreColorValue.red()), qRound(255*ignoreColorValue.green()), qRound(255*ignoreColorValue.blue()));
 
 /*
- * ImageMagick prior to V7 used matte (opacity) to determine if an image has transparency.
- * 0.0 for transparent to 1.0 for opaque
- * 
- * ImageMagick V7 now uses alpha (transparency).
- * 1.0 for transparent to 0.0 for opaque
- * 
- * Access to pixels has changed too, V7 can use pixelColor to access the color of a particular
- * pixel, but although this was available in V6, it doesn't appear to produce the same result
- * and has resulted in black images when importing.
+ * The converted image is read in bands of rows and the stitches added directly to a new
+ * StitchData, which is swapped into the document by a single command.  Neither a copy of
+ * the whole image nor a command for each stitch is held in memory.
  */
-#if MagickLibVersion < 0x700
-        bool hasTransparency = convertedImage.matte();
-        double transparent = 1.0;
-        const Magick::PixelPacket *pixels = convertedImage.getConstPixels(0, 0, imageWidth, imageHeight);
-#else
-        bool hasTransparency = convertedImage.alpha();
-        double transparent = 0.0;
-#endif
-        
-        bool ignoreColor = importImageDlg->ignoreColor();
-        Magick::Color ignoreColorValue = importImageDlg->ignoreColorValue();
-
-        int pixelCount = imageWidth * imageHeight;
-
-        if (useFractionals) {
-            documentWidth /= 2;
-            documentHeight /= 2;
-        }
-
-        QString schemeName = importImageDlg->flossScheme();
-        FlossScheme *flossScheme = SchemeManager::scheme(schemeName);
+        ImageConverter converter(importImageDlg->convertedImage(), importImageDlg->useFractionals(), importImageDlg->ignoreColor(), ignoreRgb);
+        QSize patternSize = converter.patternSize();
 
-        QUndoCommand *importImageCommand = new ImportImageCommand(m_document);
-        new ResizeDocumentCommand(m_document, documentWidth, documentHeight, importImageCommand);
-        new ChangeSchemeCommand(m_document, schemeName, importImageCommand);
+        StitchData *stitchData = new StitchData;
+        stitchData->resize(patternSize.width(), patternSize.height());
 
-        QProgressDialog progress(i18n("Converting to stitches"), i18n("Cancel"), 0, pixelCount, this);
+        QProgressDialog progress(i18n("Converting to stitches"), i18n("Cancel"), 0, converter.bands(), this);
         progress.setWindowModality(Qt::WindowModal);
 
-        for (int dy = 0 ; dy < imageHeight ; dy++) {
-            progress.setValue(dy * imageWidth);
+        for (int band = 0 ; band < converter.bands() ; ++band) {
+            progress.setValue(band);
             QApplication::processEvents();
 
-            if (progress.wasCanceled()) {
+            if (progress.wasCanceled() || !converter.convertBand(band, *stitchData)) {
+                delete stitchData;
                 delete importImageDlg;
-                delete importImageCommand;
                 return;
             }
+        }
 
-            for (int dx = 0 ; dx < imageWidth ; dx++) {
-#if MagickLibVersion < 0x700
-                Magick::ColorRGB rgb = Magick::Color(*pixels++);
-#else
-                Magick::ColorRGB rgb = convertedImage.pixelColor(dx, dy);
-#endif
-                
-                if (hasTransparency && (rgb.alpha() == transparent)) {
-                    // ignore this pixel as it is transparent
-                } else {
-                    if (!(ignoreColor && (rgb == ignoreColorValue))) {
-                        int flossIndex;
-                        QColor color((int)(255*rgb.red()), (int)(255*rgb.green()), (int)(255*rgb.blue()));
+        QString schemeName = importImageDlg->flossScheme();
+        FlossScheme *flossScheme = SchemeManager::scheme(schemeName);
 
-                        for (flossIndex = 0 ; flossIndex < documentFlosses.count() ; ++flossIndex) {
-                            if (documentFlosses[flossIndex] == color) {
-                                break;
-                            }
-                        }
+        QUndoCommand *importImageCommand = new ImportImageCommand(m_document);
+        new ReplaceStitchDataCommand(m_document, stitchData, importImageCommand);
+        new ChangeSchemeCommand(m_document, schemeName, importImageCommand);
 
-                        if (flossIndex == documentFlosses.count()) { // reached the end of the list
-                            qint16 stitchSymbol = symbolIndexes.takeFirst();
-                            Qt::PenStyle backstitchSymbol(Qt::SolidLine);
-                            Floss *floss = flossScheme->find(color);
+        QList<QRgb> colors = converter.colors();
 
-                            DocumentFloss *documentFloss = new DocumentFloss(floss->name(), stitchSymbol, backstitchSymbol, Configuration::palette_StitchStrands(), Configuration::palette_BackstitchStrands());
-                            documentFloss->setFlossColor(floss->color());
-                            new AddDocumentFlossCommand(m_document, flossIndex, documentFloss, importImageCommand);
-                            documentFlosses.insert(flossIndex, color);
-                        }
+        for (int flossIndex = 0 ; flossIndex < colors.count() ; ++flossIndex) {
+            qint16 stitchSymbol = symbolIndexes.takeFirst();
+            Qt::PenStyle backstitchSymbol(Qt::SolidLine);
+            Floss *floss = flossScheme->find(QColor(colors.at(flossIndex)));
 
-                        // at this point
-                        //   flossIndex will be the index for the found color
-                        if (useFractionals) {
-                            int zone = (dy % 2) * 2 + (dx % 2);
-                            new AddStitchCommand(m_document, QPoint(dx / 2, dy / 2), stitchMap[0][zone], flossIndex, importImageCommand);
-                        } else {
-                            new AddStitchCommand(m_document, QPoint(dx, dy), Stitch::Full, flossIndex, importImageCommand);
-                        }
-                    }
-                }
-            }
+            DocumentFloss *documentFloss = new DocumentFloss(floss->name(), stitchSymbol, backstitchSymbol, Configuration::palette_StitchStrands(), Configuration::palette_BackstitchStrands());
+            documentFloss->setFlossColor(floss->color());
+            new AddDocumentFlossCommand(m_document, flossIndex, documentFloss, importImageCommand);
         }
 
         new SetPropertyCommand(m_document, QStringLiteral("horizontalClothCount"), importImageDlg->horizontalClothCount(), importImageCommand);
@@ -648,10 +714,10 @@ void MainWindow::convertImage(const QString &source)
 
 void MainWindow::convertPreview(const QString &source, const QRect &croppedArea)
 {
-    QPixmap pixmap;
-    pixmap.load(source);
-    pixmap = pixmap.copy(croppedArea);
-    m_imageLabel->setPixmap(pixmap);
+    // only the cropped area is decoded where the image format supports it
+    QImageReader reader(source);
+    reader.setClipRect(croppedArea);
+    m_imageLabel->setPixmap(QPixmap::fromImage(reader.read()));
 }
 
 
@@ -663,7 +729,19 @@ void MainWindow::fileProperties()
         QUndoCommand *cmd = new FilePropertiesCommand(m_document);
 
         if ((filePropertiesDlg->documentWidth() != m_document->pattern()->stitches().width()) || (filePropertiesDlg->documentHeight() != m_document->pattern()->stitches().height())) {
-            new ResizeDocumentCommand(m_document, filePropertiesDlg->documentWidth(), filePropertiesDlg->documentHeight(), cmd);
+            int width = filePropertiesDlg->documentWidth();
+            int height = filePropertiesDlg->documentHeight();
+            StitchData *stitchData = StitchDataJob::execute(this, i18n("Resizing pattern"), m_document->pattern()->stitches(), [=](StitchData &stitches) {
+                ResizeDocumentCommand::resize(stitches, width, height);
+            });
+
+            if (stitchData == nullptr) {
+                delete cmd;
+                delete filePropertiesDlg;
+                return;
+            }
+
+            new ResizeDocumentCommand(m_document, width, height, cmd, stitchData);
         }
 
         if (filePropertiesDlg->unitsFormat() != static_cast<Configuration::EnumDocument_UnitsFormat::type>(m_document->property(QStringLiteral("unitsFormat")).toInt())) {
@@ -821,14 +899,14 @@ void MainWindow::paletteShowSymbols(bool show)
 
 void MainWindow::paletteClearUnused()
 {
-    QMap<int, FlossUsage> flossUsage = m_document->pattern()->stitches().flossUsage();
+    QHash<int, ColorUsage> colorUsage = m_document->pattern()->stitches().colorUsage();
     QMapIterator<int, DocumentFloss *> flosses(m_document->pattern()->palette().flosses());
     ClearUnusedFlossesCommand *clearUnusedFlossesCommand = new ClearUnusedFlossesCommand(m_document);
 
     while (flosses.hasNext()) {
         flosses.next();
 
-        if (flossUsage[flosses.key()].totalStitches() == 0) {
+        if (!colorUsage.contains(flosses.key())) {
             new RemoveDocumentFlossCommand(m_document, flosses.key(), flosses.value(), clearUnusedFlossesCommand);
         }
     }
@@ -893,7 +971,13 @@ void MainWindow::patternExtend()
         int bottom = extendPatternDlg->bottom();
 
         if (top || left || right || bottom) {
-            m_document->undoStack().push(new ExtendPatternCommand(m_document, top, left, right, bottom));
+            StitchData *stitchData = StitchDataJob::execute(this, i18n("Extending pattern"), m_document->pattern()->stitches(), [=](StitchData &stitches) {
+                ExtendPatternCommand::extend(stitches, top, left, right, bottom);
+            });
+
+            if (stitchData) {
+                m_document->undoStack().push(new ExtendPatternCommand(m_document, top, left, right, bottom, stitchData));
+            }
         }
     }
 
@@ -903,13 +987,25 @@ void MainWindow::patternExtend()
 
 void MainWindow::patternCentre()
 {
-    m_document->undoStack().push(new CentrePatternCommand(m_document));
+    StitchData *stitchData = StitchDataJob::execute(this, i18n("Centering pattern"), m_document->pattern()->stitches(), [](StitchData &stitches) {
+        CentrePatternCommand::centre(stitches);
+    });
+
+    if (stitchData) {
+        m_document->undoStack().push(new CentrePatternCommand(m_document, stitchData));
+    }
 }
 
 
 void MainWindow::patternCrop()
 {
-    m_document->undoStack().push(new CropToPatternCommand(m_document));
+    StitchData *stitchData = StitchDataJob::execute(this, i18n("Cropping pattern"), m_document->pattern()->stitches(), [](StitchData &stitches) {
+        CropToPatternCommand::crop(stitches);
+    });
+
+    if (stitchData) {
+        m_document->undoStack().push(new CropToPatternCommand(m_document, stitchData));
+    }
 }
 
 
@@ -1121,6 +1217,11 @@ void MainWindow::setupActions()
     connect(action, &QAction::triggered, this, &MainWindow::fileImportImage);
     actions->addAction(QStringLiteral("fileImportImage"), action);
 
+    action = new QAction(this);
+    action->setText(i18n("Export Open Cross Stitch..."));
+    connect(action, &QAction::triggered, this, &MainWindow::fileExportOXS);
+    actions->addAction(QStringLiteral("fileExportOXS"), action);
+
     action = new QAction(this);
     action->setText(i18n("File Properties"));
     connect(action, &QAction::triggered, this, &MainWindow::fileProperties);
@@ -1724,4 +1825,15 @@ void MainWindow::setupDockWindows()
     dock->setWidget(m_imageLabel);
     addDockWidget(Qt::LeftDockWidgetArea, dock);
     actionCollection()->addAction(QStringLiteral("showImportedDockWidget"), dock->toggleViewAction());
+
+    dock = new QDockWidget(i18n("Command Statistics"), this);
+    dock->setObjectName(QStringLiteral("CommandStatistics#"));
+    dock->setAllowedAreas(Qt::AllDockWidgetAreas);
+    m_commandStatistics = new CommandStatisticsView(this);
+    dock->setWidget(m_commandStatistics);
+    addDockWidget(Qt::BottomDockWidgetArea, dock);
+    // statistics are only collected while the dock is shown
+    connect(dock->toggleViewAction(), &QAction::toggled, &CommandStatistics::setEnabled);
+    connect(dock->toggleViewAction(), &QAction::toggled, m_commandStatistics, &CommandStatisticsView::refresh);
+    actionCollection()->addAction(QStringLiteral("showCommandStatisticsDockWidget"), dock->toggleViewAction());
 }
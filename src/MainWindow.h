@@ -21,12 +21,14 @@ class QString;
 class QUndoView;
 class QUrl;
 
+class CommandStatisticsView;
 class Document;
 class Editor;
 class Palette;
 class Preview;
 class Scale;
 class ScaledPixmapLabel;
+class SaveJob;
 class SchemeManager;
 
 
@@ -63,6 +65,7 @@ protected slots:
     void filePrint();
     void printPages();
     void fileImportImage();
+    void fileExportOXS();
     void fileProperties();
     void fileAddBackgroundImage();
     void fileRemoveBackgroundImage();
@@ -108,6 +111,7 @@ protected slots:
 
 private slots:
     void paletteContextMenu(const QPoint &);
+    void saveProgress(int);
 
 private:
     void setupMainWindow();
@@ -121,6 +125,8 @@ private:
     void convertImage(const QString &);
     void convertPreview(const QString &, const QRect &);
     QPrinter *printer();
+    void saveFinished(int);
+    void waitForSave();
 
     Document    *m_document;
     Editor      *m_editor;
@@ -128,12 +134,19 @@ private:
     Preview     *m_preview;
     QUndoView   *m_history;
 
+    CommandStatisticsView   *m_commandStatistics;
+
     ScaledPixmapLabel   *m_imageLabel;
 
     Scale       *m_horizontalScale;
     Scale       *m_verticalScale;
 
     QPrinter    *m_printer;
+
+    SaveJob     *m_saveJob;
+    int         m_saveSerial;
+    int         m_changes;
+    int         m_savedChanges;
 };
 
 
@@ -0,0 +1,468 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include "Migrator.h"
+
+#include <QAtomicInt>
+#include <QBuffer>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDataStream>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThreadPool>
+
+#include <KLocalizedString>
+
+#include <string.h>
+
+#include "configuration.h"
+#include "BatchConverter.h"
+#include "Document.h"
+#include "DocumentFloss.h"
+#include "Exceptions.h"
+#include "FlossScheme.h"
+#include "SchemeManager.h"
+#include "SymbolManager.h"
+
+
+static QMutex reportMutex;
+
+
+/**
+    Write a line to stderr, the lines from the migration threads are not mixed.
+    */
+static void report(const QString &message)
+{
+    QMutexLocker locker(&reportMutex);
+    QTextStream stream(stderr);
+    stream << message << endl;
+}
+
+
+/**
+    Write a document to memory.
+    @param document the document to write
+    @return a QByteArray of the file
+    */
+static QByteArray writeDocument(Document &document)
+{
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    QDataStream stream(&buffer);
+    document.write(stream);
+
+    return data;
+}
+
+
+/**
+    Compare two stitch queues, the stitches being in the same order.
+    @return true if the queues hold the same stitches, an empty cell being a null queue
+    */
+static bool sameStitches(const StitchQueue *stitchQueue, const StitchQueue *other)
+{
+    if (stitchQueue == nullptr || other == nullptr) {
+        return stitchQueue == other;
+    }
+
+    if (stitchQueue->count() != other->count()) {
+        return false;
+    }
+
+    for (int i = 0 ; i < stitchQueue->count() ; ++i) {
+        if (stitchQueue->at(i)->type != other->at(i)->type || stitchQueue->at(i)->colorIndex != other->at(i)->colorIndex) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+    Compare the migrated pattern read back with the original, so that data the
+    migration loses is found.  The background images and the printer
+    configuration are not compared.
+    @param original the document read from the original file
+    @param migrated the document read from the migrated file
+    @return an empty QString if the documents are the same, otherwise what differs
+    */
+static QString compareDocuments(Document &original, Document &migrated)
+{
+    if (original.properties() != migrated.properties()) {
+        return i18n("The properties are different.");
+    }
+
+    const DocumentPalette &palette = original.pattern()->palette();
+    const DocumentPalette &migratedPalette = migrated.pattern()->palette();
+    QMap<int, DocumentFloss *> flosses = palette.flosses();
+    QMap<int, DocumentFloss *> migratedFlosses = migratedPalette.flosses();
+
+    if (palette.schemeName() != migratedPalette.schemeName() || palette.symbolLibrary() != migratedPalette.symbolLibrary() || flosses.keys() != migratedFlosses.keys()) {
+        return i18n("The palette is different.");
+    }
+
+    for (QMap<int, DocumentFloss *>::const_iterator i = flosses.constBegin() ; i != flosses.constEnd() ; ++i) {
+        if (*i.value() != *migratedFlosses.value(i.key())) {
+            return i18n("The palette is different.");
+        }
+    }
+
+    const StitchData &stitchData = original.pattern()->stitches();
+    const StitchData &migratedStitchData = migrated.pattern()->stitches();
+
+    if (stitchData.width() != migratedStitchData.width() || stitchData.height() != migratedStitchData.height()) {
+        return i18n("The pattern size is different.");
+    }
+
+    for (int y = 0 ; y < stitchData.height() ; ++y) {
+        for (int x = 0 ; x < stitchData.width() ; ++x) {
+            if (!sameStitches(stitchData.stitchQueueAt(x, y), migratedStitchData.stitchQueueAt(x, y))) {
+                return i18n("The stitches are different.");
+            }
+        }
+    }
+
+    const QList<Backstitch *> &backstitches = stitchData.backstitches();
+    const QList<Backstitch *> &migratedBackstitches = migratedStitchData.backstitches();
+
+    if (backstitches.count() != migratedBackstitches.count()) {
+        return i18n("The backstitches are different.");
+    }
+
+    for (int i = 0 ; i < backstitches.count() ; ++i) {
+        const Backstitch *backstitch = backstitches.at(i);
+        const Backstitch *migratedBackstitch = migratedBackstitches.at(i);
+
+        if (backstitch->start != migratedBackstitch->start || backstitch->end != migratedBackstitch->end || backstitch->colorIndex != migratedBackstitch->colorIndex) {
+            return i18n("The backstitches are different.");
+        }
+    }
+
+    const QList<Knot *> &knots = stitchData.knots();
+    const QList<Knot *> &migratedKnots = migratedStitchData.knots();
+
+    if (knots.count() != migratedKnots.count()) {
+        return i18n("The french knots are different.");
+    }
+
+    for (int i = 0 ; i < knots.count() ; ++i) {
+        if (knots.at(i)->position != migratedKnots.at(i)->position || knots.at(i)->colorIndex != migratedKnots.at(i)->colorIndex) {
+            return i18n("The french knots are different.");
+        }
+    }
+
+    return QString();
+}
+
+
+/**
+    Migrate one pattern on a pool thread.
+    */
+class MigrateTask : public QRunnable
+{
+public:
+    MigrateTask(Migrator *migrator, const QString &source, QAtomicInt *failures)
+        :   m_migrator(migrator),
+            m_source(source),
+            m_failures(failures)
+    {
+    }
+
+    virtual void run() Q_DECL_OVERRIDE
+    {
+        QString message;
+        Migrator::Result result = {0, 0, 0, 0};
+        Migrator::Outcome outcome = m_migrator->migrateFile(m_source, message, result);
+
+        report(i18n("%1: %2", m_source, message));
+
+        if (outcome == Migrator::Failed) {
+            m_failures->ref();
+        } else {
+            m_migrator->addResult(outcome, result);
+        }
+    }
+
+private:
+    Migrator    *m_migrator;
+    QString     m_source;
+    QAtomicInt  *m_failures;
+};
+
+
+Migrator::Migrator()
+    :   m_dryRun(false),
+        m_migrated(0),
+        m_current(0)
+{
+    m_total.sourceBytes = 0;
+    m_total.targetBytes = 0;
+    m_total.sourceTime = 0;
+    m_total.targetTime = 0;
+}
+
+
+/**
+    Add the migration options to a QCommandLineParser.
+    */
+void Migrator::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption(QStringLiteral("migrate"), i18n("Re-save the patterns given in the current file format without showing any windows. Directories are searched for .kxs and .pat files, wildcards are expanded and @file reads a list of patterns from file.")));
+    parser.addOption(QCommandLineOption(QStringLiteral("migrate-dry-run"), i18n("Read, convert and verify the patterns without saving them.")));
+}
+
+
+/**
+    Check if a migration is requested before the application is created.
+    @return true if the migrate option is present
+    */
+bool Migrator::requested(int argc, char **argv)
+{
+    for (int i = 1 ; i < argc ; ++i) {
+        if (strcmp(argv[i], "--migrate") == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+    Take the settings from the command line.
+    @return true if the settings are valid, false otherwise
+    */
+bool Migrator::setOptions(const QCommandLineParser &parser)
+{
+    m_dryRun = parser.isSet(QStringLiteral("migrate-dry-run"));
+
+    return true;
+}
+
+
+/**
+    Migrate a list of patterns, sharing them between the threads of a pool,
+    then report the totals.
+    @param sources the paths of the patterns
+    @return the number of patterns that failed to migrate
+    */
+int Migrator::migrate(const QStringList &sources)
+{
+    if (sources.isEmpty()) {
+        report(i18n("No patterns to migrate."));
+        return 1;
+    }
+
+    // create the configuration, the symbol manager and the indexes of the
+    // schemes here, rather than on the migration threads
+    Configuration::self();
+    SymbolManager::libraries();
+
+    foreach (const QString &schemeName, SchemeManager::schemes()) {
+        SchemeManager::scheme(schemeName)->createIndex();
+    }
+
+    QAtomicInt failures(0);
+    QElapsedTimer timer;
+    timer.start();
+
+    QThreadPool pool;
+
+    foreach (const QString &source, sources) {
+        pool.start(new MigrateTask(this, source, &failures));
+    }
+
+    pool.waitForDone();
+
+    report(i18n("%1 migrated, %2 already current, %3 failed in %4 seconds.", m_migrated, m_current, failures.load(), timer.elapsed() / 1000.0));
+
+    if (m_total.sourceBytes && m_total.sourceTime) {
+        report(i18n("Size %1 bytes to %2 bytes, %3% of the original.", m_total.sourceBytes, m_total.targetBytes, qRound(100.0 * m_total.targetBytes / m_total.sourceBytes)));
+        report(i18n("Reading %1 ms to %2 ms, %3% of the original.", m_total.sourceTime / 1000000, m_total.targetTime / 1000000, qRound(100.0 * m_total.targetTime / m_total.sourceTime)));
+    }
+
+    return failures.load();
+}
+
+
+/**
+    Expand directories, wildcards and lists of patterns given on the command line.
+    @param arguments the arguments, as for BatchConverter::expand, a directory
+    being searched with its subdirectories for .kxs and .pat files
+    @return the paths of the patterns
+    */
+QStringList Migrator::find(const QStringList &arguments)
+{
+    QStringList paths;
+
+    foreach (const QString &path, BatchConverter::expand(arguments)) {
+        if (QFileInfo(path).isDir()) {
+            QDirIterator iterator(path, QStringList() << QStringLiteral("*.kxs") << QStringLiteral("*.pat"), QDir::Files, QDirIterator::Subdirectories);
+
+            while (iterator.hasNext()) {
+                paths.append(iterator.next());
+            }
+        } else {
+            paths.append(path);
+        }
+    }
+
+    return paths;
+}
+
+
+/**
+    Migrate one pattern.  The pattern is read from memory so that the time
+    taken to read the original and the migrated file can be compared.
+    @param source the path of the pattern
+    @param message set to the outcome, or the reason for failing
+    @param result set to the sizes and read times of the original and migrated files
+    @return the Outcome
+    */
+Migrator::Outcome Migrator::migrateFile(const QString &source, QString &message, Result &result) const
+{
+    QFile file(source);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        message = i18n("Failed to open the file.\n%1", file.errorString());
+        return Failed;
+    }
+
+    QByteArray original = file.readAll();
+    file.close();
+
+    Document document;
+    bool pcStitch = false;
+    QByteArray migrated;
+    QElapsedTimer timer;
+
+    try {
+        QBuffer buffer;
+        buffer.setData(original);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream stream(&buffer);
+        timer.start();
+
+        try {
+            document.readKXStitch(stream);
+        } catch (const InvalidFile &) {
+            buffer.seek(0);
+            stream.resetStatus();
+            document.readPCStitch(stream);
+            pcStitch = true;
+        }
+
+        result.sourceTime = timer.nsecsElapsed();
+        migrated = writeDocument(document);
+
+        // read the migrated file back, check it matches the original and writes the same file again
+        Document verified;
+        QBuffer migratedBuffer;
+        migratedBuffer.setData(migrated);
+        migratedBuffer.open(QIODevice::ReadOnly);
+        QDataStream migratedStream(&migratedBuffer);
+        timer.restart();
+        verified.readKXStitch(migratedStream);
+        result.targetTime = timer.nsecsElapsed();
+
+        QString difference = compareDocuments(document, verified);
+
+        if (!difference.isEmpty()) {
+            message = i18n("The migrated pattern did not read back the same.\n%1", difference);
+            return Failed;
+        }
+
+        if (writeDocument(verified) != migrated) {
+            message = i18n("The migrated pattern did not read back the same.");
+            return Failed;
+        }
+    } catch (const InvalidFile &) {
+        message = i18n("The file does not appear to be a recognized cross stitch file.");
+        return Failed;
+    } catch (const InvalidFileVersion &e) {
+        message = i18n("This version of the file is not supported.\n%1", e.version);
+        return Failed;
+    } catch (const FailedReadFile &e) {
+        message = i18n("Failed to read the file.\n%1", e.status);
+        return Failed;
+    } catch (const FailedWriteFile &e) {
+        message = i18n("Failed to write the migrated pattern.\n%1", e.statusMessage());
+        return Failed;
+    }
+
+    result.sourceBytes = original.size();
+    result.targetBytes = migrated.size();
+
+    if (migrated == original) {
+        message = i18n("already current");
+        return Current;
+    }
+
+    QString target = source;
+
+    if (pcStitch) {
+        QFileInfo fileInfo(source);
+        target = fileInfo.dir().filePath(fileInfo.completeBaseName() + QStringLiteral(".kxs"));
+
+        if (QFile::exists(target)) {
+            message = i18n("The file %1 already exists.", target);
+            return Failed;
+        }
+    }
+
+    if (!m_dryRun) {
+        QSaveFile saveFile(target);
+
+        if (!saveFile.open(QIODevice::WriteOnly) || saveFile.write(migrated) != migrated.size() || !saveFile.commit()) {
+            message = i18n("Failed to save the file %1.\n%2", target, saveFile.errorString());
+            return Failed;
+        }
+    }
+
+    if (m_dryRun) {
+        message = i18n("%1 bytes to %2 bytes, not written", result.sourceBytes, result.targetBytes);
+    } else {
+        message = i18n("%1 bytes to %2 bytes, written %3", result.sourceBytes, result.targetBytes, target);
+    }
+
+    return Migrated;
+}
+
+
+/**
+    Add the result of a migrated or current pattern to the totals.
+    */
+void Migrator::addResult(Outcome outcome, const Result &result)
+{
+    QMutexLocker locker(&reportMutex);
+
+    if (outcome == Migrated) {
+        ++m_migrated;
+    } else {
+        ++m_current;
+    }
+
+    m_total.sourceBytes += result.sourceBytes;
+    m_total.targetBytes += result.targetBytes;
+    m_total.sourceTime += result.sourceTime;
+    m_total.targetTime += result.targetTime;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef Migrator_H
+#define Migrator_H
+
+
+#include <QString>
+#include <QStringList>
+
+
+class QCommandLineParser;
+
+
+/**
+    Re-save patterns in the current file format from the command line without
+    any windows.  Each pattern, in any of the KXStitch or PC Stitch formats that
+    can be read, is written to memory, read back and written again, and is only
+    saved if both writes match.  KXStitch files are replaced, PC Stitch files
+    are saved as a .kxs file of the same name.  The patterns are migrated in
+    parallel, one per thread, and the change in size and in the time taken to
+    read them is reported.
+    */
+class Migrator
+{
+public:
+    Migrator();
+
+    static void addOptions(QCommandLineParser &);
+    static bool requested(int, char **);
+
+    bool setOptions(const QCommandLineParser &);
+    int migrate(const QStringList &);
+
+    static QStringList find(const QStringList &);
+
+private:
+    friend class MigrateTask;
+
+    enum Outcome {
+        Migrated,
+        Current,
+        Failed
+    };
+
+    struct Result {
+        qint64  sourceBytes;
+        qint64  targetBytes;
+        qint64  sourceTime;
+        qint64  targetTime;
+    };
+
+    Outcome migrateFile(const QString &, QString &, Result &) const;
+    void addResult(Outcome, const Result &);
+
+    bool    m_dryRun;
+    int     m_migrated;
+    int     m_current;
+    Result  m_total;
+};
+
+
+#endif // Migrator_H
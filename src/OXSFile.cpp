@@ -0,0 +1,643 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include "OXSFile.h"
+
+#include <QColor>
+#include <QHash>
+#include <QIODevice>
+#include <QMap>
+#include <QSet>
+#include <QVector>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+#include <algorithm>
+
+#include <KLocalizedString>
+
+#include "configuration.h"
+#include "Document.h"
+#include "DocumentFloss.h"
+#include "Exceptions.h"
+#include "Floss.h"
+#include "FlossScheme.h"
+#include "SchemeManager.h"
+#include "StitchData.h"
+#include "SymbolLibrary.h"
+#include "SymbolManager.h"
+
+
+/**
+    The largest chart width or height read or written, the file properties
+    allowing at most 1000 stitches, so a damaged or hostile file can not make
+    the pattern allocate more cells than memory allows.  Larger patterns are
+    not exported, as they could not be read back.
+    */
+static const int maxChartSize = 2000;
+
+
+/**
+    The quarters of a cell covered by each of the two parts of a partstitch,
+    indexed by the direction less 1 and the part less 1.  Directions 1 and 2
+    split the cell along the / and \ diagonals into triangles, stitched as
+    three quarter stitches, the top left and bottom right triangles for 1
+    and the top right and bottom left for 2.  Directions 3 and 4 split the
+    cell along the same diagonals, the parts being the quarters at the
+    corners the diagonal does not touch, the top left and bottom right
+    quarters for 3 and the top right and bottom left for 4, so both parts
+    of the same color are a half stitch.
+    */
+static const Stitch::Type PartStitchTypes[4][2] = {
+    {Stitch::TL3Qtr, Stitch::BR3Qtr},
+    {Stitch::TR3Qtr, Stitch::BL3Qtr},
+    {Stitch::TLQtr, Stitch::BRQtr},
+    {Stitch::TRQtr, Stitch::BLQtr}
+};
+
+
+/**
+    Get an integer attribute of the current element.
+    @param reader the QXmlStreamReader positioned at the element
+    @param name the name of the attribute
+    @return the value of the attribute
+    */
+static int intAttribute(const QXmlStreamReader &reader, const QString &name)
+{
+    bool ok;
+    int value = reader.attributes().value(name).toInt(&ok);
+
+    if (!ok) {
+        throw FailedReadFile(QString(i18n("Invalid data read.")));
+    }
+
+    return value;
+}
+
+
+/**
+    Get a coordinate attribute of the current element, in stitches with halves
+    for the snap points at the centres of the cells.
+    @param reader the QXmlStreamReader positioned at the element
+    @param name the name of the attribute
+    @return the value of the attribute in snap points, twice the value read
+    */
+static int snapAttribute(const QXmlStreamReader &reader, const QString &name)
+{
+    bool ok;
+    double value = reader.attributes().value(name).toDouble(&ok);
+
+    if (!ok || value < 0 || value > 65535) {
+        throw FailedReadFile(QString(i18n("Invalid data read.")));
+    }
+
+    return qRound(value * 2);
+}
+
+
+/**
+    Get a snap point from a pair of coordinate attributes of the current
+    element, checking that it lies on the pattern.
+    @param reader the QXmlStreamReader positioned at the element
+    @param stitchData the stitches, already sized to the chart
+    @param x the name of the x attribute
+    @param y the name of the y attribute
+    @return the snap point
+    */
+static QPoint snapPoint(const QXmlStreamReader &reader, const StitchData &stitchData, const QString &x, const QString &y)
+{
+    QPoint point(snapAttribute(reader, x), snapAttribute(reader, y));
+
+    if (point.x() > stitchData.width() * 2 || point.y() > stitchData.height() * 2) {
+        throw FailedReadFile(QString(i18n("Invalid data read.")));
+    }
+
+    return point;
+}
+
+
+/**
+    Convert a palette index of the file to a color index of the document.
+    @param flosses the flosses of the document palette
+    @param palindex the palette index read, 0 being the cloth
+    @return the color index, -1 for the cloth
+    */
+static int colorIndex(const QMap<int, DocumentFloss *> &flosses, int palindex)
+{
+    if (palindex == 0) {
+        return -1;
+    }
+
+    if (!flosses.contains(palindex - 1)) {
+        throw FailedReadFile(QString(i18n("Invalid data read.")));
+    }
+
+    return palindex - 1;
+}
+
+
+/**
+    Write a coordinate in snap points as stitches.
+    */
+static QString snapValue(int value)
+{
+    return QString::number(value / 2.0);
+}
+
+
+/**
+    Read an OXS file into a document, replacing its contents.
+    @param document the document
+    @param device the device to read from
+    */
+void OXSFile::read(Document &document, QIODevice *device)
+{
+    document.initialiseNew();
+
+    QXmlStreamReader reader(device);
+
+    if (!reader.readNextStartElement() || reader.name() != QLatin1String("chart")) {
+        throw InvalidFile();
+    }
+
+    while (reader.readNextStartElement()) {
+        if (reader.name() == QLatin1String("properties")) {
+            readProperties(document, reader);
+        } else if (reader.name() == QLatin1String("palette")) {
+            readPalette(document, reader);
+        } else if (reader.name() == QLatin1String("fullstitches")) {
+            readFullStitches(document, reader);
+        } else if (reader.name() == QLatin1String("partstitches")) {
+            readPartStitches(document, reader);
+        } else if (reader.name() == QLatin1String("backstitches")) {
+            readBackstitches(document, reader);
+        } else if (reader.name() == QLatin1String("ornaments_inc_knots_and_beads")) {
+            readOrnaments(document, reader);
+        } else {
+            reader.skipCurrentElement();
+        }
+    }
+
+    if (reader.hasError()) {
+        throw FailedReadFile(reader.errorString());
+    }
+
+    document.pattern()->palette().setCurrentIndex(-1);
+}
+
+
+/**
+    Read the properties, resizing the pattern to the size of the chart.  The
+    cloth counts are always in stitches per inch.
+    */
+void OXSFile::readProperties(Document &document, QXmlStreamReader &reader)
+{
+    QXmlStreamAttributes attributes = reader.attributes();
+    int width = intAttribute(reader, QStringLiteral("chartwidth"));
+    int height = intAttribute(reader, QStringLiteral("chartheight"));
+
+    if (width < 1 || width > maxChartSize || height < 1 || height > maxChartSize) {
+        throw FailedReadFile(QString(i18n("Invalid data read.")));
+    }
+
+    document.pattern()->stitches().resize(width, height);
+    document.setProperty(QStringLiteral("unitsFormat"), Configuration::EnumDocument_UnitsFormat::Stitches);
+    document.setProperty(QStringLiteral("title"), attributes.value(QStringLiteral("charttitle")).toString());
+    document.setProperty(QStringLiteral("author"), attributes.value(QStringLiteral("author")).toString());
+    document.setProperty(QStringLiteral("copyright"), attributes.value(QStringLiteral("copyright")).toString());
+    document.setProperty(QStringLiteral("instructions"), attributes.value(QStringLiteral("instructions")).toString());
+
+    bool ok;
+    double horizontalClothCount = attributes.value(QStringLiteral("stitchesperinch")).toDouble(&ok);
+
+    if (ok && horizontalClothCount > 0) {
+        double verticalClothCount = attributes.value(QStringLiteral("stitchesperinch_y")).toDouble(&ok);
+        document.setProperty(QStringLiteral("horizontalClothCount"), horizontalClothCount);
+        document.setProperty(QStringLiteral("verticalClothCount"), (ok && verticalClothCount > 0) ? verticalClothCount : horizontalClothCount);
+        document.setProperty(QStringLiteral("clothCountUnits"), Configuration::EnumEditor_ClothCountUnits::Inches);
+    }
+
+    reader.skipCurrentElement();
+}
+
+
+/**
+    Read the palette.  The floss number is the scheme name followed by the
+    floss name, the scheme of the first floss with a known scheme becoming
+    the scheme of the document.  A floss not found in that scheme is replaced
+    by the nearest color of the scheme.  The symbols written by KXStitch are
+    indexes of the symbol library, any others are replaced by free symbols.
+    */
+void OXSFile::readPalette(Document &document, QXmlStreamReader &reader)
+{
+    DocumentPalette &palette = document.pattern()->palette();
+    QList<qint16> symbolIndexes = SymbolManager::library(palette.symbolLibrary())->indexes();
+    QSet<qint16> usedSymbols;
+    bool schemeFound = false;
+
+    while (reader.readNextStartElement()) {
+        if (reader.name() != QLatin1String("palette_item")) {
+            reader.skipCurrentElement();
+            continue;
+        }
+
+        QXmlStreamAttributes attributes = reader.attributes();
+        int index = intAttribute(reader, QStringLiteral("index"));
+        QColor color(QLatin1Char('#') + attributes.value(QStringLiteral("color")).toString());
+
+        if (index == 0) {
+            if (color.isValid()) {
+                document.setProperty(QStringLiteral("fabricColor"), color);
+            }
+
+            reader.skipCurrentElement();
+            continue;
+        }
+
+        if (index < 0 || palette.flosses().contains(index - 1)) {
+            throw FailedReadFile(QString(i18n("Invalid data read.")));
+        }
+
+        QString number = attributes.value(QStringLiteral("number")).toString().trimmed();
+        QString flossName = number;
+        int space = number.indexOf(QLatin1Char(' '));
+
+        if (space != -1 && SchemeManager::scheme(number.left(space))) {
+            if (!schemeFound) {
+                palette.setSchemeName(number.left(space));
+                schemeFound = true;
+            }
+
+            flossName = number.mid(space + 1);
+        }
+
+        FlossScheme *scheme = SchemeManager::scheme(palette.schemeName());
+        Floss *floss = scheme->find(flossName);
+
+        if (floss == nullptr && color.isValid()) {
+            floss = scheme->convert(color);
+        }
+
+        if (floss == nullptr) {
+            throw FailedReadFile(QString(i18n("The floss %1 was not found in the scheme %2", number, palette.schemeName())));
+        }
+
+        bool ok;
+        qint16 symbol = attributes.value(QStringLiteral("symbol")).toShort(&ok);
+
+        if (!ok || !symbolIndexes.contains(symbol) || usedSymbols.contains(symbol)) {
+            symbol = palette.freeSymbol();
+        }
+
+        usedSymbols.insert(symbol);
+
+        int stitchStrands = attributes.value(QStringLiteral("strands")).toInt(&ok);
+
+        if (!ok || stitchStrands < 1) {
+            stitchStrands = Configuration::palette_StitchStrands();
+        }
+
+        int backstitchStrands = attributes.value(QStringLiteral("bsstrands")).toInt(&ok);
+
+        if (!ok || backstitchStrands < 1) {
+            backstitchStrands = Configuration::palette_BackstitchStrands();
+        }
+
+        DocumentFloss *documentFloss = new DocumentFloss(floss->name(), symbol, Qt::SolidLine, stitchStrands, backstitchStrands);
+        documentFloss->setFlossColor(floss->color());
+        palette.add(index - 1, documentFloss);
+
+        reader.skipCurrentElement();
+    }
+}
+
+
+/**
+    Read the full stitches straight into the cells, a stitch in a cell already
+    holding stitches being merged with them.
+    */
+void OXSFile::readFullStitches(Document &document, QXmlStreamReader &reader)
+{
+    StitchData &stitchData = document.pattern()->stitches();
+    QMap<int, DocumentFloss *> flosses = document.pattern()->palette().flosses();
+    int width = stitchData.width();
+    int height = stitchData.height();
+
+    QVector<StitchQueue **> rows(height);
+
+    for (int y = 0 ; y < height ; ++y) {
+        rows[y] = stitchData.stitchQueueRow(y);
+    }
+
+    while (reader.readNextStartElement()) {
+        if (reader.name() == QLatin1String("stitch")) {
+            int x = intAttribute(reader, QStringLiteral("x"));
+            int y = intAttribute(reader, QStringLiteral("y"));
+            int color = colorIndex(flosses, intAttribute(reader, QStringLiteral("palindex")));
+
+            if (x < 0 || x >= width || y < 0 || y >= height) {
+                throw FailedReadFile(QString(i18n("Invalid data read.")));
+            }
+
+            if (color != -1) {
+                StitchQueue *&stitchQueue = rows.at(y)[x];
+
+                if (stitchQueue == nullptr) {
+                    stitchQueue = new StitchQueue;
+                    stitchQueue->enqueue(new Stitch(Stitch::Full, color));
+                } else {
+                    stitchQueue->add(Stitch::Full, color);
+                }
+            }
+        }
+
+        reader.skipCurrentElement();
+    }
+}
+
+
+/**
+    Read the fractional stitches, each part being merged into the cell as
+    the stitch given by PartStitchTypes.
+    */
+void OXSFile::readPartStitches(Document &document, QXmlStreamReader &reader)
+{
+    StitchData &stitchData = document.pattern()->stitches();
+    QMap<int, DocumentFloss *> flosses = document.pattern()->palette().flosses();
+
+    while (reader.readNextStartElement()) {
+        if (reader.name() == QLatin1String("partstitch")) {
+            int x = intAttribute(reader, QStringLiteral("x"));
+            int y = intAttribute(reader, QStringLiteral("y"));
+            int direction = intAttribute(reader, QStringLiteral("direction"));
+            int colors[2];
+            colors[0] = colorIndex(flosses, intAttribute(reader, QStringLiteral("palindex1")));
+            colors[1] = colorIndex(flosses, reader.attributes().hasAttribute(QStringLiteral("palindex2")) ? intAttribute(reader, QStringLiteral("palindex2")) : 0);
+
+            if (!stitchData.isValid(x, y) || direction < 1 || direction > 4) {
+                throw FailedReadFile(QString(i18n("Invalid data read.")));
+            }
+
+            for (int part = 0 ; part < 2 ; ++part) {
+                if (colors[part] != -1) {
+                    stitchData.addStitch(QPoint(x, y), PartStitchTypes[direction - 1][part], colors[part]);
+                }
+            }
+        }
+
+        reader.skipCurrentElement();
+    }
+}
+
+
+/**
+    Read the backstitches, the ends being in stitches with halves for the
+    centres of the cells.  The properties must have been read first, as ends
+    off the pattern are rejected.
+    */
+void OXSFile::readBackstitches(Document &document, QXmlStreamReader &reader)
+{
+    StitchData &stitchData = document.pattern()->stitches();
+    QMap<int, DocumentFloss *> flosses = document.pattern()->palette().flosses();
+
+    while (reader.readNextStartElement()) {
+        if (reader.name() == QLatin1String("backstitch")) {
+            QPoint start = snapPoint(reader, stitchData, QStringLiteral("x1"), QStringLiteral("y1"));
+            QPoint end = snapPoint(reader, stitchData, QStringLiteral("x2"), QStringLiteral("y2"));
+            int color = colorIndex(flosses, intAttribute(reader, QStringLiteral("palindex")));
+
+            if (color != -1 && start != end) {
+                stitchData.addBackstitch(start, end, color);
+            }
+        }
+
+        reader.skipCurrentElement();
+    }
+}
+
+
+/**
+    Read the ornaments, only the french knots are used.  Knots off the
+    pattern are rejected.
+    */
+void OXSFile::readOrnaments(Document &document, QXmlStreamReader &reader)
+{
+    StitchData &stitchData = document.pattern()->stitches();
+    QMap<int, DocumentFloss *> flosses = document.pattern()->palette().flosses();
+
+    while (reader.readNextStartElement()) {
+        if (reader.name() == QLatin1String("object") && reader.attributes().value(QStringLiteral("objecttype")) == QLatin1String("knot")) {
+            QPoint position = snapPoint(reader, stitchData, QStringLiteral("x1"), QStringLiteral("y1"));
+            int color = colorIndex(flosses, intAttribute(reader, QStringLiteral("palindex")));
+
+            if (color != -1) {
+                stitchData.addFrenchKnot(position, color);
+            }
+        }
+
+        reader.skipCurrentElement();
+    }
+}
+
+
+/**
+    Write a document as an OXS file.  The cells are visited twice, once for
+    the full stitches and once for the fractional stitches, so that each
+    section is written as it is found.  A pattern wider or taller than
+    maxChartSize is not written.
+    @param document the document
+    @param device the device to write to
+    */
+void OXSFile::write(Document &document, QIODevice *device)
+{
+    StitchData &stitchData = document.pattern()->stitches();
+    DocumentPalette &palette = document.pattern()->palette();
+    QMap<int, DocumentFloss *> flosses = palette.flosses();
+    FlossScheme *scheme = SchemeManager::scheme(palette.schemeName());
+    int width = stitchData.width();
+    int height = stitchData.height();
+
+    if (width > maxChartSize || height > maxChartSize) {
+        throw FailedWriteFile(QString(i18n("The pattern is larger than the %1 by %1 stitches that can be exported.", maxChartSize)));
+    }
+
+    double horizontalClothCount = document.property(QStringLiteral("horizontalClothCount")).toDouble();
+    double verticalClothCount = document.property(QStringLiteral("verticalClothCount")).toDouble();
+
+    if (static_cast<Configuration::EnumEditor_ClothCountUnits::type>(document.property(QStringLiteral("clothCountUnits")).toInt()) == Configuration::EnumEditor_ClothCountUnits::Centimeters) {
+        horizontalClothCount *= 2.54;
+        verticalClothCount *= 2.54;
+    }
+
+    QXmlStreamWriter writer(device);
+    writer.setAutoFormatting(true);
+    writer.writeStartDocument();
+    writer.writeStartElement(QStringLiteral("chart"));
+
+    writer.writeStartElement(QStringLiteral("format"));
+    writer.writeAttribute(QStringLiteral("comments01"), QStringLiteral("Open Cross Stitch format written by KXStitch"));
+    writer.writeEndElement();
+
+    writer.writeStartElement(QStringLiteral("properties"));
+    writer.writeAttribute(QStringLiteral("oxsversion"), QStringLiteral("1.0"));
+    writer.writeAttribute(QStringLiteral("software"), QStringLiteral("KXStitch"));
+    writer.writeAttribute(QStringLiteral("chartwidth"), QString::number(width));
+    writer.writeAttribute(QStringLiteral("chartheight"), QString::number(height));
+    writer.writeAttribute(QStringLiteral("charttitle"), document.property(QStringLiteral("title")).toString());
+    writer.writeAttribute(QStringLiteral("author"), document.property(QStringLiteral("author")).toString());
+    writer.writeAttribute(QStringLiteral("copyright"), document.property(QStringLiteral("copyright")).toString());
+    writer.writeAttribute(QStringLiteral("instructions"), document.property(QStringLiteral("instructions")).toString());
+    writer.writeAttribute(QStringLiteral("stitchesperinch"), QString::number(horizontalClothCount));
+    writer.writeAttribute(QStringLiteral("stitchesperinch_y"), QString::number(verticalClothCount));
+    writer.writeAttribute(QStringLiteral("palettecount"), QString::number(flosses.count()));
+    writer.writeEndElement();
+
+    // the flosses are numbered from 1 in the order of their color index
+    QHash<int, int> palindexes;
+    QString fabricColor = document.property(QStringLiteral("fabricColor")).value<QColor>().name().mid(1).toUpper();
+
+    writer.writeStartElement(QStringLiteral("palette"));
+    writer.writeStartElement(QStringLiteral("palette_item"));
+    writer.writeAttribute(QStringLiteral("index"), QStringLiteral("0"));
+    writer.writeAttribute(QStringLiteral("number"), QStringLiteral("cloth"));
+    writer.writeAttribute(QStringLiteral("name"), QStringLiteral("cloth"));
+    writer.writeAttribute(QStringLiteral("color"), fabricColor);
+    writer.writeEndElement();
+
+    for (QMap<int, DocumentFloss *>::const_iterator i = flosses.constBegin() ; i != flosses.constEnd() ; ++i) {
+        const DocumentFloss *documentFloss = i.value();
+        const Floss *floss = (scheme) ? scheme->find(documentFloss->flossName()) : nullptr;
+        int palindex = palindexes.count() + 1;
+        palindexes.insert(i.key(), palindex);
+
+        writer.writeStartElement(QStringLiteral("palette_item"));
+        writer.writeAttribute(QStringLiteral("index"), QString::number(palindex));
+        writer.writeAttribute(QStringLiteral("number"), palette.schemeName() + QLatin1Char(' ') + documentFloss->flossName());
+        writer.writeAttribute(QStringLiteral("name"), (floss) ? floss->description() : documentFloss->flossName());
+        writer.writeAttribute(QStringLiteral("color"), documentFloss->flossColor().name().mid(1).toUpper());
+        writer.writeAttribute(QStringLiteral("symbol"), QString::number(documentFloss->stitchSymbol()));
+        writer.writeAttribute(QStringLiteral("strands"), QString::number(documentFloss->stitchStrands()));
+        writer.writeAttribute(QStringLiteral("bsstrands"), QString::number(documentFloss->backstitchStrands()));
+        writer.writeEndElement();
+    }
+
+    writer.writeEndElement();
+
+    writer.writeStartElement(QStringLiteral("fullstitches"));
+
+    for (int y = 0 ; y < height ; ++y) {
+        StitchQueue **row = stitchData.stitchQueueRow(y);
+
+        for (int x = 0 ; x < width ; ++x) {
+            if (row[x] == nullptr) {
+                continue;
+            }
+
+            foreach (const Stitch *stitch, *row[x]) {
+                if (stitch->type == Stitch::Full) {
+                    writer.writeStartElement(QStringLiteral("stitch"));
+                    writer.writeAttribute(QStringLiteral("x"), QString::number(x));
+                    writer.writeAttribute(QStringLiteral("y"), QString::number(y));
+                    writer.writeAttribute(QStringLiteral("palindex"), QString::number(palindexes.value(stitch->colorIndex)));
+                    writer.writeEndElement();
+                }
+            }
+        }
+    }
+
+    writer.writeEndElement();
+
+    writer.writeStartElement(QStringLiteral("partstitches"));
+
+    for (int y = 0 ; y < height ; ++y) {
+        StitchQueue **row = stitchData.stitchQueueRow(y);
+
+        for (int x = 0 ; x < width ; ++x) {
+            if (row[x] == nullptr) {
+                continue;
+            }
+
+            // the palette indexes of each part of each direction, parts of different colors being paired into one partstitch
+            QVector<int> parts[4][2];
+
+            foreach (const Stitch *stitch, *row[x]) {
+                // the mini stitches have the high bits set
+                if (stitch->type == Stitch::Full || (stitch->type & 192)) {
+                    continue;
+                }
+
+                int palindex = palindexes.value(stitch->colorIndex);
+                int quarters = stitch->type;
+
+                // whole triangles first, then the quarters left, a pair of opposite quarters being a half stitch
+                for (int direction = 0 ; direction < 4 ; ++direction) {
+                    for (int part = 0 ; part < 2 ; ++part) {
+                        int type = PartStitchTypes[direction][part];
+
+                        if ((quarters & type) == type) {
+                            parts[direction][part].append(palindex);
+                            quarters &= ~type;
+                        }
+                    }
+                }
+            }
+
+            for (int direction = 0 ; direction < 4 ; ++direction) {
+                for (int i = 0 ; i < std::max(parts[direction][0].count(), parts[direction][1].count()) ; ++i) {
+                    writer.writeStartElement(QStringLiteral("partstitch"));
+                    writer.writeAttribute(QStringLiteral("x"), QString::number(x));
+                    writer.writeAttribute(QStringLiteral("y"), QString::number(y));
+                    writer.writeAttribute(QStringLiteral("palindex1"), QString::number(parts[direction][0].value(i)));
+                    writer.writeAttribute(QStringLiteral("palindex2"), QString::number(parts[direction][1].value(i)));
+                    writer.writeAttribute(QStringLiteral("direction"), QString::number(direction + 1));
+                    writer.writeEndElement();
+                }
+            }
+        }
+    }
+
+    writer.writeEndElement();
+
+    writer.writeStartElement(QStringLiteral("backstitches"));
+
+    foreach (const Backstitch *backstitch, stitchData.backstitches()) {
+        writer.writeStartElement(QStringLiteral("backstitch"));
+        writer.writeAttribute(QStringLiteral("x1"), snapValue(backstitch->start.x()));
+        writer.writeAttribute(QStringLiteral("y1"), snapValue(backstitch->start.y()));
+        writer.writeAttribute(QStringLiteral("x2"), snapValue(backstitch->end.x()));
+        writer.writeAttribute(QStringLiteral("y2"), snapValue(backstitch->end.y()));
+        writer.writeAttribute(QStringLiteral("palindex"), QString::number(palindexes.value(backstitch->colorIndex)));
+        writer.writeAttribute(QStringLiteral("objecttype"), QStringLiteral("backstitch"));
+        writer.writeEndElement();
+    }
+
+    writer.writeEndElement();
+
+    writer.writeStartElement(QStringLiteral("ornaments_inc_knots_and_beads"));
+
+    foreach (const Knot *knot, stitchData.knots()) {
+        writer.writeStartElement(QStringLiteral("object"));
+        writer.writeAttribute(QStringLiteral("objecttype"), QStringLiteral("knot"));
+        writer.writeAttribute(QStringLiteral("x1"), snapValue(knot->position.x()));
+        writer.writeAttribute(QStringLiteral("y1"), snapValue(knot->position.y()));
+        writer.writeAttribute(QStringLiteral("palindex"), QString::number(palindexes.value(knot->colorIndex)));
+        writer.writeEndElement();
+    }
+
+    writer.writeEndElement();
+
+    writer.writeEndElement();
+    writer.writeEndDocument();
+
+    if (writer.hasError()) {
+        throw FailedWriteFile(QDataStream::WriteFailed);
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef OXSFile_H
+#define OXSFile_H
+
+
+class QIODevice;
+class QXmlStreamReader;
+
+class Document;
+
+
+/**
+    Read and write patterns in the Open Cross Stitch (OXS) XML format used to
+    exchange patterns with other cross stitch programs.
+    The palette, full and fractional stitches, backstitches and french knots
+    are exchanged, the other document settings are not.  Both directions are
+    streamed with QXmlStreamWriter and QXmlStreamReader, an element at a time,
+    so the memory used apart from the document does not depend on the size of
+    the pattern.  The full stitches read are placed straight into the cells.
+    Palette index 0 is the cloth, the flosses being numbered from 1.  A
+    partstitch splits a cell into two parts, the direction giving the split
+    and palindex1 and palindex2 the colors of the parts, 0 for none.  The
+    three quarter, half and quarter stitches are mapped onto the parts as
+    described for PartStitchTypes in OXSFile.cpp, the parts of a color being
+    merged back into the stitch when read.  The mini stitches have no
+    equivalent and are not written.
+    */
+class OXSFile
+{
+public:
+    static void read(Document &, QIODevice *);
+    static void write(Document &, QIODevice *);
+
+private:
+    static void readProperties(Document &, QXmlStreamReader &);
+    static void readPalette(Document &, QXmlStreamReader &);
+    static void readFullStitches(Document &, QXmlStreamReader &);
+    static void readPartStitches(Document &, QXmlStreamReader &);
+    static void readBackstitches(Document &, QXmlStreamReader &);
+    static void readOrnaments(Document &, QXmlStreamReader &);
+};
+
+
+#endif // OXSFile_H
@@ -17,6 +17,7 @@
 #include <QStyleOptionRubberBand>
 
 #include "configuration.h"
+#include "CommandStatistics.h"
 #include "Document.h"
 
 
@@ -120,6 +121,7 @@ void Preview::drawContents()
     painter.setWindow(0, 0, m_document->pattern()->stitches().width(), m_document->pattern()->stitches().height());
 
     m_renderer.render(&painter, m_document->pattern(), painter.window(), false, true, true, true, -1);
+    CommandStatistics::redrawn(painter.window());
 
     painter.end();
     update();
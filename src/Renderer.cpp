@@ -312,12 +312,15 @@ void Renderer::render(QPainter *painter,
         }
     }
 
+    // read only access leaves the color usage index of the stitches intact
+    const StitchData &stitchData = pattern->stitches();
+
     if (renderStitches) {
         QTransform transform = painter->transform();
 
         for (int y = patternTop ; y <= patternBottom ; ++y) {
             for (int x = patternLeft ; x <= patternRight ; ++x) {
-                if (StitchQueue *queue = pattern->stitches().stitchQueueAt(QPoint(x, y))) {
+                if (const StitchQueue *queue = stitchData.stitchQueueAt(QPoint(x, y))) {
                     painter->translate(x, y);
                     (this->*renderStitchCallPointers[d->m_renderStitchesAs])(queue);
                     painter->setTransform(transform);
@@ -327,7 +330,7 @@ void Renderer::render(QPainter *painter,
     }
 
     if (renderBackstitches) {
-        QList<Backstitch*> backstitches = pattern->stitches().backstitches();
+        QList<Backstitch*> backstitches = stitchData.backstitches();
 
         for (int i = 0 ; i < backstitches.count() ; ++i) {
             (this->*renderBackstitchCallPointers[d->m_renderBackstitchesAs])(backstitches.at(i));
@@ -335,7 +338,7 @@ void Renderer::render(QPainter *painter,
     }
 
     if (renderKnots) {
-        QList<Knot*> knots = pattern->stitches().knots();
+        QList<Knot*> knots = stitchData.knots();
 
         for (int i = 0 ; i < knots.count() ; ++i) {
             (this->*renderKnotCallPointers[d->m_renderKnotsAs])(knots.at(i));
@@ -346,7 +349,7 @@ void Renderer::render(QPainter *painter,
 }
 
 
-void Renderer::renderStitchesAsStitches(StitchQueue *stitchQueue)
+void Renderer::renderStitchesAsStitches(const StitchQueue *stitchQueue)
 {
     QPen pen(Qt::lightGray, 0, Qt::SolidLine, Qt::RoundCap);
 
@@ -462,7 +465,7 @@ void Renderer::renderStitchesAsStitches(StitchQueue *stitchQueue)
 }
 
 
-void Renderer::renderStitchesAsBlackWhiteSymbols(StitchQueue *stitchQueue)
+void Renderer::renderStitchesAsBlackWhiteSymbols(const StitchQueue *stitchQueue)
 {
     int i = stitchQueue->count();
 
@@ -493,7 +496,7 @@ void Renderer::renderStitchesAsBlackWhiteSymbols(StitchQueue *stitchQueue)
 }
 
 
-void Renderer::renderStitchesAsColorSymbols(StitchQueue *stitchQueue)
+void Renderer::renderStitchesAsColorSymbols(const StitchQueue *stitchQueue)
 {
     int i = stitchQueue->count();
 
@@ -525,7 +528,7 @@ void Renderer::renderStitchesAsColorSymbols(StitchQueue *stitchQueue)
 }
 
 
-void Renderer::renderStitchesAsColorBlocks(StitchQueue *stitchQueue)
+void Renderer::renderStitchesAsColorBlocks(const StitchQueue *stitchQueue)
 {
     QBrush blockBrush(Qt::SolidPattern);
 
@@ -635,7 +638,7 @@ void Renderer::renderStitchesAsColorBlocks(StitchQueue *stitchQueue)
 }
 
 
-void Renderer::renderStitchesAsColorBlocksSymbols(StitchQueue *stitchQueue)
+void Renderer::renderStitchesAsColorBlocksSymbols(const StitchQueue *stitchQueue)
 {
     QBrush blockBrush(Qt::SolidPattern);
 
@@ -58,7 +58,7 @@ public:
     Renderer &operator=(const Renderer &);
 
 private:
-    typedef void (Renderer::*renderStitchCallPointer)(StitchQueue *);
+    typedef void (Renderer::*renderStitchCallPointer)(const StitchQueue *);
     typedef void (Renderer::*renderBackstitchCallPointer)(Backstitch *);
     typedef void (Renderer::*renderKnotCallPointer)(Knot *);
 
@@ -66,11 +66,11 @@ private:
     static const renderBackstitchCallPointer renderBackstitchCallPointers[];
     static const renderKnotCallPointer renderKnotCallPointers[];
 
-    void renderStitchesAsStitches(StitchQueue *);
-    void renderStitchesAsBlackWhiteSymbols(StitchQueue *);
-    void renderStitchesAsColorSymbols(StitchQueue *);
-    void renderStitchesAsColorBlocks(StitchQueue *);
-    void renderStitchesAsColorBlocksSymbols(StitchQueue *);
+    void renderStitchesAsStitches(const StitchQueue *);
+    void renderStitchesAsBlackWhiteSymbols(const StitchQueue *);
+    void renderStitchesAsColorSymbols(const StitchQueue *);
+    void renderStitchesAsColorBlocks(const StitchQueue *);
+    void renderStitchesAsColorBlocksSymbols(const StitchQueue *);
     void renderStitchHints(Stitch *);
 
     void renderBackstitchesAsColorLines(Backstitch *);
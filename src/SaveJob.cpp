@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include "SaveJob.h"
+
+#include <QDataStream>
+#include <QSaveFile>
+
+#include "Document.h"
+#include "Exceptions.h"
+
+
+/**
+    Constructor.
+    @param snapshot a snapshot of the document created by Document::snapshot, the job takes ownership of it
+    @param fileName the local file to save to
+    @param parent the parent object
+    */
+SaveJob::SaveJob(Document *snapshot, const QString &fileName, QObject *parent)
+    :   QThread(parent),
+        m_snapshot(snapshot),
+        m_fileName(fileName),
+        m_saved(false)
+{
+}
+
+
+SaveJob::~SaveJob()
+{
+    wait();
+    delete m_snapshot;
+}
+
+
+QString SaveJob::fileName() const
+{
+    return m_fileName;
+}
+
+
+/**
+    Get the result of the save, only valid once the job has finished.
+    @return true if the file was written and committed, false otherwise
+    */
+bool SaveJob::isSaved() const
+{
+    return m_saved;
+}
+
+
+/**
+    Get the reason the save failed, only valid once the job has finished.
+    @return a QString describing the error, empty if the file was saved
+    */
+QString SaveJob::errorString() const
+{
+    return m_errorString;
+}
+
+
+void SaveJob::run()
+{
+    QSaveFile file(m_fileName);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_errorString = file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+
+    try {
+        m_snapshot->write(stream, [this](int percent) {
+            emit progress(percent);
+        });
+
+        if (!file.commit()) {
+            throw FailedWriteFile(stream.status());
+        }
+
+        m_saved = true;
+    } catch (const FailedWriteFile &e) {
+        // the file has no error if the stream failed before anything was written to it
+        m_errorString = (file.error() == QFileDevice::NoError) ? e.statusMessage() : QStringLiteral("%1\n%2").arg(e.statusMessage(), file.errorString());
+        file.cancelWriting();
+    }
+}
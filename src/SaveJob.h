@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef SaveJob_H
+#define SaveJob_H
+
+
+#include <QString>
+#include <QThread>
+
+
+class Document;
+
+
+/**
+    Save a document on a worker thread.
+    The job is given a snapshot of the document taken on the GUI thread, so
+    the document can be edited while the snapshot is streamed and committed
+    to the file.  The snapshot is owned by the job and deleted with it, so
+    the job must be deleted on the GUI thread.
+    */
+class SaveJob : public QThread
+{
+    Q_OBJECT
+
+public:
+    SaveJob(Document *, const QString &, QObject *parent = nullptr);
+    virtual ~SaveJob();
+
+    QString fileName() const;
+    bool isSaved() const;
+    QString errorString() const;
+
+signals:
+    void progress(int);
+
+protected:
+    virtual void run() Q_DECL_OVERRIDE;
+
+private:
+    Document    *m_snapshot;
+    QString     m_fileName;
+    bool        m_saved;
+    QString     m_errorString;
+};
+
+
+#endif // SaveJob_H
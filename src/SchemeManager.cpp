@@ -151,6 +151,7 @@ FlossScheme *SchemeManager::readScheme(QString name)
         flossScheme = nullptr;
     } else {
         flossScheme->setPath(name);
+        flossScheme->createIndex();
     }
 
     return flossScheme;
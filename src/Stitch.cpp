@@ -94,7 +94,7 @@ StitchQueue::~StitchQueue()
 }
 
 
-StitchQueue::StitchQueue(StitchQueue *stitchQueue)
+StitchQueue::StitchQueue(const StitchQueue *stitchQueue)
 {
     QListIterator<Stitch *> stitchIterator(*stitchQueue);
 
@@ -62,7 +62,7 @@ class StitchQueue : public QQueue<Stitch *>
 {
 public:
     StitchQueue();
-    explicit StitchQueue(StitchQueue *);
+    explicit StitchQueue(const StitchQueue *);
     ~StitchQueue();
 
     int add(Stitch::Type, int);
@@ -11,6 +11,14 @@
 
 #include "StitchData.h"
 
+#include <QByteArray>
+#include <QDataStream>
+#include <QtAlgorithms>
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <iterator>
+
 #include <KLocalizedString>
 
 #include "Exceptions.h"
@@ -59,9 +67,122 @@ int FlossUsage::stitchCount() const
 }
 
 
+bool ColorUsage::isEmpty() const
+{
+    return cells.isEmpty() && overflow.isEmpty() && backstitches.isEmpty() && knots.isEmpty();
+}
+
+
+/**
+    Merge two ascending vectors of entries.
+    @param entries the entries to merge into
+    @param other the entries to merge
+    */
+template <typename T>
+static void uniteEntries(QVector<T> &entries, const QVector<T> &other)
+{
+    QVector<T> united;
+    united.reserve(entries.count() + other.count());
+    std::set_union(entries.constBegin(), entries.constEnd(), other.constBegin(), other.constEnd(), std::back_inserter(united));
+    entries.swap(united);
+}
+
+
+/**
+    Remove the entries of an ascending vector from another.
+    @param entries the entries to remove from
+    @param other the entries to remove
+    */
+template <typename T>
+static void subtractEntries(QVector<T> &entries, const QVector<T> &other)
+{
+    QVector<T> remaining;
+    remaining.reserve(entries.count());
+    std::set_difference(entries.constBegin(), entries.constEnd(), other.constBegin(), other.constEnd(), std::back_inserter(remaining));
+    entries.swap(remaining);
+}
+
+
+/**
+    Add the items of another usage to this one, used to move the usage of a
+    color to the color replacing it.
+    @param other the usage to add
+    */
+void ColorUsage::unite(const ColorUsage &other)
+{
+    QVector<int> unitedCells;
+    QVector<quint32> unitedPositions;
+    unitedCells.reserve(cells.count() + other.cells.count());
+    unitedPositions.reserve(cells.count() + other.cells.count());
+
+    int i = 0;
+    int j = 0;
+
+    while (i < cells.count() || j < other.cells.count()) {
+        if (j == other.cells.count() || (i < cells.count() && cells.at(i) < other.cells.at(j))) {
+            unitedCells.append(cells.at(i));
+            unitedPositions.append(positions.at(i++));
+        } else if (i == cells.count() || other.cells.at(j) < cells.at(i)) {
+            unitedCells.append(other.cells.at(j));
+            unitedPositions.append(other.positions.at(j++));
+        } else {
+            unitedCells.append(cells.at(i));
+            unitedPositions.append(positions.at(i++) | other.positions.at(j++));
+        }
+    }
+
+    cells.swap(unitedCells);
+    positions.swap(unitedPositions);
+    uniteEntries(overflow, other.overflow);
+    uniteEntries(backstitches, other.backstitches);
+    uniteEntries(knots, other.knots);
+}
+
+
+/**
+    Remove the items of another usage from this one, used to move the usage of
+    a color to the color replacing it.
+    @param other the usage to remove
+    */
+void ColorUsage::subtract(const ColorUsage &other)
+{
+    QVector<int> remainingCells;
+    QVector<quint32> remainingPositions;
+    remainingCells.reserve(cells.count());
+    remainingPositions.reserve(cells.count());
+
+    int j = 0;
+
+    for (int i = 0 ; i < cells.count() ; ++i) {
+        while (j < other.cells.count() && other.cells.at(j) < cells.at(i)) {
+            ++j;
+        }
+
+        quint32 remaining = positions.at(i);
+
+        if (j < other.cells.count() && other.cells.at(j) == cells.at(i)) {
+            remaining &= ~other.positions.at(j);
+        }
+
+        if (remaining) {
+            remainingCells.append(cells.at(i));
+            remainingPositions.append(remaining);
+        }
+    }
+
+    cells.swap(remainingCells);
+    positions.swap(remainingPositions);
+    subtractEntries(overflow, other.overflow);
+    subtractEntries(backstitches, other.backstitches);
+    subtractEntries(knots, other.knots);
+}
+
+
 StitchData::StitchData()
     :   m_width(0),
-        m_height(0)
+        m_height(0),
+        m_encoded(false),
+        m_colorUsageValid(false)
 {
 }
 
@@ -74,6 +195,8 @@ StitchData::~StitchData()
 
 void StitchData::clear()
 {
+    m_colorUsageValid = false;
+
     qDeleteAll(m_stitches);
     m_stitches.fill(nullptr);
 
@@ -82,6 +205,25 @@ void StitchData::clear()
 
     qDeleteAll(m_knots);
     m_knots.clear();
+
+    m_encoded = false;
+    m_encodedStitches.clear();
+    m_encodedLines.clear();
+}
+
+
+void StitchData::swap(StitchData &other)
+{
+    std::swap(m_width, other.m_width);
+    std::swap(m_height, other.m_height);
+    m_stitches.swap(other.m_stitches);
+    m_backstitches.swap(other.m_backstitches);
+    m_knots.swap(other.m_knots);
+    std::swap(m_encoded, other.m_encoded);
+    m_encodedStitches.swap(other.m_encodedStitches);
+    m_encodedLines.swap(other.m_encodedLines);
+    m_colorUsage.swap(other.m_colorUsage);
+    std::swap(m_colorUsageValid, other.m_colorUsageValid);
 }
 
 
@@ -99,6 +241,8 @@ int StitchData::height() const
 
 void StitchData::resize(int width, int height)
 {
+    m_colorUsageValid = false;
+
     QVector<StitchQueue *> newVector(width * height);
     QRect extentsRect = extents();
 
@@ -116,6 +260,8 @@ void StitchData::resize(int width, int height)
 
 void StitchData::insertColumns(int startColumn, int columns)
 {
+    m_colorUsageValid = false;
+
     int originalWidth = m_width;
 
     resize(originalWidth + columns, m_height);
@@ -157,6 +303,8 @@ void StitchData::insertColumns(int startColumn, int columns)
 
 void StitchData::insertRows(int startRow, int rows)
 {
+    m_colorUsageValid = false;
+
     int originalHeight = m_height;
 
     resize(m_width, originalHeight + rows);
@@ -198,6 +346,8 @@ void StitchData::insertRows(int startRow, int rows)
 
 void StitchData::removeColumns(int startColumn, int columns)
 {
+    m_colorUsageValid = false;
+
     for (int y = 0 ; y < m_height ; ++y) {
         for (int destinationColumn = startColumn, sourceColumn = startColumn + columns ; sourceColumn < m_width ; ++destinationColumn, ++sourceColumn) {
             m_stitches[index(destinationColumn, y)] = takeStitchQueueAt(sourceColumn, y);
@@ -237,6 +387,8 @@ void StitchData::removeColumns(int startColumn, int columns)
 
 void StitchData::removeRows(int startRow, int rows)
 {
+    m_colorUsageValid = false;
+
     for (int destinationRow = startRow, sourceRow = startRow + rows ; sourceRow < m_height ; ++destinationRow, ++sourceRow) {
         for (int x = 0 ; x < m_width ; ++x) {
             m_stitches[index(x, destinationRow)] = takeStitchQueueAt(x, sourceRow);
@@ -312,6 +464,8 @@ QRect StitchData::extents() const
 
 void StitchData::movePattern(int dx, int dy)
 {
+    m_colorUsageValid = false;
+
     QRect extentsRect = extents();
 
     QVector<StitchQueue *> newVector(m_width * m_height);
@@ -343,6 +497,8 @@ void StitchData::movePattern(int dx, int dy)
 
 void StitchData::mirror(Qt::Orientation orientation)
 {
+    m_colorUsageValid = false;
+
     int rows = m_height;
     int cols = m_width;
 
@@ -410,6 +566,8 @@ void StitchData::mirror(Qt::Orientation orientation)
 
 void StitchData::rotate(Rotation rotation)
 {
+    m_colorUsageValid = false;
+
     int rows = m_height;
     int cols = m_width;
 
@@ -648,6 +806,8 @@ bool StitchData::isValid(int x, int y) const
 
 void StitchData::addStitch(const QPoint &position, Stitch::Type type, int colorIndex)
 {
+    m_colorUsageValid = false;
+
     int i = index(position);
     StitchQueue *stitchQueue = m_stitches.at(i);
 
@@ -662,6 +822,8 @@ void StitchData::addStitch(const QPoint &position, Stitch::Type type, int colorI
 
 Stitch *StitchData::findStitch(const QPoint &cell, Stitch::Type type, int colorIndex)
 {
+    m_colorUsageValid = false;
+
     StitchQueue *stitchQueue = stitchQueueAt(cell);
     Stitch *found = nullptr;
 
@@ -677,6 +839,8 @@ Stitch *StitchData::findStitch(const QPoint &cell, Stitch::Type type, int colorI
 
 void StitchData::deleteStitch(const QPoint &position, Stitch::Type type, int colorIndex)
 {
+    m_colorUsageValid = false;
+
     int i = index(position);
     StitchQueue *stitchQueue = m_stitches.at(i);
 
@@ -691,6 +855,8 @@ void StitchData::deleteStitch(const QPoint &position, Stitch::Type type, int col
 
 StitchQueue *StitchData::stitchQueueAt(int x, int y)
 {
+    m_colorUsageValid = false;
+
     StitchQueue *stitchQueue = nullptr;
 
     if (isValid(x, y)) {
@@ -707,8 +873,28 @@ StitchQueue *StitchData::stitchQueueAt(const QPoint &position)
 }
 
 
+const StitchQueue *StitchData::stitchQueueAt(int x, int y) const
+{
+    const StitchQueue *stitchQueue = nullptr;
+
+    if (isValid(x, y)) {
+        stitchQueue = m_stitches.at(index(x, y));
+    }
+
+    return stitchQueue;
+}
+
+
+const StitchQueue *StitchData::stitchQueueAt(const QPoint &position) const
+{
+    return stitchQueueAt(position.x(), position.y());
+}
+
+
 StitchQueue *StitchData::takeStitchQueueAt(int x, int y)
 {
+    m_colorUsageValid = false;
+
     StitchQueue *stitchQueue = stitchQueueAt(x, y);
 
     if (stitchQueue) {
@@ -727,6 +913,8 @@ StitchQueue *StitchData::takeStitchQueueAt(const QPoint &position)
 
 StitchQueue *StitchData::replaceStitchQueueAt(int x, int y, StitchQueue *stitchQueue)
 {
+    m_colorUsageValid = false;
+
     StitchQueue *originalQueue = takeStitchQueueAt(x, y);
 
     if (isValid(x, y)) {
@@ -743,20 +931,56 @@ StitchQueue *StitchData::replaceStitchQueueAt(const QPoint &position, StitchQueu
 }
 
 
+/**
+    Get the stitch queues of a row of cells for bulk updates.  Different rows may
+    be updated from different threads as long as the row pointers are all taken
+    beforehand on one thread and the StitchData is not resized meanwhile.  A queue
+    replaced through the pointer must be deleted by the caller.
+    @param y the row
+    @return a pointer to the width() stitch queues of the row, null for empty cells
+    */
+StitchQueue **StitchData::stitchQueueRow(int y)
+{
+    m_colorUsageValid = false;
+
+    return m_stitches.data() + index(0, y);
+}
+
+
 void StitchData::addBackstitch(const QPoint &start, const QPoint &end, int colorIndex)
 {
+    m_colorUsageValid = false;
+
     m_backstitches.append(new Backstitch(start, end, colorIndex));
 }
 
 
 void StitchData::addBackstitch(Backstitch *backstitch)
 {
+    m_colorUsageValid = false;
+
     m_backstitches.append(backstitch);
 }
 
 
+/**
+    Insert a backstitch at a position in the list, used to put back a deleted
+    backstitch where it was so the order of the list is restored.
+    @param i the position in the list
+    @param backstitch a pointer to the Backstitch
+    */
+void StitchData::insertBackstitch(int i, Backstitch *backstitch)
+{
+    m_colorUsageValid = false;
+
+    m_backstitches.insert(i, backstitch);
+}
+
+
 Backstitch *StitchData::findBackstitch(const QPoint &start, const QPoint &end, int colorIndex)
 {
+    m_colorUsageValid = false;
+
     Backstitch *found = nullptr;
 
     foreach (Backstitch *backstitch, m_backstitches) {
@@ -772,6 +996,8 @@ Backstitch *StitchData::findBackstitch(const QPoint &start, const QPoint &end, i
 
 Backstitch *StitchData::takeBackstitch(const QPoint &start, const QPoint &end, int colorIndex)
 {
+    m_colorUsageValid = false;
+
     Backstitch *removed = findBackstitch(start, end, colorIndex);
     m_backstitches.removeOne(removed);
 
@@ -781,6 +1007,8 @@ Backstitch *StitchData::takeBackstitch(const QPoint &start, const QPoint &end, i
 
 Backstitch *StitchData::takeBackstitch(Backstitch *backstitch)
 {
+    m_colorUsageValid = false;
+
     Backstitch *removed = nullptr;
 
     if (m_backstitches.removeOne(backstitch)) {
@@ -793,18 +1021,38 @@ Backstitch *StitchData::takeBackstitch(Backstitch *backstitch)
 
 void StitchData::addFrenchKnot(const QPoint &position, int colorIndex)
 {
+    m_colorUsageValid = false;
+
     m_knots.append(new Knot(position, colorIndex));
 }
 
 
 void StitchData::addFrenchKnot(Knot *knot)
 {
+    m_colorUsageValid = false;
+
     m_knots.append(knot);
 }
 
 
+/**
+    Insert a knot at a position in the list, used to put back a deleted knot
+    where it was so the order of the list is restored.
+    @param i the position in the list
+    @param knot a pointer to the Knot
+    */
+void StitchData::insertFrenchKnot(int i, Knot *knot)
+{
+    m_colorUsageValid = false;
+
+    m_knots.insert(i, knot);
+}
+
+
 Knot *StitchData::findKnot(const QPoint &position, int colorIndex)
 {
+    m_colorUsageValid = false;
+
     Knot *found = nullptr;
 
     foreach (Knot *knot, m_knots) {
@@ -820,6 +1068,8 @@ Knot *StitchData::findKnot(const QPoint &position, int colorIndex)
 
 Knot *StitchData::takeFrenchKnot(const QPoint &position, int colorIndex)
 {
+    m_colorUsageValid = false;
+
     Knot *removed = findKnot(position, colorIndex);
 
     if (removed) {
@@ -832,6 +1082,8 @@ Knot *StitchData::takeFrenchKnot(const QPoint &position, int colorIndex)
 
 Knot *StitchData::takeFrenchKnot(Knot *knot)
 {
+    m_colorUsageValid = false;
+
     Knot *removed = nullptr;
 
     if (m_knots.removeOne(knot)) {
@@ -844,11 +1096,27 @@ Knot *StitchData::takeFrenchKnot(Knot *knot)
 
 QList<Backstitch *> &StitchData::backstitches()
 {
+    m_colorUsageValid = false;
+
     return m_backstitches;
 }
 
 
 QList<Knot *> &StitchData::knots()
+{
+    m_colorUsageValid = false;
+
+    return m_knots;
+}
+
+
+const QList<Backstitch *> &StitchData::backstitches() const
+{
+    return m_backstitches;
+}
+
+
+const QList<Knot *> &StitchData::knots() const
 {
     return m_knots;
 }
@@ -856,24 +1124,32 @@ QList<Knot *> &StitchData::knots()
 
 QListIterator<Backstitch *> StitchData::backstitchIterator()
 {
+    m_colorUsageValid = false;
+
     return QListIterator<Backstitch *>(m_backstitches);
 }
 
 
 QMutableListIterator<Backstitch *> StitchData::mutableBackstitchIterator()
 {
+    m_colorUsageValid = false;
+
     return QMutableListIterator<Backstitch *>(m_backstitches);
 }
 
 
 QListIterator<Knot *> StitchData::knotIterator()
 {
+    m_colorUsageValid = false;
+
     return QListIterator<Knot *>(m_knots);
 }
 
 
 QMutableListIterator<Knot *> StitchData::mutableKnotIterator()
 {
+    m_colorUsageValid = false;
+
     return QMutableListIterator<Knot *>(m_knots);
 }
 
@@ -944,33 +1220,359 @@ QMap<int, FlossUsage> StitchData::flossUsage()
 }
 
 
-QDataStream &operator<<(QDataStream &stream, const StitchData &stitchData)
+/**
+    Get where a color is used.
+    @param colorIndex the index of the color
+    @return the usage of the color, empty if it is not used
+    */
+ColorUsage StitchData::colorUsage(int colorIndex) const
 {
-    stream << qint32(stitchData.version);
-    stream << qint32(stitchData.m_width);
-    stream << qint32(stitchData.m_height);
+    return colorUsage().value(colorIndex);
+}
 
-    QVectorIterator<StitchQueue *> stitchesIterator(stitchData.m_stitches);
-    int queues = 0;
 
-    while (stitchesIterator.hasNext()) {
-        if (stitchesIterator.next()) {
-            ++queues;
+/**
+    Get where every color is used.  The index is built by a single pass over
+    the stitches the first time it is needed after they have been changed and
+    recolor keeps it up to date, so replacing several colors in turn only
+    scans the stitches once.
+    @return a hash of the usage keyed by color index, containing only the
+    colors used
+    */
+QHash<int, ColorUsage> StitchData::colorUsage() const
+{
+    if (m_colorUsageValid) {
+        return m_colorUsage;
+    }
+
+    QHash<int, ColorUsage> usage;
+
+    for (int i = 0 ; i < m_stitches.count() ; ++i) {
+        if (const StitchQueue *stitchQueue = m_stitches.at(i)) {
+            for (int position = 0 ; position < stitchQueue->count() ; ++position) {
+                ColorUsage &colorUsage = usage[stitchQueue->at(position)->colorIndex];
+
+                if (position >= ColorUsage::maskPositions) {
+                    colorUsage.overflow.append(qMakePair(i, position));
+                    continue;
+                }
+
+                if (colorUsage.cells.isEmpty() || colorUsage.cells.last() != i) {
+                    colorUsage.cells.append(i);
+                    colorUsage.positions.append(0);
+                }
+
+                colorUsage.positions.last() |= (1u << position);
+            }
         }
     }
 
-    stream << qint32(queues);
+    for (int i = 0 ; i < m_backstitches.count() ; ++i) {
+        usage[m_backstitches.at(i)->colorIndex].backstitches.append(i);
+    }
+
+    for (int i = 0 ; i < m_knots.count() ; ++i) {
+        usage[m_knots.at(i)->colorIndex].knots.append(i);
+    }
+
+    m_colorUsage = usage;
+    m_colorUsageValid = true;
+
+    return usage;
+}
+
+
+/**
+    Change the color of the items in a usage index, moving them in the index
+    of every color from their current color to the new one.
+    @param usage the items to recolor, all of one color
+    @param colorIndex the index of the new color
+    */
+void StitchData::recolor(const ColorUsage &usage, int colorIndex)
+{
+    int originalIndex = -1;
+
+    if (!usage.cells.isEmpty()) {
+        originalIndex = m_stitches.at(usage.cells.first())->at(qCountTrailingZeroBits(usage.positions.first()))->colorIndex;
+    } else if (!usage.overflow.isEmpty()) {
+        originalIndex = m_stitches.at(usage.overflow.first().first)->at(usage.overflow.first().second)->colorIndex;
+    } else if (!usage.backstitches.isEmpty()) {
+        originalIndex = m_backstitches.at(usage.backstitches.first())->colorIndex;
+    } else if (!usage.knots.isEmpty()) {
+        originalIndex = m_knots.at(usage.knots.first())->colorIndex;
+    }
 
-    for (int row = 0 ; row < stitchData.m_height ; ++row) {
-        for (int column = 0 ; column < stitchData.m_width ; ++column) {
-            if (StitchQueue *stitchQueue = stitchData.m_stitches[stitchData.index(column, row)]) {
-                stream << qint32(column);
-                stream << qint32(row);
-                stream << *stitchQueue;
+    if (originalIndex == -1 || originalIndex == colorIndex) {
+        return;
+    }
+
+    for (int i = 0 ; i < usage.cells.count() ; ++i) {
+        StitchQueue *stitchQueue = m_stitches.at(usage.cells.at(i));
+        quint32 positions = usage.positions.at(i);
+
+        for (int position = 0 ; positions ; ++position, positions >>= 1) {
+            if (positions & 1) {
+                (*stitchQueue)[position]->colorIndex = colorIndex;
             }
         }
     }
 
+    for (int i = 0 ; i < usage.overflow.count() ; ++i) {
+        (*m_stitches.at(usage.overflow.at(i).first))[usage.overflow.at(i).second]->colorIndex = colorIndex;
+    }
+
+    foreach (int i, usage.backstitches) {
+        m_backstitches[i]->colorIndex = colorIndex;
+    }
+
+    foreach (int i, usage.knots) {
+        m_knots[i]->colorIndex = colorIndex;
+    }
+
+    if (m_colorUsageValid) {
+        ColorUsage &original = m_colorUsage[originalIndex];
+        original.subtract(usage);
+
+        if (original.isEmpty()) {
+            m_colorUsage.remove(originalIndex);
+        }
+
+        m_colorUsage[colorIndex].unite(usage);
+    }
+}
+
+
+/**
+    Append an unsigned value to a buffer as a varint, seven bits per byte with
+    the high bit set on all but the last byte.
+    */
+static void appendVarint(QByteArray &buffer, quint32 value)
+{
+    while (value >= 0x80) {
+        buffer.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+
+    buffer.append(char(value));
+}
+
+
+/**
+    Decode a varint written by appendVarint.
+    @param data the position in the buffer, advanced past the varint
+    @param end the end of the buffer
+    @param value set to the value read
+    @return true if the varint was read, false if it was truncated or too long
+    */
+static inline bool decodeVarint(const uchar *&data, const uchar *end, quint32 &value)
+{
+    if (data < end && *data < 0x80) {
+        value = *data++;
+        return true;
+    }
+
+    value = 0;
+
+    for (int shift = 0 ; shift < 35 && data < end ; shift += 7) {
+        uchar byte = *data++;
+        value |= quint32(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+    Compare the stitches of two cells.
+    @return true if both cells are empty or have the same stitches in the same order
+    */
+static bool sameStitches(const StitchQueue *a, const StitchQueue *b)
+{
+    if (a == nullptr || b == nullptr) {
+        return a == b;
+    }
+
+    if (a->count() != b->count()) {
+        return false;
+    }
+
+    for (int i = 0 ; i < a->count() ; ++i) {
+        if (a->at(i)->type != b->at(i)->type || a->at(i)->colorIndex != b->at(i)->colorIndex) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+    Encode the cells of the pattern for version 104.
+    Each row is a sequence of runs of cells having the same stitches, covering
+    the width of the row.  A run is its length and the number of stitches in each
+    cell followed by the type and color index of each stitch, an empty run having
+    no stitches.  All values are varints except the type which is a single byte.
+    */
+static QByteArray encodeStitches(const QVector<StitchQueue *> &stitches, int width, int height)
+{
+    QByteArray buffer;
+
+    for (int row = 0 ; row < height ; ++row) {
+        const StitchQueue *const *cells = stitches.constData() + row * width;
+        int column = 0;
+
+        while (column < width) {
+            const StitchQueue *stitchQueue = cells[column];
+            int length = 1;
+
+            while (column + length < width && sameStitches(stitchQueue, cells[column + length])) {
+                ++length;
+            }
+
+            appendVarint(buffer, length);
+            appendVarint(buffer, (stitchQueue) ? stitchQueue->count() : 0);
+
+            if (stitchQueue) {
+                foreach (const Stitch *stitch, *stitchQueue) {
+                    buffer.append(char(stitch->type));
+                    appendVarint(buffer, quint32(stitch->colorIndex));
+                }
+            }
+
+            column += length;
+        }
+    }
+
+    return buffer;
+}
+
+
+/**
+    Decode the cells written by encodeStitches directly into the cells of the
+    pattern, which must be empty.  The whole section is parsed from the one
+    buffer, each run being checked against the width of its row and the end of
+    the buffer before its cells are filled.
+    @param buffer the decompressed cells
+    @param cells the cells of the pattern in row order
+    @param width the width of the pattern
+    @param height the height of the pattern
+    @return true if the buffer decoded to exactly the size of the pattern, false
+    if it was invalid, the cells filled so far are left in place
+    */
+static bool decodeStitches(const QByteArray &buffer, StitchQueue **cells, int width, int height)
+{
+    const uchar *data = reinterpret_cast<const uchar *>(buffer.constData());
+    const uchar *end = data + buffer.size();
+    QVarLengthArray<Stitch, 8> run;
+
+    for (int row = 0 ; row < height ; ++row, cells += width) {
+        int column = 0;
+
+        while (column < width) {
+            quint32 length;
+            quint32 count;
+
+            // each stitch takes at least two bytes, a type and a color index
+            if (!decodeVarint(data, end, length) || !decodeVarint(data, end, count)
+                    || length == 0 || length > quint32(width - column) || count > quint32(end - data) / 2) {
+                return false;
+            }
+
+            if (count) {
+                run.resize(count);
+
+                for (quint32 i = 0 ; i < count ; ++i) {
+                    quint32 colorIndex;
+
+                    if (data == end) {
+                        return false;
+                    }
+
+                    run[i].type = static_cast<Stitch::Type>(*data++);
+
+                    if (!decodeVarint(data, end, colorIndex)) {
+                        return false;
+                    }
+
+                    run[i].colorIndex = int(colorIndex);
+                }
+
+                for (quint32 i = 0 ; i < length ; ++i) {
+                    StitchQueue *stitchQueue = new StitchQueue;
+                    stitchQueue->reserve(count);
+
+                    for (quint32 j = 0 ; j < count ; ++j) {
+                        stitchQueue->append(new Stitch(run[j].type, run[j].colorIndex));
+                    }
+
+                    cells[column + i] = stitchQueue;
+                }
+            }
+
+            column += length;
+        }
+    }
+
+    return data == end;
+}
+
+
+/**
+    Make this an encoded copy of another StitchData to be written on another
+    thread.  The cells are encoded as they are written and the backstitches
+    and knots are streamed, so no stitch is copied and the slow compression
+    is left to the thread writing the copy.  The copy has no cells and can
+    only be written.
+    @param other the StitchData to copy
+    */
+void StitchData::snapshot(const StitchData &other)
+{
+    clear();
+    m_stitches.clear();
+    m_width = other.m_width;
+    m_height = other.m_height;
+    m_encoded = true;
+    m_encodedStitches = encodeStitches(other.m_stitches, other.m_width, other.m_height);
+
+    QDataStream stream(&m_encodedLines, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_0); // maintain consistancy in the qt types
+    stream << qint32(other.m_backstitches.count());
+
+    foreach (const Backstitch *backstitch, other.m_backstitches) {
+        stream << *backstitch;
+    }
+
+    stream << qint32(other.m_knots.count());
+
+    foreach (const Knot *knot, other.m_knots) {
+        stream << *knot;
+    }
+}
+
+
+QDataStream &operator<<(QDataStream &stream, const StitchData &stitchData)
+{
+    stream << qint32(stitchData.version);
+    stream << qint32(stitchData.m_width);
+    stream << qint32(stitchData.m_height);
+
+    if (stitchData.m_encoded) {
+        stream << qCompress(stitchData.m_encodedStitches);
+        stream.writeRawData(stitchData.m_encodedLines.constData(), stitchData.m_encodedLines.size());
+
+        if (stream.status() != QDataStream::Ok) {
+            throw FailedWriteFile(stream.status());
+        }
+
+        return stream;
+    }
+
+    stream << qCompress(encodeStitches(stitchData.m_stitches, stitchData.m_width, stitchData.m_height));
+
     QListIterator<Backstitch *> backstitchIterator(stitchData.m_backstitches);
     stream << qint32(stitchData.m_backstitches.count());
 
@@ -1001,34 +1603,104 @@ QDataStream &operator<<(QDataStream &stream, const StitchData &stitchData)
 }
 
 
-QDataStream &operator>>(QDataStream &stream, StitchData &stitchData)
+/**
+    Read the size of the pattern and resize the StitchData to it.
+    */
+static void readSize(QDataStream &stream, StitchData &stitchData)
 {
-    qint32 version;
     qint32 width;
     qint32 height;
+
+    stream >> width;
+    stream >> height;
+
+    if (stream.status() != QDataStream::Ok || width < 0 || height < 0) {
+        throw FailedReadFile(QString(i18n("Invalid stitch data")));
+    }
+
+    stitchData.resize(width, height);
+}
+
+
+/**
+    Read a stitch queue of version 100 to 103 into its cell.  Queues outside
+    the pattern were ignored by earlier versions, so they are read and deleted.
+    A second queue for a cell replaces the first.
+    */
+static void readStitchQueue(QDataStream &stream, StitchData &stitchData, int column, int row)
+{
+    StitchQueue *stitchQueue = new StitchQueue;
+    stream >> *stitchQueue;
+
+    if (column >= 0 && column < stitchData.width() && row >= 0 && row < stitchData.height()) {
+        delete stitchData.replaceStitchQueueAt(column, row, stitchQueue);
+    } else {
+        delete stitchQueue;
+    }
+}
+
+
+QDataStream &operator>>(QDataStream &stream, StitchData &stitchData)
+{
+    qint32 version;
     qint32 layers;
     qint32 columns;
     qint32 rows;
     qint32 count;
-    QHash<int, QHash<int, StitchQueue *> > stitches;
+    qint32 layer;
+    qint32 column;
+    qint32 row;
+    QByteArray encoded;
 
     stitchData.clear();
 
     stream >> version;
 
     switch (version) {
+    case 104:
+        readSize(stream, stitchData);
+        stream >> encoded;
+
+        if (stream.status() == QDataStream::Ok) {
+            if (!decodeStitches(qUncompress(encoded), stitchData.m_stitches.data(), stitchData.m_width, stitchData.m_height)) {
+                throw FailedReadFile(QString(i18n("Invalid stitch data")));
+            }
+        }
+
+        stream >> count;
+
+        if (count < 0) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data")));
+        }
+
+        while (count-- > 0 && stream.status() == QDataStream::Ok) {
+            Backstitch *backstitch = new Backstitch;
+            stream >> *(backstitch);
+            stitchData.addBackstitch(backstitch);
+        }
+
+        stream >> count;
+
+        if (count < 0) {
+            throw FailedReadFile(QString(i18n("Invalid stitch data")));
+        }
+
+        while (count-- > 0 && stream.status() == QDataStream::Ok) {
+            Knot *knot = new Knot;
+            stream >> *knot;
+            stitchData.addFrenchKnot(knot);
+        }
+
+        break;
+
     case 103:
-        stream >> width;
-        stream >> height;
-        stitchData.resize(width, height);
+        readSize(stream, stitchData);
         stream >> count;
 
-        while (count--) {
-            stream >> columns;
-            stream >> rows;
-            StitchQueue *stitchQueue = new StitchQueue;
-            stitchData.replaceStitchQueueAt(columns, rows, stitchQueue);
-            stream >> *stitchQueue;
+        while (count-- > 0 && stream.status() == QDataStream::Ok) {
+            stream >> column;
+            stream >> row;
+            readStitchQueue(stream, stitchData, column, row);
         }
 
         stream >> count;
@@ -1050,33 +1722,16 @@ QDataStream &operator>>(QDataStream &stream, StitchData &stitchData)
         break;
 
     case 102:
-        stream >> width;
-        stream >> height;
-        stitchData.resize(width, height);
-
+        readSize(stream, stitchData);
         stream >> columns;
 
-        while (columns--) {
+        while (columns-- > 0 && stream.status() == QDataStream::Ok) {
             stream >> rows;
 
-            while (rows--) {
-                qint32 column;
-                qint32 row;
-
+            while (rows-- > 0 && stream.status() == QDataStream::Ok) {
                 stream >> column;
                 stream >> row;
-
-                StitchQueue *stitchQueue = new StitchQueue;
-                stitches[column][row] = stitchQueue;
-                stream >> *stitchQueue;
-            }
-        }
-
-        for (int y = 0 ; y < height ; ++y) {
-            for (int x = 0 ; x < width ; ++x) {
-                if (stitches[x][y]) {
-                    stitchData.replaceStitchQueueAt(x, y, stitches[x][y]);
-                }
+                readStitchQueue(stream, stitchData, column, row);
             }
         }
 
@@ -1099,72 +1754,37 @@ QDataStream &operator>>(QDataStream &stream, StitchData &stitchData)
         break;
 
     case 101:
-        stream >> width;
-        stream >> height;
-        stitchData.resize(width, height);
-
+        readSize(stream, stitchData);
         stream >> columns;
 
-        while (columns--) {
+        while (columns-- > 0 && stream.status() == QDataStream::Ok) {
             stream >> rows;
 
-            while (rows--) {
-                qint32 column;
-                qint32 row;
-
+            while (rows-- > 0 && stream.status() == QDataStream::Ok) {
                 stream >> column;
                 stream >> row;
-
-                StitchQueue *stitchQueue = new StitchQueue;
-                stitches[column][row] = stitchQueue;
-                stream >> *stitchQueue;
-            }
-        }
-
-        for (int y = 0 ; y < height ; ++y) {
-            for (int x = 0 ; x < width ; ++x) {
-                if (stitches[x][y]) {
-                    stitchData.replaceStitchQueueAt(x, y, stitches[x][y]);
-                }
+                readStitchQueue(stream, stitchData, column, row);
             }
         }
 
         break;
 
     case 100:
-        stream >> width;
-        stream >> height;
-        stitchData.m_width = width;
-        stitchData.m_height = height;
-
+        // earlier versions set the size without resizing, leaving no cells to put the stitches in
+        readSize(stream, stitchData);
         stream >> layers;
 
-        while (layers--) {
+        while (layers-- > 0 && stream.status() == QDataStream::Ok) {
             stream >> columns;
 
-            while (columns--) {
+            while (columns-- > 0 && stream.status() == QDataStream::Ok) {
                 stream >> rows;
 
-                while (rows--) {
-                    qint32 layer;
-                    qint32 column;
-                    qint32 row;
-
+                while (rows-- > 0 && stream.status() == QDataStream::Ok) {
                     stream >> layer;
                     stream >> column;
                     stream >> row;
-
-                    StitchQueue *stitchQueue = new StitchQueue;
-                    stitches[column][row] = stitchQueue;
-                    stream >> *stitchQueue;
-                }
-            }
-        }
-
-        for (int y = 0 ; y < height ; ++y) {
-            for (int x = 0 ; x < width ; ++x) {
-                if (stitches[x][y]) {
-                    stitchData.replaceStitchQueueAt(x, y, stitches[x][y]);
+                    readStitchQueue(stream, stitchData, column, row);
                 }
             }
         }
@@ -13,9 +13,12 @@
 #define StitchData_H
 
 
+#include <QByteArray>
+#include <QHash>
 #include <QList>
 #include <QListIterator>
 #include <QMap>
+#include <QPair>
 #include <QPoint>
 #include <QRect>
 #include <QSharedDataPointer>
@@ -41,6 +44,35 @@ public:
 };
 
 
+/**
+    Positional index of where a single color is used in a StitchData.
+    Cells are indexes into the stitch grid and positions hold a bit for
+    each of the first maskPositions entries of the cell's queue using the
+    color.  Entries of longer queues beyond the mask are recorded
+    individually as a cell and position in overflow.  Backstitches and
+    knots are recorded as indexes into their lists.  All entries are kept
+    in ascending order.  Being positional, the index only remains valid
+    while every change made since it was taken has been undone, which the
+    commands restoring items at their original positions ensure.
+    */
+class ColorUsage
+{
+public:
+    bool isEmpty() const;
+
+    void unite(const ColorUsage &);
+    void subtract(const ColorUsage &);
+
+    static const int maskPositions = 32;
+
+    QVector<int>                cells;
+    QVector<quint32>            positions;
+    QVector<QPair<int, int> >   overflow;
+    QVector<int>                backstitches;
+    QVector<int>                knots;
+};
+
+
 class StitchData
 {
 public:
@@ -54,6 +86,8 @@ public:
     ~StitchData();
 
     void clear();
+    void swap(StitchData &);
+    void snapshot(const StitchData &);
 
     int width() const;
     int height() const;
@@ -73,27 +107,35 @@ public:
     Stitch *findStitch(const QPoint &, Stitch::Type, int);
     void deleteStitch(const QPoint &, Stitch::Type, int);
 
+    bool isValid(int, int) const;
     StitchQueue *stitchQueueAt(int, int);
     StitchQueue *stitchQueueAt(const QPoint &);
+    const StitchQueue *stitchQueueAt(int, int) const;
+    const StitchQueue *stitchQueueAt(const QPoint &) const;
     StitchQueue *takeStitchQueueAt(int, int);
     StitchQueue *takeStitchQueueAt(const QPoint &);
     StitchQueue *replaceStitchQueueAt(int, int, StitchQueue *);
     StitchQueue *replaceStitchQueueAt(const QPoint &, StitchQueue *);
+    StitchQueue **stitchQueueRow(int);
 
     void addBackstitch(const QPoint &, const QPoint &, int);
     void addBackstitch(Backstitch *);
+    void insertBackstitch(int, Backstitch *);
     Backstitch *findBackstitch(const QPoint &, const QPoint &, int);
     Backstitch *takeBackstitch(const QPoint &, const QPoint &, int);
     Backstitch *takeBackstitch(Backstitch *);
 
     void addFrenchKnot(const QPoint &, int);
     void addFrenchKnot(Knot *);
+    void insertFrenchKnot(int, Knot *);
     Knot *findKnot(const QPoint &, int);
     Knot *takeFrenchKnot(const QPoint &, int);
     Knot *takeFrenchKnot(Knot *);
 
     QList<Backstitch *> &backstitches();
     QList<Knot *> &knots();
+    const QList<Backstitch *> &backstitches() const;
+    const QList<Knot *> &knots() const;
 
     QListIterator<Backstitch *> backstitchIterator();
     QMutableListIterator<Backstitch *> mutableBackstitchIterator();
@@ -101,6 +143,9 @@ public:
     QMutableListIterator<Knot *> mutableKnotIterator();
 
     QMap<int, FlossUsage> flossUsage();
+    ColorUsage colorUsage(int) const;
+    QHash<int, ColorUsage> colorUsage() const;
+    void recolor(const ColorUsage &, int);
 
     friend QDataStream &operator<<(QDataStream &, const StitchData &);
     friend QDataStream &operator>>(QDataStream &, StitchData &);
@@ -111,9 +156,8 @@ private:
     void    rotateQueue(Rotation, StitchQueue *);
     int     index(int, int) const;
     int     index(const QPoint &) const;
-    bool    isValid(int x, int y) const;
 
-    static const int version = 103;
+    static const int version = 104;
 
     int m_width;
     int m_height;
@@ -121,6 +165,13 @@ private:
     QVector<StitchQueue *>                  m_stitches;
     QList<Backstitch *>                     m_backstitches;
     QList<Knot *>                           m_knots;
+
+    bool                                    m_encoded;
+    QByteArray                              m_encodedStitches;
+    QByteArray                              m_encodedLines;
+
+    mutable QHash<int, ColorUsage>          m_colorUsage;
+    mutable bool                            m_colorUsageValid;
 };
 
 
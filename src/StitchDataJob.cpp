@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#include "StitchDataJob.h"
+
+#include <QEventLoop>
+#include <QProgressDialog>
+
+#include <KLocalizedString>
+
+#include "StitchData.h"
+
+
+StitchDataJob::StitchDataJob(const StitchData &source, const Transform &transform, QObject *parent)
+    :   QThread(parent),
+        m_source(source),
+        m_transform(transform),
+        m_result(nullptr),
+        m_canceled(0)
+{
+}
+
+
+StitchDataJob::~StitchDataJob()
+{
+    wait();
+    delete m_result;
+}
+
+
+/**
+    Run a transformation with a modal progress dialog.
+    The dialog blocks input to the application while the job runs, so the
+    source can not be edited, but the event loop keeps the windows painted.
+    The dialog shows the rows copied, then shows busy without the cancel
+    button while the transform is applied.
+    @param parent the parent widget for the progress dialog
+    @param label the text shown in the progress dialog
+    @param source the StitchData to be copied and transformed
+    @param transform the transformation applied to the copy
+    @return a pointer to the transformed copy owned by the caller, or
+    nullptr if the job was canceled
+    */
+StitchData *StitchDataJob::execute(QWidget *parent, const QString &label, const StitchData &source, const Transform &transform)
+{
+    QProgressDialog progress(label, i18n("Cancel"), 0, source.height(), parent);
+    progress.setWindowModality(Qt::ApplicationModal);
+    progress.setMinimumDuration(0);
+    progress.show();
+
+    StitchDataJob job(source, transform);
+    QEventLoop loop;
+
+    connect(&job, &StitchDataJob::progress, &progress, &QProgressDialog::setValue);
+    connect(&job, &QThread::finished, &loop, &QEventLoop::quit);
+    connect(&progress, &QProgressDialog::canceled, &job, &StitchDataJob::cancel);
+    connect(&job, &StitchDataJob::transforming, &progress, [&progress]() {
+        progress.setCancelButton(nullptr);
+        progress.setRange(0, 0);
+    });
+
+    job.start();
+    loop.exec();
+
+    return job.takeResult();
+}
+
+
+StitchData *StitchDataJob::takeResult()
+{
+    StitchData *result = m_result;
+    m_result = nullptr;
+
+    return result;
+}
+
+
+void StitchDataJob::cancel()
+{
+    m_canceled.store(1);
+}
+
+
+void StitchDataJob::run()
+{
+    StitchData *stitchData = new StitchData;
+    stitchData->resize(m_source.width(), m_source.height());
+
+    for (int row = 0 ; row < m_source.height() ; ++row) {
+        if (m_canceled.load()) {
+            delete stitchData;
+            return;
+        }
+
+        for (int column = 0 ; column < m_source.width() ; ++column) {
+            if (const StitchQueue *stitchQueue = m_source.stitchQueueAt(column, row)) {
+                stitchData->replaceStitchQueueAt(column, row, new StitchQueue(stitchQueue));
+            }
+        }
+
+        emit progress(row);
+    }
+
+    foreach (const Backstitch *backstitch, m_source.backstitches()) {
+        stitchData->addBackstitch(backstitch->start, backstitch->end, backstitch->colorIndex);
+    }
+
+    foreach (const Knot *knot, m_source.knots()) {
+        stitchData->addFrenchKnot(knot->position, knot->colorIndex);
+    }
+
+    if (m_canceled.load()) {
+        delete stitchData;
+        return;
+    }
+
+    emit transforming();
+    m_transform(*stitchData);
+    m_result = stitchData;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2026 by Stephen Allewell
+ * steve.allewell@gmail.com
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+
+#ifndef StitchDataJob_H
+#define StitchDataJob_H
+
+
+#include <QAtomicInt>
+#include <QThread>
+
+#include <functional>
+
+
+class QString;
+class QWidget;
+
+class StitchData;
+
+
+/**
+    Run a whole pattern transformation on a worker thread.
+    The source StitchData is copied on the worker thread and the transform
+    applied to the copy, the source is only read so the GUI thread must
+    not modify it until the job has finished.  Progress is reported and
+    cancel checked for each row copied.  The transforms only move the copied
+    stitch queues, so once the copy is complete the transform runs to the end.
+    */
+class StitchDataJob : public QThread
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<void(StitchData &)> Transform;
+
+    StitchDataJob(const StitchData &, const Transform &, QObject *parent = nullptr);
+    virtual ~StitchDataJob();
+
+    static StitchData *execute(QWidget *, const QString &, const StitchData &, const Transform &);
+
+    StitchData *takeResult();
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(int);
+    void transforming();
+
+protected:
+    virtual void run() Q_DECL_OVERRIDE;
+
+private:
+    const StitchData    &m_source;
+    Transform           m_transform;
+    StitchData          *m_result;
+    QAtomicInt          m_canceled;
+};
+
+
+#endif // StitchDataJob_H